@@ -0,0 +1,247 @@
+/* Include the bar directly, to run its frames without a compositor */
+#include "../src/bar.c"
+
+#include "bench.h"
+
+#include <gaybar/draw.h>
+#include <gaybar/params.h>
+
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#define BENCH_ZONES 9
+
+static const char* g_texts[] = {
+  "BAT: 01:23 left",
+  "CPU 12%",
+  "wlan0 up 192.168.1.2"
+};
+
+static void noop(void) {
+}
+
+/* Owns a resizable zone, which the frames draw on themselves */
+static struct zone* g_zone;
+static size_t g_zone_inits, g_zone_cleanups;
+
+static void* zone_init(struct module_init_data* init_data) {
+  struct zone_size size = { 8, 8, 512 };
+
+  ++g_zone_inits;
+  g_zone = bar_alloc_resizable_zone(init_data->position, size,
+                                    init_data->handle);
+  return g_zone;
+}
+
+static void zone_render(void* instance) {
+  UNUSED(instance);
+}
+
+static void zone_cleanup(void* instance) {
+  struct zone* zone = instance;
+
+  ++g_zone_cleanups;
+  bar_destroy_zone(&zone);
+}
+
+static struct module g_zone_module = {
+  .abi_version = MODULE_ABI_VERSION,
+  .name = "bench",
+  .callbacks = {
+    .init = zone_init,
+    .render = zone_render,
+    .cleanup = zone_cleanup
+  }
+};
+
+static void run_frame(struct zone** zones, size_t frame) {
+  size_t i;
+  const char* text;
+  struct draw* draw;
+
+  /* Like the modules that poll with one-shot tasks */
+  sched_task_delete(sched_task_delayed(noop, 1000));
+
+  /* Every zone changes, and some of them change size */
+  for (i = 0; i < BENCH_ZONES; ++i) {
+    text = g_texts[(i + frame) % ARRAY_LENGTH(g_texts)];
+    zone_resize(zones[i], font_string_width(text) + 8);
+  }
+
+  layout();
+  module_render_dirty();
+
+  for (i = 0; i < BENCH_ZONES; ++i) {
+    text = g_texts[(i + frame) % ARRAY_LENGTH(g_texts)];
+    draw_on_zone(zones[i], draw) {
+      draw_rect(draw,
+                0, 0,
+                draw_width(draw), draw_height(draw),
+                g_bar.background_color.as_u32);
+      draw_string(draw, 4, 0, text, g_bar.foreground_color.as_u32);
+    }
+  }
+
+  render();
+}
+
+/* Every iteration is a whole frame. Once the caches are warm and the
+ * buffers have grown to their size, it must not touch the heap.
+ */
+BENCH(bar_frame_steady_state) {
+  size_t i, frame;
+  struct zone* zones[BENCH_ZONES];
+  struct module_instance* instances[BENCH_ZONES];
+
+  for (i = 0; i < BENCH_ZONES; ++i) {
+    instances[i] = module_init(&g_zone_module, NULL, i % ZONE_POSITION_MAX);
+    zones[i] = g_zone;
+  }
+
+  for (frame = 0; frame < ARRAY_LENGTH(g_texts); ++frame)
+    run_frame(zones, frame);
+
+  BENCH_LOOP(b)
+    run_frame(zones, frame++);
+
+  ASSERT(b->allocations == 0 && "the steady state allocates");
+
+  for (i = 0; i < BENCH_ZONES; ++i)
+    module_cleanup(instances[i]);
+}
+
+static char g_config_file[64];
+static b8 g_reloaded;
+
+/* Like an editor would, the file is replaced in one go */
+static void write_config(const char* text) {
+  FILE* file;
+  char path[sizeof(g_config_file) + 4];
+
+  snprintf(path, sizeof(path), "%s.new", g_config_file);
+  file = fopen(path, "w");
+  ASSERT(file != NULL);
+  fputs(text, file);
+  ASSERT(fclose(file) == 0);
+  ASSERT(rename(path, g_config_file) == 0);
+}
+
+static void on_config_change(void) {
+  reload_config();
+  g_reloaded = true;
+}
+
+/* Runs the main loop until the config watch notices the file changed, then
+ * checks what became of the widgets.
+ */
+static void expect_reload(size_t kept, size_t initialized) {
+  size_t n, inits;
+  struct pollfd pfds[SCHED_MAX_WATCHES];
+
+  inits = g_zone_inits;
+  g_reloaded = false;
+  while (!g_reloaded) {
+    n = sched_watch_pollfds(pfds, ARRAY_LENGTH(pfds));
+    ASSERT(poll(pfds, n, 1000) > 0 && "the config change went unnoticed");
+    sched_watch_dispatch(pfds, n);
+  }
+
+  layout();
+  module_render_dirty();
+  render();
+
+  ASSERT(g_zone_inits - inits == initialized);
+  ASSERT(g_zone_inits - g_zone_cleanups == kept + initialized);
+}
+
+#define WIDGETS(left, right) \
+  "\"widgets\": { \"left\": [ " left " ], \"right\": [ " right " ] }"
+#define OWN_COLORS \
+  "\"colors\": { \"foreground\": \"#ffffff\", \"background\": \"#111111\" }"
+
+/* Walks through the reloads the bar has to handle, through the same file
+ * watch as the bar. Then every iteration reloads a config that didn't
+ * change, where every widget must be kept.
+ */
+BENCH(bar_reload_config) {
+  size_t inits, font_size;
+  char dir[] = "/tmp/gaybar-bench-XXXXXX";
+
+  ASSERT(mkdtemp(dir) != NULL);
+  snprintf(g_config_file, sizeof(g_config_file), "%s/config.jsonc", dir);
+  font_size = font_get_size();
+
+  write_config("{ " WIDGETS("\"bench#a\", \"bench#b\"", "\"bench#c\"") ", "
+               "\"bench#a\": { \"n\": 1 } }");
+  g_params.config_file = g_config_file;
+  config_load();
+  config_watch(on_config_change);
+  module_register(&g_zone_module);
+
+  inits = g_zone_inits;
+  init_widgets();
+  ASSERT(g_zone_inits - inits == 3);
+
+  /* Moving widgets around keeps them, unlike changing their config */
+  write_config("{ " WIDGETS("\"bench#b\", \"bench#a\"", "\"bench#c\"") ",\n"
+               "  // A comment changes nothing\n"
+               "  \"bench#a\": { \"n\": 2 } }");
+  expect_reload(2, 1);
+
+  /* A config that doesn't parse leaves everything as it is */
+  write_config("{ \"widgets\": ");
+  expect_reload(3, 0);
+
+  /* The same module may show up more than once */
+  write_config("{ " WIDGETS("\"bench#b\", \"bench#a\"",
+                            "\"bench#c\", \"bench#b\"") ", "
+               "\"bench#a\": { \"n\": 2 }, "
+               "\"bench#c\": { " OWN_COLORS " } }");
+  expect_reload(2, 2);
+
+  /* Only the widgets that use the colors of the bar follow them */
+  write_config("{ \"colors\": { \"background\": \"#000000\" }, "
+               WIDGETS("\"bench#b\", \"bench#a\"",
+                       "\"bench#c\", \"bench#b\"") ", "
+               "\"bench#a\": { \"n\": 2 }, "
+               "\"bench#c\": { " OWN_COLORS " } }");
+  expect_reload(1, 3);
+
+  /* Every width was measured with the old font */
+  write_config("{ \"font\": { \"size\": 12 }, "
+               "\"colors\": { \"background\": \"#000000\" }, "
+               WIDGETS("\"bench#b\", \"bench#a\"", "\"bench#c\"") ", "
+               "\"bench#a\": { \"n\": 2 }, "
+               "\"bench#c\": { " OWN_COLORS " } }");
+  expect_reload(0, 3);
+  ASSERT(font_get_size() == 12);
+
+  /* A font that can't be loaded leaves the current one, and the widgets */
+  write_config("{ \"font\": { \"path\": \"/nonexistent.ttf\" }, "
+               "\"colors\": { \"background\": \"#000000\" }, "
+               WIDGETS("\"bench#b\", \"bench#a\"", "\"bench#c\"") ", "
+               "\"bench#a\": { \"n\": 2 }, "
+               "\"bench#c\": { " OWN_COLORS " } }");
+  expect_reload(3, 0);
+  ASSERT(font_get_size() == 12);
+
+  BENCH_LOOP(b) {
+    inits = g_zone_inits;
+    reload_config();
+    ASSERT(g_zone_inits == inits);
+  }
+
+  /* Back to the defaults the other benchmarks run with */
+  write_config("{}");
+  expect_reload(0, 0);
+  ASSERT(font_get_size() == font_size);
+
+  module_unregister(&g_zone_module);
+  config_unwatch();
+  config_unload();
+  g_params.config_file = NULL;
+
+  unlink(g_config_file);
+  rmdir(dir);
+}
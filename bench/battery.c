@@ -0,0 +1,93 @@
+/* Include the module directly, to get at its parser */
+#include "../src/modules/battery.c"
+
+#include "bench.h"
+
+/* Taken from a laptop running in ACPI energy mode */
+static const char g_sample_uevent[] =
+  "POWER_SUPPLY_NAME=BAT1\n"
+  "POWER_SUPPLY_TYPE=Battery\n"
+  "POWER_SUPPLY_STATUS=Discharging\n"
+  "POWER_SUPPLY_PRESENT=1\n"
+  "POWER_SUPPLY_TECHNOLOGY=Li-poly\n"
+  "POWER_SUPPLY_CYCLE_COUNT=0\n"
+  "POWER_SUPPLY_VOLTAGE_MIN_DESIGN=15440000\n"
+  "POWER_SUPPLY_VOLTAGE_NOW=16808000\n"
+  "POWER_SUPPLY_POWER_NOW=6794000\n"
+  "POWER_SUPPLY_ENERGY_FULL_DESIGN=57000000\n"
+  "POWER_SUPPLY_ENERGY_FULL=54560000\n"
+  "POWER_SUPPLY_ENERGY_NOW=41570000\n"
+  "POWER_SUPPLY_CAPACITY=76\n"
+  "POWER_SUPPLY_CAPACITY_LEVEL=Normal\n"
+  "POWER_SUPPLY_MODEL_NAME=5B10W13930\n"
+  "POWER_SUPPLY_MANUFACTURER=SMP\n"
+  "POWER_SUPPLY_SERIAL_NUMBER=1234\n";
+
+BENCH(parse_uevent) {
+  struct battery_pack pack = {0};
+
+  check_property_keys();
+
+  pack.info.mode = ACPI_MODE_ENERGY;
+  estimator_init(&pack.estimator, ESTIMATOR_MODE_WINDOW,
+                 ESTIMATOR_DEFAULT_WINDOW);
+
+  BENCH_LOOP(b) {
+    BENCH_KEEP(parse_uevent(&pack, g_sample_uevent,
+                            STATIC_STRLEN(g_sample_uevent)));
+  }
+
+  estimator_destroy(&pack.estimator);
+}
+
+/* A whole update: read the uevent file and parse it */
+BENCH(update_uevent) {
+  int fd;
+  ssize_t length;
+  char path[] = "/tmp/gaybar-bench-uevent-XXXXXX";
+  char buffer[1024];
+  struct battery_pack pack = {0};
+
+  fd = mkstemp(path);
+  ASSERT(fd >= 0);
+  unlink(path);
+  ASSERT(write(fd, g_sample_uevent, STATIC_STRLEN(g_sample_uevent))
+         == STATIC_STRLEN(g_sample_uevent));
+
+  pack.info.mode = ACPI_MODE_ENERGY;
+  estimator_init(&pack.estimator, ESTIMATOR_MODE_WINDOW,
+                 ESTIMATOR_DEFAULT_WINDOW);
+
+  BENCH_LOOP(b) {
+    length = read_uevent_fd(fd, buffer, sizeof(buffer));
+    BENCH_KEEP(parse_uevent(&pack, buffer, length));
+  }
+
+  estimator_destroy(&pack.estimator);
+  close(fd);
+}
+
+/* Samples come on uevents and on the poll, at uneven times. The average
+ * must weigh them by the time they cover, over the window in seconds.
+ */
+BENCH(battery_estimator) {
+  u64 now_ms;
+  struct battery_estimator estimator = {0};
+
+  estimator_init(&estimator, ESTIMATOR_MODE_WINDOW, 60);
+  ASSERT(estimator_add(&estimator, 100, 0) == 100);
+  ASSERT(estimator_add(&estimator, 200, 30000) == 200);
+  /* A uevent a second later barely moves it */
+  ASSERT(estimator_add(&estimator, 400, 31000) == (200 * 30 + 400) / 31);
+  /* Past the window, only the samples it covers are left */
+  ASSERT(estimator_add(&estimator, 400, 61000) == (200 * 30 + 400 * 31) / 61);
+  ASSERT(estimator_add(&estimator, 400, 91000) == 400);
+
+  now_ms = 91000;
+  BENCH_LOOP(b) {
+    now_ms += 1000;
+    BENCH_KEEP(estimator_add(&estimator, now_ms & 1024, now_ms));
+  }
+
+  estimator_destroy(&estimator);
+}
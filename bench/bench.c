@@ -0,0 +1,136 @@
+#include "bench.h"
+
+#include <gaybar/params.h>
+#include <gaybar/bar.h>
+#include <gaybar/log.h>
+#include <gaybar/util.h>
+#include <gaybar/assert.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Run every benchmark for at least this long */
+#define BENCH_MIN_TIME_NS    200000000ULL
+#define BENCH_MAX_ITERATIONS 1000000000ULL
+
+struct params g_params = {0};
+struct list g_benches = LIST_UNINITIALIZED;
+
+static u64 g_allocations;
+
+/* We count allocations by interposing the libc allocator. This catches
+ * allocations made by shared libraries (freetype, fontconfig, ...) as well.
+ */
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t nmemb, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+
+void* malloc(size_t size) {
+  __atomic_add_fetch(&g_allocations, 1, __ATOMIC_RELAXED);
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t nmemb, size_t size) {
+  __atomic_add_fetch(&g_allocations, 1, __ATOMIC_RELAXED);
+  return __libc_calloc(nmemb, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  __atomic_add_fetch(&g_allocations, 1, __ATOMIC_RELAXED);
+  return __libc_realloc(ptr, size);
+}
+
+static inline u64 allocations(void) {
+  return __atomic_load_n(&g_allocations, __ATOMIC_RELAXED);
+}
+
+void _bench_register(struct bench* b) {
+  if (!list_is_initialized(&g_benches))
+    list_init(&g_benches);
+  /* Insert at the tail, so benchmarks run in registration order */
+  list_insert(g_benches.prev, &b->link);
+}
+
+void _bench_start(struct bench* b) {
+  b->remaining = b->iterations;
+  b->allocations = allocations();
+  monotonic_time(&b->start);
+}
+
+void _bench_stop(struct bench* b) {
+  monotonic_time(&b->end);
+  b->allocations = allocations() - b->allocations;
+}
+
+static u64 elapsed_ns(struct bench* b) {
+  return (b->end.tv_sec - b->start.tv_sec) * 1000000000ULL
+         + (b->end.tv_nsec - b->start.tv_nsec);
+}
+
+static void run_bench(struct bench* b) {
+  u64 ns, n, next;
+
+  n = 1;
+  for (;;) {
+    b->iterations = n;
+    b->end.tv_sec = b->end.tv_nsec = 0;
+    b->run(b);
+    ASSERT((b->end.tv_sec | b->end.tv_nsec) != 0 && "BENCH_LOOP(..) not run");
+
+    ns = elapsed_ns(b);
+    if (ns >= BENCH_MIN_TIME_NS || n >= BENCH_MAX_ITERATIONS)
+      break;
+
+    /* Aim 20% past the minimum time, but don't grow more than 100x per run */
+    next = ns == 0 ? n * 100 : (BENCH_MIN_TIME_NS * 6 / 5) * n / ns;
+    n = clamp(next, n + 1, min(n * 100, BENCH_MAX_ITERATIONS));
+  }
+
+  printf("%-32s %12lu %12.1f ns/op %10.2f allocs/op\n",
+         b->name, n, (f64)ns / n, (f64)b->allocations / n);
+}
+
+static b8 should_run(struct bench* b, int argc, char* argv[]) {
+  int i;
+
+  if (argc < 2)
+    return true;
+
+  for (i = 1; i < argc; ++i) {
+    if (strstr(b->name, argv[i]) != NULL)
+      return true;
+  }
+
+  return false;
+}
+
+int main(int argc, char* argv[]) {
+  int rc;
+  struct bench* b;
+
+  log_init();
+
+  /* Don't take over the sockets of a running bar */
+  unsetenv("XDG_RUNTIME_DIR");
+
+  /* No config is loaded, so everything runs with the default options */
+  rc = bar_init();
+  if (rc < 0) {
+    log_error("could not initialize the bar");
+    goto out;
+  }
+
+  if (list_is_initialized(&g_benches)) {
+    list_for_each(b, &g_benches, link) {
+      if (should_run(b, argc, argv))
+        run_bench(b);
+    }
+  }
+
+  rc = 0;
+out:
+  bar_cleanup();
+  log_cleanup();
+  return rc < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
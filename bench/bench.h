@@ -0,0 +1,56 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <gaybar/types.h>
+#include <gaybar/list.h>
+#include <gaybar/compiler.h>
+
+#include <time.h>
+
+struct bench {
+  struct list link;
+  const char* name;
+  void (*run)(struct bench* b);
+  /* Filled in by the harness */
+  u64 iterations;
+  u64 remaining;
+  u64 allocations;
+  struct timespec start, end;
+};
+
+extern struct list g_benches;
+
+void _bench_register(struct bench* b);
+void _bench_start(struct bench* b);
+void _bench_stop(struct bench* b);
+
+static inline b8 _bench_next(struct bench* b) {
+  if (b->remaining-- > 0)
+    return true;
+  _bench_stop(b);
+  return false;
+}
+
+/* Defines a benchmark function. The body should do its setup, then run the
+ * code to measure inside BENCH_LOOP(b) { .. }, then do its teardown.
+ */
+#define BENCH(_name)                                      \
+  static void bench_##_name(struct bench* b);             \
+  static struct bench g_bench_##_name = {                 \
+    .name = #_name,                                       \
+    .run = bench_##_name                                  \
+  };                                                      \
+  static void CONSTRUCTOR _register_bench_##_name(void) { \
+    _bench_register(&g_bench_##_name);                    \
+  }                                                       \
+  static void bench_##_name(struct bench* b)
+
+/* Only the code inside the loop is timed and counted. */
+#define BENCH_LOOP(b) \
+  for (_bench_start(b); _bench_next(b);)
+
+/* Prevent the compiler from optimizing away a computed value */
+#define BENCH_KEEP(x) \
+  __asm__ volatile("" : : "r,m"(x) : "memory")
+
+#endif
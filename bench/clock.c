@@ -0,0 +1,58 @@
+/* Include the module directly, to get at its renderer */
+#include "../src/modules/clock.c"
+
+#include "bench.h"
+
+#define SAMPLE_FORMAT "%H:%M:%S"
+#define SAMPLE_TEXT   "23:59:58"
+
+static struct clock_instance* create_instance(void) {
+  struct clock_instance* instance;
+
+  instance = zalloc(sizeof(*instance));
+  ASSERT(instance != NULL);
+
+  instance->format = SAMPLE_FORMAT;
+  instance->fg_color = COLOR(0xEE, 0xEE, 0xEE);
+  instance->bg_color = COLOR(0x1D, 0x1D, 0x1D);
+  instance->strip.height = bar_get_thickness();
+  strip_preload(instance, CLOCK_PRELOAD_GLYPHS);
+  instance->zone = bar_alloc_zone(ZONE_POSITION_RIGHT, compute_width(instance));
+  memcpy(instance->text, SAMPLE_TEXT, sizeof(SAMPLE_TEXT));
+
+  return instance;
+}
+
+static void destroy_instance(struct clock_instance* instance) {
+  bar_destroy_zone(&instance->zone);
+  free(instance->strip.pixels);
+  free(instance);
+}
+
+/* A frame composed from the glyph strip */
+BENCH(clock_render_strip) {
+  struct clock_instance* instance = create_instance();
+
+  BENCH_LOOP(b)
+    clock_render(instance);
+
+  destroy_instance(instance);
+}
+
+/* The same frame through the font renderer, for comparison */
+BENCH(clock_render_string) {
+  struct draw* draw;
+  struct clock_instance* instance = create_instance();
+
+  BENCH_LOOP(b) {
+    draw_on_zone(instance->zone, draw) {
+      draw_rect(draw,
+                0, 0,
+                draw_width(draw), draw_height(draw),
+                instance->bg_color.as_u32);
+      draw_string(draw, 4, 0, instance->text, instance->fg_color.as_u32);
+    }
+  }
+
+  destroy_instance(instance);
+}
@@ -0,0 +1,96 @@
+/* Include the config directly, to parse from memory instead of a file */
+#include "../src/config.c"
+
+#include "bench.h"
+
+/* A typical config, with a few widgets and comments */
+static const char g_sample_config[] =
+  ""
+  "{\n"
+  "  \"position\": \"top\",\n"
+  "  \"thickness\": 24,\n"
+  "  \"font\": { \"name\": \"monospace\", \"size\": 14 },\n"
+  "  \"colors\": {\n"
+  "    \"foreground\": \"#ffffff\",\n"
+  "    \"background\": \"#1e1e2e\"\n"
+  "  },\n"
+  "  \"widgets\": {\n"
+  "    \"left\": [ \"i3bar\" ],\n"
+  "    \"center\": [ \"clock\" ],\n"
+  "    \"right\": [ \"network\", \"cpu\", \"memory\", \"disk\", \"thermal\",\n"
+  "               \"battery\" ]\n"
+  "  },\n"
+  "  /* Every widget has its own section */\n"
+  "  \"i3bar\": { \"command\": \"i3status\", \"width\": 600 },\n"
+  "  \"clock\": { \"format\": \"%a %d %b %H:%M:%S\" },\n"
+  "  \"network\": {\n"
+  "    \"interface\": \"wlan0\",\n"
+  "    \"format\": \"%n %a \\u2193%d \\u2191%u\",\n"
+  "    \"colors\": { \"foreground\": \"#a6e3a1\" }\n"
+  "  },\n"
+  "  \"cpu\": { \"interval\": 1000, \"graph\": true },\n"
+  "  \"memory\": { \"format\": \"MEM %u/%t\" },\n"
+  "  \"disk\": { \"mount\": \"/\", \"device\": \"nvme0n1\", \"timeout\": 500 },\n"
+  "  \"thermal\": {\n"
+  "    \"sensors\": [ \"coretemp/Package id 0\", \"nvme/Composite\" ],\n"
+  "    \"warning\": 70,\n"
+  "    \"critical\": 90\n"
+  "  },\n"
+  "  \"battery\": {\n"
+  "    \"names\": [ \"BAT0\", \"BAT1\" ],\n"
+  "    \"breakdown\": true,\n"
+  "    \"estimator\": \"ewma\",\n"
+  "    \"window\": 30\n"
+  "  }\n"
+  "}\n";
+
+/* Every iteration parses the config, and reads a few parameters from it */
+BENCH(config_parse) {
+  long thickness;
+  const char* format;
+  struct config_node* network;
+  char content[sizeof(g_sample_config)];
+
+  BENCH_LOOP(b) {
+    /* Strings are unescaped in place */
+    memcpy(content, g_sample_config, sizeof(content));
+    g_config = parse_config(content, sizeof(content) - 1);
+    ASSERT(g_config != NULL);
+
+    CONFIG_PARSE(CONFIG_ROOT,
+      CONFIG_PARAM(
+        CONFIG_PARAM_NAME("thickness"),
+        CONFIG_PARAM_TYPE(INTEGER),
+        CONFIG_PARAM_STORE(thickness),
+        CONFIG_PARAM_DEFAULT(0)
+      )
+    );
+    network = config_get_node(CONFIG_ROOT, "network");
+    CONFIG_PARSE(network,
+      CONFIG_PARAM(
+        CONFIG_PARAM_NAME("format"),
+        CONFIG_PARAM_TYPE(STRING),
+        CONFIG_PARAM_STORE(format),
+        CONFIG_PARAM_DEFAULT(NULL)
+      )
+    );
+    BENCH_KEEP(thickness);
+    BENCH_KEEP(format);
+
+    ASSERT(thickness == 24);
+    ASSERT(!strcmp(format, "%n %a \u2193%d \u2191%u"));
+    /* Equal strings are stored once */
+    ASSERT(config_get_node(CONFIG_ROOT, "clock")->name ==
+           config_get_node(CONFIG_ROOT, "widgets")->children.first->next
+             ->children.first->string);
+
+    config_unload();
+  }
+
+  /* A comment left open after the config must not be taken as its end */
+  {
+    char unterminated[] = "{ \"thickness\": 24 } /* open";
+
+    ASSERT(parse_config(unterminated, sizeof(unterminated) - 1) == NULL);
+  }
+}
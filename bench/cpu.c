@@ -0,0 +1,72 @@
+/* Include the module directly, to get at its parser */
+#include "../src/modules/cpu.c"
+
+#include "bench.h"
+
+#define BENCH_CORES 128
+
+/* Percentage of time core i is busy, the rest it's idle */
+static u64 core_busy(size_t i) {
+  return i % 101;
+}
+
+/* Generates a /proc/stat like buffer, with the lines that follow the cpu
+ * ones, as the kernel puts them there too. Every tick, each core spends
+ * 100 jiffies.
+ */
+static void generate_stat(char* buffer, size_t buffer_size, u64 tick) {
+  size_t i, length;
+  u64 busy;
+
+  busy = 0;
+  for (i = 0; i < BENCH_CORES; ++i)
+    busy += core_busy(i);
+
+  length = snprintf(buffer, buffer_size,
+                    "cpu  %lu 1204 500000 %lu 4321 0 1234 0 0 0\n",
+                    1000000 + tick * busy,
+                    98765432 + tick * (BENCH_CORES * 100 - busy));
+  for (i = 0; i < BENCH_CORES; ++i)
+    length += snprintf(&buffer[length], buffer_size - length,
+                       "cpu%zu %lu 12 3906 %lu 33 0 9 0 0 0\n",
+                       i, 7812 + tick * core_busy(i),
+                       771604 + tick * (100 - core_busy(i)));
+  length += snprintf(&buffer[length], buffer_size - length,
+                     "intr 123456789 0 9 0 0 0 0 0 0 1 0 0 0 0 0 0 0\n"
+                     "ctxt 987654321\n"
+                     "btime 1700000000\n");
+  ASSERT(length < buffer_size);
+}
+
+BENCH(cpu_parse_stat_128) {
+  u64 tick, busy;
+  size_t i;
+  char buffers[2][(BENCH_CORES + 2) * STAT_LINE_SIZE];
+  struct cpu_sampler sampler = {0};
+
+  generate_stat(buffers[0], sizeof(buffers[0]), 0);
+  generate_stat(buffers[1], sizeof(buffers[1]), 1);
+
+  sampler.count = BENCH_CORES + 1;
+  sampler.times = zalloc(sampler.count * sizeof(*sampler.times));
+  sampler.usage = zalloc(sampler.count * sizeof(*sampler.usage));
+
+  parse_stat(&sampler, buffers[0]);
+  parse_stat(&sampler, buffers[1]);
+  busy = 0;
+  for (i = 0; i < BENCH_CORES; ++i) {
+    ASSERT(sampler.usage[i + 1] == core_busy(i));
+    busy += core_busy(i);
+  }
+  ASSERT(sampler.usage[0] == busy / BENCH_CORES);
+
+  tick = 0;
+  BENCH_LOOP(b) {
+    parse_stat(&sampler, buffers[tick & 1]);
+    BENCH_KEEP(sampler.usage[0]);
+    ++tick;
+  }
+
+  free(sampler.times);
+  free(sampler.usage);
+}
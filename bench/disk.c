@@ -0,0 +1,56 @@
+/* Include the module directly, to get at its parser */
+#include "../src/modules/disk.c"
+
+#include "bench.h"
+
+#define BENCH_DEVICES 64
+
+/* Generates a /proc/diskstats like buffer, with partitions and loop devices
+ * around the two devices being followed.
+ */
+static void generate_diskstats(char* buffer, size_t buffer_size, u64 tick) {
+  size_t i, length;
+
+  length = 0;
+  for (i = 0; i < BENCH_DEVICES; ++i)
+    length += snprintf(&buffer[length], buffer_size - length,
+                       "%4d %7zu %s%zu %lu 0 %lu 120 %lu 0 %lu 340 0 460 460"
+                       " 0 0 0 0 0 0\n",
+                       i < BENCH_DEVICES / 2 ? 7 : 259, i,
+                       i < BENCH_DEVICES / 2 ? "loop" : "nvme0n1p", i,
+                       1000 + tick, 8000 + tick * 8 * i,
+                       2000 + tick, 16000 + tick * 16 * i);
+  ASSERT(length < buffer_size);
+}
+
+BENCH(disk_parse_diskstats_64) {
+  u64 tick;
+  struct list instances;
+  char buffers[2][BENCH_DEVICES * 128];
+  struct disk_instance followed[2] = {
+    { .device = "nvme0n1p40" },
+    { .device = "nvme0n1p63" }
+  };
+
+  generate_diskstats(buffers[0], sizeof(buffers[0]), 0);
+  generate_diskstats(buffers[1], sizeof(buffers[1]), 1);
+
+  list_init(&instances);
+  list_insert(&instances, &followed[0].link);
+  list_insert(&instances, &followed[1].link);
+
+  /* Device i reads 8 * i sectors and writes 16 * i sectors every tick */
+  parse_diskstats(buffers[0], &instances, 1000000000ULL);
+  parse_diskstats(buffers[1], &instances, 2000000000ULL);
+  ASSERT(followed[0].io.read_rate == 8 * 40 * SECTOR_SIZE);
+  ASSERT(followed[0].io.write_rate == 16 * 40 * SECTOR_SIZE);
+  ASSERT(followed[1].io.read_rate == 8 * 63 * SECTOR_SIZE);
+  ASSERT(followed[1].io.write_rate == 16 * 63 * SECTOR_SIZE);
+
+  tick = 2;
+  BENCH_LOOP(b) {
+    parse_diskstats(buffers[tick & 1], &instances, (tick + 1) * 1000000000ULL);
+    BENCH_KEEP(followed[0].io.read_rate);
+    ++tick;
+  }
+}
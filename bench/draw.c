@@ -0,0 +1,58 @@
+#include "bench.h"
+
+#include <gaybar/draw.h>
+#include <gaybar/bar.h>
+#include <gaybar/util.h>
+#include <gaybar/assert.h>
+
+#include <stdlib.h>
+
+#define ZONE_WIDTH   128
+#define OUTPUT_WIDTH 1920
+
+BENCH(draw_on_zone) {
+  struct zone* zone;
+  struct draw* draw;
+
+  zone = bar_alloc_zone(ZONE_POSITION_LEFT, ZONE_WIDTH);
+
+  BENCH_LOOP(b) {
+    draw_on_zone(zone, draw)
+      BENCH_KEEP(draw);
+  }
+
+  bar_destroy_zone(&zone);
+}
+
+BENCH(draw_rect) {
+  struct zone* zone;
+  struct draw* draw;
+
+  zone = bar_alloc_zone(ZONE_POSITION_LEFT, ZONE_WIDTH);
+
+  draw_on_zone(zone, draw) {
+    BENCH_LOOP(b)
+      draw_rect(draw, 0, 0, draw_width(draw), draw_height(draw), 0xFF1D1D1D);
+  }
+
+  bar_destroy_zone(&zone);
+}
+
+BENCH(fill_buffer_region) {
+  u32 height;
+  u32 *src, *dst;
+
+  height = bar_get_thickness();
+  src = zalloc(ZONE_WIDTH * height * sizeof(*src));
+  dst = zalloc(OUTPUT_WIDTH * height * sizeof(*dst));
+  ASSERT(src != NULL && dst != NULL);
+
+  BENCH_LOOP(b) {
+    fill_buffer_region(0, 0, OUTPUT_WIDTH - ZONE_WIDTH, 0, ZONE_WIDTH, height,
+                       src, ZONE_WIDTH, dst, OUTPUT_WIDTH);
+    BENCH_KEEP(dst);
+  }
+
+  free(dst);
+  free(src);
+}
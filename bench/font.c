@@ -0,0 +1,41 @@
+#include "bench.h"
+
+#include <gaybar/font.h>
+#include <gaybar/color.h>
+
+#define SAMPLE_TEXT   "BAT1: 02:34 left\nLVL: 87%"
+#define BUFFER_WIDTH  256
+#define BUFFER_HEIGHT 48
+
+static u32 g_buffer[BUFFER_WIDTH * BUFFER_HEIGHT];
+
+static void render_sample(void) {
+  font_string_render(SAMPLE_TEXT, false, COLOR_AS_U32(0xEE, 0xEE, 0xEE),
+                     g_buffer, BUFFER_WIDTH, BUFFER_HEIGHT, BUFFER_WIDTH);
+}
+
+BENCH(font_string_width) {
+  size_t width;
+
+  /* Only rendering fills the glyph cache */
+  render_sample();
+
+  BENCH_LOOP(b) {
+    width = font_string_width(SAMPLE_TEXT);
+    BENCH_KEEP(width);
+  }
+}
+
+BENCH(font_string_render) {
+  render_sample();
+
+  BENCH_LOOP(b)
+    render_sample();
+}
+
+BENCH(font_string_render_cold) {
+  BENCH_LOOP(b) {
+    font_cache_clear();
+    render_sample();
+  }
+}
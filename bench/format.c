@@ -0,0 +1,16 @@
+#include "bench.h"
+
+#include <gaybar/format.h>
+
+BENCH(format) {
+  char buffer[128];
+
+  BENCH_LOOP(b) {
+    FORMAT(buffer, sizeof(buffer), "{name}: {hours}:{minutes} left ({rate}W)",
+           FORMAT_PARAM("name", STRING, "BAT1"),
+           FORMAT_PARAM("hours", INTEGER, 2),
+           FORMAT_PARAM("minutes", INTEGER, 34),
+           FORMAT_PARAM("rate", FLOAT, 6.79));
+    BENCH_KEEP(buffer[0]);
+  }
+}
@@ -0,0 +1,96 @@
+#include <gaybar/wl.h>
+#include <gaybar/bar.h>
+#include <gaybar/draw.h>
+#include <gaybar/util.h>
+#include <gaybar/assert.h>
+
+#include <stdlib.h>
+#include <wchar.h>
+
+/* Headless replacement for src/wl.c: zones are blitted into a plain memory
+ * buffer, so the benchmarks can drive the bar without a compositor.
+ */
+
+/* Along the bar, the buffer is g_height pixels across it */
+#define HEADLESS_LENGTH 1920
+
+static u32* g_buffer;
+static u32 g_height;
+
+int wl_init(void) {
+  g_height = bar_get_thickness();
+  g_buffer = zalloc(HEADLESS_LENGTH * g_height * sizeof(*g_buffer));
+  return g_buffer == NULL ? -1 : 0;
+}
+
+int wl_should_close(void) {
+  return true;
+}
+
+void wl_cleanup(void) {
+  free(g_buffer);
+  g_buffer = NULL;
+}
+
+b8 wl_frame_ready(void) {
+  return true;
+}
+
+b8 wl_draw_begin(void) {
+  return true;
+}
+
+void wl_draw_end(void) {
+}
+
+static u32 get_offset(enum zone_position position, u32 width,
+                      u32 offset, u32 position_width) {
+  switch (position) {
+    case ZONE_POSITION_LEFT:
+      return offset;
+    case ZONE_POSITION_CENTER:
+      return ((HEADLESS_LENGTH - position_width) >> 1) + offset;
+    case ZONE_POSITION_RIGHT:
+      return HEADLESS_LENGTH - offset - width;
+    default:
+      log_fatal("invalid zone position %d", position);
+  }
+}
+
+void wl_draw_zone(struct zone* zone, u32 offset, u32 position_width) {
+  u32 start;
+
+  start = get_offset(zone->position, zone->width, offset, position_width);
+  if (bar_is_vertical())
+    fill_buffer_region(0, 0, 0, start,
+                       zone->height, zone->width,
+                       zone->image_buffer, zone->height,
+                       g_buffer, g_height);
+  else
+    fill_buffer_region(0, 0, start, 0,
+                       zone->width, zone->height,
+                       zone->image_buffer, zone->width,
+                       g_buffer, HEADLESS_LENGTH);
+}
+
+void wl_clear(u32 color) {
+  wmemset((wchar_t*)g_buffer, color, HEADLESS_LENGTH * g_height);
+}
+
+void wl_clear_area(enum zone_position position, u32 offset, u32 width,
+                   u32 position_width, u32 color) {
+  u32 x, y;
+
+  x = get_offset(position, width, offset, position_width);
+  if (bar_is_vertical()) {
+    wmemset((wchar_t*)&g_buffer[x * g_height], color, width * g_height);
+    return;
+  }
+
+  for (y = 0; y < g_height; ++y)
+    wmemset((wchar_t*)&g_buffer[x + y * HEADLESS_LENGTH], color, width);
+}
+
+u32 wl_get_length(void) {
+  return HEADLESS_LENGTH;
+}
@@ -0,0 +1,91 @@
+/* Include the module directly, to get at its parser */
+#include "../src/modules/i3bar.c"
+
+#include "bench.h"
+
+#include <stdio.h>
+
+#define BENCH_LINES 64
+
+/* An i3status like stream: the header, then status lines in which only the
+ * clock changes.
+ */
+static size_t generate_stream(char* buffer, size_t buffer_size) {
+  size_t i, length;
+
+  length = snprintf(buffer, buffer_size, "{\"version\":1}\n[\n");
+  for (i = 0; i < BENCH_LINES; ++i)
+    length += snprintf(&buffer[length], buffer_size - length,
+      "%s[{\"name\":\"ipv6\",\"color\":\"#FF0000\",\"full_text\":\"no IPv6\"},"
+      "{\"name\":\"wireless\",\"instance\":\"wlan0\",\"color\":\"#00FF00\","
+      "\"full_text\":\"W: (070%% at home) 192.168.1.2\"},"
+      "{\"name\":\"battery\",\"instance\":\"/sys/class/power_supply/BAT0\","
+      "\"full_text\":\"BAT 87.12%% 02:13:44\",\"min_width\":\"BAT 100.00%%\"},"
+      "{\"name\":\"disk_info\",\"instance\":\"/\",\"full_text\":\"42.1 GiB\"},"
+      "{\"name\":\"load\",\"full_text\":\"0.42\",\"separator\":false},"
+      "{\"name\":\"tztime\",\"instance\":\"local\","
+      "\"full_text\":\"2024-01-01 12:00:%02zu\"}]\n",
+      i == 0 ? "" : ",", i % 60);
+  ASSERT(length < buffer_size);
+  return length;
+}
+
+BENCH(i3bar_status_line) {
+  size_t i, length, *lines;
+  char* buffer;
+  const char* s;
+  struct i3bar_instance* instance;
+
+  buffer = malloc(BENCH_LINES * 1024);
+  length = generate_stream(buffer, BENCH_LINES * 1024);
+
+  /* Where each line ends, to feed the stream one line at a time */
+  lines = malloc((BENCH_LINES + 1) * sizeof(*lines));
+  lines[0] = strchr(strchr(buffer, '\n') + 1, '\n') + 1 - buffer;
+  for (i = 1, s = buffer + lines[0]; i <= BENCH_LINES; ++i) {
+    s = strchr(s, '\n') + 1;
+    lines[i] = s - buffer;
+  }
+  ASSERT(lines[BENCH_LINES] == length);
+
+  instance = zalloc(sizeof(*instance));
+  instance->zone = bar_alloc_zone(ZONE_POSITION_RIGHT, I3BAR_DEFAULT_WIDTH);
+  instance->max_width = I3BAR_DEFAULT_WIDTH;
+  instance->fg_color = COLOR(0xEE, 0xEE, 0xEE);
+  instance->bg_color = COLOR(0x1D, 0x1D, 0x1D);
+  json_stream_init(&instance->stream, &g_stream_callbacks, instance);
+  json_stream_feed(&instance->stream, buffer, lines[0]);
+  i3bar_render(instance);
+
+  i = 0;
+  BENCH_LOOP(b) {
+    json_stream_feed(&instance->stream, buffer + lines[i],
+                     lines[i + 1] - lines[i]);
+    /* A frame for every line */
+    i3bar_render(instance);
+    BENCH_KEEP(instance->slots_count);
+    if (++i == BENCH_LINES)
+      i = 0;
+  }
+
+  ASSERT(instance->slots_count == 6);
+
+  /* The blocks past the ones shown must not land in the last one */
+  length = snprintf(buffer, BENCH_LINES * 1024, ",[");
+  for (i = 0; i < I3BAR_MAX_BLOCKS + 8; ++i)
+    length += snprintf(&buffer[length], BENCH_LINES * 1024 - length,
+                       "%s{\"full_text\":\"%zu\",\"min_width\":%zu}",
+                       i == 0 ? "" : ",", i, i);
+  length += snprintf(&buffer[length], BENCH_LINES * 1024 - length, "]\n");
+  json_stream_feed(&instance->stream, buffer, length);
+  ASSERT(instance->slots_count == I3BAR_MAX_BLOCKS);
+  ASSERT(!strcmp(instance->slots[I3BAR_MAX_BLOCKS - 1].block.text, "31"));
+  ASSERT(instance->slots[I3BAR_MAX_BLOCKS - 1].block.min_width == 31);
+
+  for (i = 0; i < I3BAR_MAX_BLOCKS; ++i)
+    free(instance->slots[i].pixels);
+  bar_destroy_zone(&instance->zone);
+  free(instance);
+  free(lines);
+  free(buffer);
+}
@@ -0,0 +1,72 @@
+/* Include the ipc server directly, to drive a client without a socket */
+#include "../src/ipc.c"
+
+#include "bench.h"
+
+#define BENCH_BATCH 64
+
+struct bench_target {
+  struct ipc_target target;
+  size_t updates;
+  char text[64];
+};
+
+static void bench_set_text(struct ipc_target* target,
+                           const char* text, size_t length) {
+  struct bench_target* bench_target =
+    CONTAINER_OF(target, struct bench_target, target);
+
+  length = min(length, sizeof(bench_target->text) - 1);
+  memcpy(bench_target->text, text, length);
+  bench_target->text[length] = '\0';
+  ++bench_target->updates;
+}
+
+static void bench_redraw(struct ipc_target* target) {
+  UNUSED(target);
+}
+
+/* Every iteration handles a batch of updates to one of a few targets, as
+ * sent by a client in a single write.
+ */
+BENCH(ipc_set_batch_64) {
+  int fds[2];
+  size_t i, length;
+  char batch[BENCH_BATCH * 32];
+  struct ipc_client* client;
+  struct bench_target targets[4];
+  static const char* names[] = { "cpu", "mem", "net", "clock" };
+
+  for (i = 0; i < ARRAY_LENGTH(targets); ++i) {
+    memset(&targets[i], 0, sizeof(targets[i]));
+    targets[i].target.name = names[i];
+    targets[i].target.callbacks.set_text = bench_set_text;
+    targets[i].target.callbacks.redraw = bench_redraw;
+    ipc_add_target(&targets[i].target);
+  }
+
+  length = 0;
+  for (i = 0; i < BENCH_BATCH; ++i)
+    length += snprintf(&batch[length], sizeof(batch) - length,
+                       "set %s %zu%%\n", names[i % ARRAY_LENGTH(names)], i);
+  ASSERT(length < sizeof(batch));
+
+  ASSERT(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  add_client(fds[0]);
+  client = &g_ipc.clients[0];
+  ASSERT(client->fd == fds[0]);
+
+  BENCH_LOOP(b) {
+    ASSERT(write(fds[1], batch, length) == (ssize_t)length);
+    read_client(client->fd, client);
+    BENCH_KEEP(targets[0].updates);
+  }
+
+  ASSERT(targets[0].updates > 0);
+  ASSERT(!strcmp(targets[3].text, "63%"));
+
+  close_client(client);
+  close(fds[1]);
+  for (i = 0; i < ARRAY_LENGTH(targets); ++i)
+    ipc_remove_target(&targets[i].target);
+}
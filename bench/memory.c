@@ -0,0 +1,89 @@
+/* Include the module directly, to get at its parser */
+#include "../src/modules/memory.c"
+
+#include "bench.h"
+
+/* Taken from a desktop with 32 GB of memory */
+static const char g_sample_meminfo[] =
+  "MemTotal:       32784700 kB\n"
+  "MemFree:        18206964 kB\n"
+  "MemAvailable:   26010228 kB\n"
+  "Buffers:          443732 kB\n"
+  "Cached:          7530080 kB\n"
+  "SwapCached:            0 kB\n"
+  "Active:          6290096 kB\n"
+  "Inactive:        6620612 kB\n"
+  "Active(anon):    4982200 kB\n"
+  "Inactive(anon):        0 kB\n"
+  "Active(file):    1307896 kB\n"
+  "Inactive(file):  6620612 kB\n"
+  "Unevictable:       90788 kB\n"
+  "Mlocked:             132 kB\n"
+  "SwapTotal:       8388604 kB\n"
+  "SwapFree:        8388604 kB\n"
+  "Zswap:                 0 kB\n"
+  "Zswapped:              0 kB\n"
+  "Dirty:              1032 kB\n"
+  "Writeback:             0 kB\n"
+  "AnonPages:       4986876 kB\n"
+  "Mapped:          1387912 kB\n"
+  "Shmem:            125632 kB\n"
+  "KReclaimable:     300476 kB\n"
+  "Slab:             541232 kB\n"
+  "SReclaimable:     300476 kB\n"
+  "SUnreclaim:       240756 kB\n"
+  "KernelStack:       22048 kB\n"
+  "PageTables:        61328 kB\n"
+  "SecPageTables:         0 kB\n"
+  "NFS_Unstable:          0 kB\n"
+  "Bounce:                0 kB\n"
+  "WritebackTmp:          0 kB\n"
+  "CommitLimit:    24780952 kB\n"
+  "Committed_AS:   15380616 kB\n"
+  "VmallocTotal:   34359738367 kB\n"
+  "VmallocUsed:      123456 kB\n"
+  "VmallocChunk:          0 kB\n"
+  "Percpu:            12160 kB\n"
+  "HardwareCorrupted:     0 kB\n"
+  "AnonHugePages:         0 kB\n"
+  "HugePages_Total:       0\n"
+  "HugePages_Free:        0\n"
+  "Hugepagesize:       2048 kB\n"
+  "DirectMap4k:      513840 kB\n"
+  "DirectMap2M:    17143808 kB\n";
+
+static void load_sample(struct meminfo* meminfo) {
+  memcpy(meminfo->buffer, g_sample_meminfo, sizeof(g_sample_meminfo));
+}
+
+BENCH(meminfo_parse_full) {
+  static struct meminfo meminfo;
+
+  load_sample(&meminfo);
+
+  BENCH_LOOP(b) {
+    BENCH_KEEP(parse_full(&meminfo, STATIC_STRLEN(g_sample_meminfo)));
+  }
+}
+
+BENCH(meminfo_parse_cached) {
+  static struct meminfo meminfo;
+
+  load_sample(&meminfo);
+  ASSERT(parse_full(&meminfo, STATIC_STRLEN(g_sample_meminfo)));
+
+  BENCH_LOOP(b) {
+    BENCH_KEEP(parse_meminfo(&meminfo, STATIC_STRLEN(g_sample_meminfo)));
+  }
+}
+
+BENCH(memory_format) {
+  char buffer[256];
+
+  BENCH_LOOP(b) {
+    get_formatted_text(buffer, sizeof(buffer), MEMORY_DEFAULT_FORMAT,
+                       (u64[FIELDS_COUNT]) { 32784700, 26010228, 443732,
+                                             7530080, 8388604, 8388604 });
+    BENCH_KEEP(buffer[0]);
+  }
+}
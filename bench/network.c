@@ -0,0 +1,99 @@
+/* Include the module directly, to get at its parser */
+#include "../src/modules/network.c"
+
+#include "bench.h"
+
+#define BENCH_LINKS 16
+
+static void* put_attr(void* p, u16 type, const void* data, size_t length) {
+  struct rtattr* attr = p;
+
+  attr->rta_type = type;
+  attr->rta_len = RTA_LENGTH(length);
+  memcpy(RTA_DATA(attr), data, length);
+  return (u8*)p + RTA_SPACE(length);
+}
+
+/* Generates the datagram the kernel sends in reply to a RTM_GETLINK dump */
+static size_t generate_dump(u32* buffer, size_t buffer_size, u32 seq, u64 tick) {
+  size_t i;
+  u8* p;
+  char name[IFNAMSIZ];
+  struct nlmsghdr* header;
+  struct ifinfomsg* info;
+  struct rtnl_link_stats64 stats;
+
+  p = (u8*)buffer;
+  for (i = 0; i < BENCH_LINKS; ++i) {
+    header = (struct nlmsghdr*)p;
+    header->nlmsg_type = RTM_NEWLINK;
+    header->nlmsg_flags = NLM_F_MULTI;
+    header->nlmsg_seq = seq;
+    header->nlmsg_pid = 0;
+
+    info = NLMSG_DATA(header);
+    memset(info, 0, sizeof(*info));
+    info->ifi_family = AF_UNSPEC;
+    info->ifi_index = i + 1;
+    info->ifi_flags = IFF_UP | IFF_RUNNING | (i == 0 ? IFF_LOOPBACK : 0);
+
+    memset(&stats, 0, sizeof(stats));
+    stats.rx_bytes = 123456789 + tick * 1000 * (i + 1);
+    stats.tx_bytes = 987654321 + tick * 500 * (i + 1);
+    stats.rx_packets = stats.rx_bytes / 1500;
+    stats.tx_packets = stats.tx_bytes / 1500;
+
+    snprintf(name, sizeof(name), "eth%zu", i);
+    p = (u8*)IFLA_RTA(info);
+    p = put_attr(p, IFLA_IFNAME, name, strlen(name) + 1);
+    p = put_attr(p, IFLA_MTU, &(u32){ 1500 }, sizeof(u32));
+    p = put_attr(p, IFLA_STATS64, &stats, sizeof(stats));
+    header->nlmsg_len = p - (u8*)header;
+  }
+
+  header = (struct nlmsghdr*)p;
+  header->nlmsg_type = NLMSG_DONE;
+  header->nlmsg_flags = NLM_F_MULTI;
+  header->nlmsg_seq = seq;
+  header->nlmsg_len = NLMSG_LENGTH(sizeof(int));
+  *(int*)NLMSG_DATA(header) = 0;
+  p += NLMSG_ALIGN(header->nlmsg_len);
+
+  ASSERT((size_t)(p - (u8*)buffer) <= buffer_size);
+  return p - (u8*)buffer;
+}
+
+BENCH(network_parse_dump_16) {
+  u64 tick;
+  size_t i, lengths[2];
+  struct net_link* link;
+  static u32 buffers[2][8192 / sizeof(u32)];
+  struct network network = {0};
+
+  lengths[0] = generate_dump(buffers[0], sizeof(buffers[0]), 1, 0);
+  lengths[1] = generate_dump(buffers[1], sizeof(buffers[1]), 1, 1);
+
+  /* Link i receives 1000 * i bytes and sends 500 * i every tick */
+  for (tick = 0; tick < 2; ++tick) {
+    network.pending = DUMP_LINKS;
+    network.pending_seq = 1;
+    network.dump_ns = (tick + 1) * 1000000000ULL;
+    parse_messages(&network, buffers[tick], lengths[tick]);
+  }
+  for (i = 1; i <= BENCH_LINKS; ++i) {
+    link = find_link(&network, i, false);
+    ASSERT(link != NULL);
+    ASSERT(link->rx_rate == 1000 * i);
+    ASSERT(link->tx_rate == 500 * i);
+  }
+
+  tick = 2;
+  BENCH_LOOP(b) {
+    network.pending = DUMP_LINKS;
+    network.pending_seq = 1;
+    network.dump_ns = (tick + 1) * 1000000000ULL;
+    BENCH_KEEP(parse_messages(&network, buffers[tick & 1], lengths[tick & 1]));
+    BENCH_KEEP(network.links[1].rx_rate);
+    ++tick;
+  }
+}
@@ -0,0 +1,43 @@
+/* Include the scheduler directly, so we can reset its private state */
+#include "../src/sched.c"
+
+#include "bench.h"
+
+static void noop(void) {
+}
+
+static void bench_prepare(struct bench* b, size_t n_tasks) {
+  size_t i;
+  u64* ids;
+
+  ids = malloc(n_tasks * sizeof(*ids));
+  ASSERT(ids != NULL);
+
+  /* Use different intervals, so that only one task becomes due */
+  for (i = 0; i < n_tasks; ++i)
+    ids[i] = sched_task_interval(noop, 1000 + i, false);
+
+  BENCH_LOOP(b) {
+    g_timer_expired = true;
+    sched_queue_prepare();
+    /* Put the enqueued task back, so every iteration sees all the tasks */
+    list_insert_list(&g_task_list, &g_task_queue);
+    list_init(&g_task_queue);
+  }
+
+  for (i = 0; i < n_tasks; ++i)
+    sched_task_delete(ids[i]);
+  free(ids);
+}
+
+BENCH(sched_queue_prepare_1) {
+  bench_prepare(b, 1);
+}
+
+BENCH(sched_queue_prepare_16) {
+  bench_prepare(b, 16);
+}
+
+BENCH(sched_queue_prepare_256) {
+  bench_prepare(b, 256);
+}
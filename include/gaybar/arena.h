@@ -0,0 +1,33 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <gaybar/types.h>
+
+/* A bump allocator for data that is thrown away all at once. What doesn't
+ * fit in the arena goes to blocks malloc'ed on the side, and the arena
+ * grows to fit it on the next reset: after the first few rounds, it settles
+ * to the size the biggest round needs and no longer goes to malloc.
+ */
+
+struct arena_block;
+
+struct arena {
+  u8* base;
+  size_t size;
+  size_t used;
+  /* Allocations that didn't fit in this round, newest block first */
+  struct arena_block* overflow;
+  /* Bytes allocated from the overflow blocks */
+  size_t overflow_size;
+};
+
+#define ARENA_INITIALIZER { 0 }
+
+void  arena_destroy(struct arena* arena);
+
+/* Memory is not zeroed, and is aligned for any type */
+void* arena_alloc(struct arena* arena, size_t size);
+/* Everything allocated so far is gone */
+void  arena_reset(struct arena* arena);
+
+#endif
@@ -7,6 +7,8 @@
 enum bar_position {
   BAR_POSITION_TOP,
   BAR_POSITION_BOTTOM,
+  BAR_POSITION_LEFT,
+  BAR_POSITION_RIGHT,
   BAR_POSITION_MAX
 };
 
@@ -17,6 +19,18 @@ enum zone_position {
   ZONE_POSITION_MAX
 };
 
+/* Every zone gets its preferred width when they all fit on the bar,
+ * otherwise they are shrunk towards their minimum width.
+ */
+struct zone_size {
+  u32 min, preferred, max;
+};
+
+/* width is along the bar and height across it, whatever the orientation of
+ * the bar. The image buffer is stored the way it appears on screen, so it
+ * can be blitted in contiguous rows: on vertical bars that means rotated
+ * clockwise, with x going down and y going from right to left.
+ */
 struct zone {
   enum zone_position position;
   u32 width, height;
@@ -29,13 +43,22 @@ void bar_cleanup(void);
 
 u32               bar_get_thickness(void);
 enum bar_position bar_get_position(void);
+b8                bar_is_vertical(void);
 struct color      bar_get_background_color(void);
 struct color      bar_get_foreground_color(void);
 
+struct module_instance;
+
 struct zone* bar_alloc_zone(enum zone_position position, u32 size);
+/* instance is rendered again whenever the layout changes the zone width */
+struct zone* bar_alloc_resizable_zone(enum zone_position position,
+                                      struct zone_size size,
+                                      struct module_instance* instance);
 void         bar_destroy_zone(struct zone** zonep);
 
 void         zone_request_redraw(struct zone* zone);
 b8           zone_should_redraw(struct zone* zone);
+/* Sets the preferred width, takes effect on the next frame */
+void         zone_resize(struct zone* zone, u32 width);
 
 #endif
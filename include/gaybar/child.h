@@ -0,0 +1,55 @@
+#ifndef CHILD_H_
+#define CHILD_H_
+
+#include <gaybar/types.h>
+
+#include <sys/types.h>
+
+/* A command run under /bin/sh, in its own process group, with its stdout
+ * read by the main loop. Its exit is noticed through a pidfd, so nothing
+ * polls for it.
+ */
+
+struct child;
+
+struct child_callbacks {
+  /* Runs with every chunk read from the child's stdout, then once with a
+   * length of 0 when the child (or whatever it handed it to) closes it.
+   */
+  void (*output)(struct child* child, const char* buffer, size_t length);
+  /* Runs once the child has exited and was reaped, with its status as
+   * returned by waitpid(..).
+   */
+  void (*exit)(struct child* child, int status);
+};
+
+struct child {
+  const char* command;
+  struct child_callbacks callbacks;
+  /* They go away independently, as the child may hand its stdout down.
+   * Both are -1 once gone.
+   */
+  pid_t pid;
+  int fd;
+  int pidfd;
+  u64 started_ns;
+};
+
+/* Sets up a child that doesn't run yet */
+void child_init(struct child* child, const char* command,
+                const struct child_callbacks* callbacks);
+
+/* Returns false, after logging why, if the command could not be started */
+b8   child_spawn(struct child* child);
+
+/* Closes the output and sends SIGTERM to the whole process group. The
+ * child is reaped in the background, and gets a SIGKILL if it doesn't
+ * exit in time. No callback runs after this.
+ */
+void child_stop(struct child* child);
+
+static inline b8 child_is_running(const struct child* child) {
+  return child->pid > 0 || child->fd >= 0;
+}
+
+#endif
@@ -12,6 +12,9 @@
 
 #define UNUSED(x) ((void)(x))
 
+#define ALIGNED(n) __attribute__((aligned(n)))
+
 #define CONSTRUCTOR __attribute__((constructor))
+#define DESTRUCTOR  __attribute__((destructor))
 
 #endif
@@ -1,27 +1,31 @@
 #ifndef CONFIG_H_
 #define CONFIG_H_
 
-/* FIXME: The entire config API sucks big balls and is very error prone. */
+/* The config file is parsed into a tree that lives in a single arena until
+ * config_unload(..), or until it is replaced by config_reload(..). Nodes and
+ * STRING parameters point into that tree: they don't need to be freed, but
+ * they must not be used after the config is gone, unless it was acquired.
+ * Strings are interned, so equal strings share the same storage.
+ */
 
 #include <gaybar/types.h>
 
 struct config_node;
 
+/* data is what the parameter was given with CONFIG_PARAM_DATA(..) */
 typedef void (*config_array_parse_callback_t)(size_t index,
-                                              struct config_node* elem);
+                                              struct config_node* elem,
+                                              void* data);
 typedef void (*config_array_empty_callback_t)(void);
+typedef void (*config_change_callback_t)(void);
 
-/* NOTE: The value stored in parameters of type STRING is a pointer to
- *       heap memory allocated via strdup(..). This means that, once you're done
- *       with it, you should free memory using free(..).
- */
 enum _config_param_type {
   _CONFIG_PARAM_TYPE_INVALID = 0,
                               /* config_param.store must be of type */
   _CONFIG_PARAM_TYPE_INTEGER, /* long*                              */
   _CONFIG_PARAM_TYPE_FLOAT,   /* double*                            */
-  _CONFIG_PARAM_TYPE_STRING,  /* char**                             */
-  _CONFIG_PARAM_TYPE_BOOL,    /* bool*                              */
+  _CONFIG_PARAM_TYPE_STRING,  /* const char**                       */
+  _CONFIG_PARAM_TYPE_BOOL,    /* b8*                                */
   _CONFIG_PARAM_TYPE_ARRAY,   /* config_array_parse_callback_t      */
   _CONFIG_PARAM_TYPE_MAX
 };
@@ -33,14 +37,38 @@ struct _config_param {
   const char* name;
   void* store;
   void* default_value;
+  void* data;
 };
 
 void   config_load(void);
 void   config_unload(void);
+/* Parses the config file again. On success the new config replaces the
+ * loaded one, otherwise the loaded one is kept.
+ */
+b8     config_reload(void);
+
+/* Keeps the loaded config alive, even after it is unloaded or replaced,
+ * until it is released. Returns its root, NULL if there is no config.
+ */
+struct config_node* config_acquire(void);
+void                config_release(struct config_node* root);
 
+/* on_change is called from the main loop when the config file changes */
+void   config_watch(config_change_callback_t on_change);
+void   config_unwatch(void);
+
+/* Compares two nodes, which may belong to different configs. NULL is only
+ * equal to NULL.
+ */
+b8 config_node_equal(struct config_node* a, struct config_node* b);
+
+/* The root of the config, NULL if there is none */
+struct config_node* config_root(void);
+/* Returns NULL if node has no child called name. Parsing a NULL node gives
+ * every parameter its default value.
+ */
 struct config_node* config_get_node(struct config_node* node,
                                     const char* name);
-void config_destroy_node(struct config_node* node);
 
 size_t _config_parse(struct config_node* node,
                      struct _config_param* params, size_t params_count);
@@ -58,6 +86,8 @@ size_t _config_parse(struct config_node* node,
 #define CONFIG_PARAM_NAME(n)    .name = (n)
 #define CONFIG_PARAM_TYPE(t)    .type = (_CONFIG_PARAM_TYPE_##t)
 #define CONFIG_PARAM_STORE(s)   .store = (void*)&(s)
+/* Passed to the callback of an ARRAY parameter */
+#define CONFIG_PARAM_DATA(d)    .data = (void*)(d)
 /* Use this if the parameter type is not FLOAT */
 #define CONFIG_PARAM_DEFAULT(v) \
   .has_default_value = true,    \
@@ -67,6 +97,6 @@ size_t _config_parse(struct config_node* node,
   .has_default_value = true,          \
   .default_value = *(void**)((double[]) {(v)})
 
-#define CONFIG_ROOT NULL
+#define CONFIG_ROOT config_root()
 
 #endif
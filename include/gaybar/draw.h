@@ -20,4 +20,10 @@ void draw_string(struct draw* draw, u32 x, u32 y,
 u32 draw_width(struct draw* draw);
 u32 draw_height(struct draw* draw);
 
+void fill_buffer_region(u32 src_x, u32 src_y,
+                        u32 dst_x, u32 dst_y,
+                        u32 width, u32 height,
+                        u32* src, u32 src_stride,
+                        u32* dst, u32 dst_stride);
+
 #endif
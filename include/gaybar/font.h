@@ -5,14 +5,28 @@
 
 int  font_init(void);
 void font_cleanup(void);
+/* Loads the font from the config again. If it can't be loaded, the current
+ * font stays and -1 is returned.
+ */
+int  font_reload(void);
 void font_cache_clear(void);
 
 void   font_set_size(size_t pixels);
 size_t font_get_size(void);
 
 size_t font_string_width(const char* string);
+/* Width of a text of length characters, as wide as a digit */
+size_t font_chars_width(size_t length);
 void   font_string_render(const char* string, b8 wrap, u32 color, u32* buffer,
                           size_t buffer_width, size_t buffer_height,
                           size_t buffer_stride_in_pixels);
 
+/* Copies string to text, keeping at most length characters. The renderer
+ * gives up on invalid UTF-8, so anything that isn't becomes a '?', as do
+ * control characters.
+ */
+void   font_string_sanitize(char* text, size_t text_size,
+                            const char* string, size_t string_length,
+                            size_t length);
+
 #endif
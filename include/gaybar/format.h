@@ -19,10 +19,15 @@ struct _format_parameter {
   };
 };
 
-/* This function returns true if the buffer was too small, false otherwise */
+/* The output is always NUL terminated. This function returns true if the
+ * buffer was too small, false otherwise.
+ */
 b8 _format(char* buffer, size_t buffer_size, const char* format,
            struct _format_parameter* params, size_t n_params);
 
+/* Formats a rate in bytes per second as '12.3K', with binary units */
+void format_rate(char* buffer, size_t buffer_size, u64 rate);
+
 #define FORMAT_PARAM(_tag, _type, _value) \
   { .tag = _tag, .type = _FORMAT_TYPE_##_type, .value_##_type = _value }
 
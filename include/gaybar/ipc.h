@@ -0,0 +1,38 @@
+#ifndef IPC_H_
+#define IPC_H_
+
+#include <gaybar/types.h>
+#include <gaybar/list.h>
+
+/* The bar reads commands from a unix socket in $XDG_RUNTIME_DIR, one per
+ * line:
+ *   set NAME [TEXT]  Set the text of the targets called NAME
+ *   redraw [NAME]    Draw the targets called NAME (or all of them) again
+ *   stats            Reply with the statistics, as a line of JSON
+ * Only queries and errors are replied to, so a client can send updates as
+ * fast as it likes without ever reading from the socket.
+ */
+
+#define IPC_SOCKET_NAME "gaybar-ipc.sock"
+
+struct ipc_target;
+
+struct ipc_target_callbacks {
+  /* text is NUL terminated, and is not sanitized */
+  void (*set_text)(struct ipc_target* target, const char* text, size_t length);
+  void (*redraw)(struct ipc_target* target);
+};
+
+struct ipc_target {
+  struct list link;
+  const char* name;
+  struct ipc_target_callbacks callbacks;
+};
+
+void ipc_init(void);
+void ipc_cleanup(void);
+
+void ipc_add_target(struct ipc_target* target);
+void ipc_remove_target(struct ipc_target* target);
+
+#endif
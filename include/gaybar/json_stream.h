@@ -0,0 +1,66 @@
+#ifndef JSON_STREAM_H_
+#define JSON_STREAM_H_
+
+#include <gaybar/types.h>
+
+/* An incremental JSON parser, for documents that arrive in pieces and may
+ * never end, like the i3bar protocol. Bytes are fed as they are read, and
+ * the callbacks fire as soon as each container or value is complete: the
+ * stream itself is never buffered, only the token being read.
+ */
+
+#define JSON_STREAM_MAX_DEPTH  16
+#define JSON_STREAM_TOKEN_SIZE 512
+#define JSON_STREAM_KEY_SIZE   64
+
+enum json_value_type {
+  JSON_VALUE_STRING,
+  JSON_VALUE_NUMBER,
+  JSON_VALUE_TRUE,
+  JSON_VALUE_FALSE,
+  JSON_VALUE_NULL
+};
+
+struct json_stream;
+
+struct json_stream_callbacks {
+  /* type is '{' or '[', depth already includes the new container */
+  void (*open)(struct json_stream* stream, char type);
+  /* type is '{' or '[', depth no longer includes the container */
+  void (*close)(struct json_stream* stream, char type);
+  /* Strings are unescaped and NUL terminated, longer ones are truncated */
+  void (*value)(struct json_stream* stream, enum json_value_type type,
+                const char* token, size_t length);
+};
+
+struct json_stream {
+  struct json_stream_callbacks callbacks;
+  void* data;
+  /* The containers that are open, outermost first */
+  size_t depth;
+  char containers[JSON_STREAM_MAX_DEPTH];
+  /* The key of the value being parsed, if its container is an object */
+  char key[JSON_STREAM_KEY_SIZE];
+  /* Private */
+  u8 state;
+  b8 is_key;
+  u8 unicode_digits;
+  u32 codepoint;
+  u32 high_surrogate;
+  size_t token_length;
+  char token[JSON_STREAM_TOKEN_SIZE];
+};
+
+void json_stream_init(struct json_stream* stream,
+                      const struct json_stream_callbacks* callbacks,
+                      void* data);
+
+/* Parses length more bytes of the stream. On a syntax error the rest of the
+ * line is skipped, and parsing starts over inside the outermost container,
+ * which is what line oriented streams need. Returns false if there was an
+ * error.
+ */
+b8 json_stream_feed(struct json_stream* stream,
+                    const char* bytes, size_t length);
+
+#endif
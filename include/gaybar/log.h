@@ -1,6 +1,8 @@
 #ifndef LOG_H_
 #define LOG_H_
 
+#include <gaybar/types.h>
+
 /* extern abort(..) function, to avoid including the entire stdlib.h header */
 extern __attribute__((noreturn)) void abort();
 
@@ -15,10 +17,52 @@ enum log_level {
 #define LOG_LEVEL_MIN LOG_WARN
 #define LOG_LEVEL_MAX LOG_TRACE
 
+/* Calls above this level are compiled out entirely, arguments included.
+ * Can be overridden at build time (e.g. -DLOG_LEVEL_COMPILED_MAX=2).
+ */
+#ifndef LOG_LEVEL_COMPILED_MAX
+#define LOG_LEVEL_COMPILED_MAX LOG_LEVEL_MAX
+#endif
+
+/* How many times per second a rate limited callsite may log */
+#define LOG_RATELIMIT_BURST 5
+
+struct log_ratelimit {
+  u64 window;
+  u32 count;
+  u32 suppressed;
+};
+
+/* Runtime log level, set by log_init(..) */
+extern enum log_level g_log_level;
+
 void log_init(void);
 void log_cleanup(void);
 
 void _log(enum log_level level, const char* fmt, ...);
+b8 _log_ratelimit(struct log_ratelimit* rl, enum log_level level);
+
+/* Constant folded for levels above LOG_LEVEL_COMPILED_MAX */
+#define log_enabled(level) \
+  ((level) <= LOG_LEVEL_COMPILED_MAX && (level) <= g_log_level)
+
+#define _log_at(level, fmt, ...)                 \
+  do {                                           \
+    if (log_enabled(level))                      \
+      _log(level, fmt "\n", ##__VA_ARGS__);      \
+  } while (0)
+
+/* Every callsite gets its own limiter, so a noisy message can't starve the
+ * others. The number of suppressed messages is logged when the next
+ * second starts.
+ */
+#define _log_at_ratelimited(level, fmt, ...)           \
+  do {                                                 \
+    static struct log_ratelimit _log_rl;               \
+    if (log_enabled(level) &&                          \
+        _log_ratelimit(&_log_rl, level))               \
+      _log(level, fmt "\n", ##__VA_ARGS__);            \
+  } while (0)
 
 #define log_fatal(fmt, ...)                    \
   do {                                         \
@@ -26,12 +70,19 @@ void _log(enum log_level level, const char* fmt, ...);
     abort();                                   \
   } while (0)
 #define log_error(fmt, ...) \
-  _log(LOG_ERROR, fmt "\n", ##__VA_ARGS__)
+  _log_at(LOG_ERROR, fmt, ##__VA_ARGS__)
 #define log_warn(fmt, ...) \
-  _log(LOG_WARN, fmt "\n", ##__VA_ARGS__)
+  _log_at(LOG_WARN, fmt, ##__VA_ARGS__)
 #define log_info(fmt, ...) \
-  _log(LOG_INFO, fmt "\n", ##__VA_ARGS__)
+  _log_at(LOG_INFO, fmt, ##__VA_ARGS__)
 #define log_trace(fmt, ...) \
-  _log(LOG_TRACE, fmt "\n", ##__VA_ARGS__)
+  _log_at(LOG_TRACE, fmt, ##__VA_ARGS__)
+
+#define log_error_ratelimited(fmt, ...) \
+  _log_at_ratelimited(LOG_ERROR, fmt, ##__VA_ARGS__)
+#define log_warn_ratelimited(fmt, ...) \
+  _log_at_ratelimited(LOG_WARN, fmt, ##__VA_ARGS__)
+#define log_trace_ratelimited(fmt, ...) \
+  _log_at_ratelimited(LOG_TRACE, fmt, ##__VA_ARGS__)
 
 #endif
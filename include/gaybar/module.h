@@ -7,33 +7,67 @@
 #include <gaybar/assert.h>
 #include <gaybar/config.h>
 #include <gaybar/bar.h>
+#include <gaybar/stats.h>
+
+struct module_instance;
 
 struct module_init_data {
+  /* Identifies the instance to module_update(..) and module_redraw(..) */
+  struct module_instance* handle;
   enum zone_position position;
+  /* NULL if the widget has no config. The strings parsed from it stay valid
+   * until the instance is cleaned up.
+   */
   struct config_node* config;
   struct color foreground_color;
   struct color background_color;
 };
 
+/* Modules collect their data on their own (tasks, watched descriptors)
+ * and report it with module_update(..). That runs the update callback,
+ * which brings the visible state up to date and returns true if it changed.
+ * The bar then calls render once, before the next frame, however many
+ * updates came in between. A module without an update callback is rendered
+ * after every module_update(..).
+ */
 struct module_callbacks {
   void* (*init)(struct module_init_data* initdata);
+  b8    (*update)(void* instance);
   void  (*render)(void* instance);
   void  (*cleanup)(void* instance);
 };
 
+struct module_stats {
+  struct stats_histogram update;
+  struct stats_histogram render;
+};
+
+/* Bumped on every change to the structures above, or to the functions a
+ * module may call. A plugin built against another version is not loaded.
+ */
+#define MODULE_ABI_VERSION 4
+
 struct module {
+  /* Must stay the first member, to be readable whatever the version */
+  u32 abi_version;
   struct list link;
   const char* name;
   const char* author;
   const char* description;
   struct module_callbacks callbacks;
+  struct module_stats stats;
 };
 
-struct module_instance;
-
 extern struct list g_modules;
 
+void module_register(struct module* module);
+void module_unregister(struct module* module);
+
+/* Modules that aren't built in are loaded from the plugin directory, the
+ * first time they're looked up.
+ */
 struct module* module_find_by_name(const char* name);
+void           module_unload_plugins(void);
 
 struct module_instance* module_init(struct module* module,
                                     struct config_node* config,
@@ -41,9 +75,18 @@ struct module_instance* module_init(struct module* module,
 void module_render(struct module_instance* instance);
 void module_cleanup(struct module_instance* instance);
 
+/* Called by a module when the data of one of its instances changed */
+void module_update(struct module_instance* instance);
+/* Renders the instance on the next frame, even if nothing changed */
+void module_redraw(struct module_instance* instance);
+
+/* Renders the instances whose visible state changed */
+void module_render_dirty(void);
+
 #define MODULE(_name, _author, _description) \
   STATIC_ASSERT(_name != NULL);              \
   static struct module g_module = {          \
+    .abi_version = MODULE_ABI_VERSION,       \
     .name = _name,                           \
     .author = _author,                       \
     .description = _description,             \
@@ -55,10 +98,11 @@ void module_cleanup(struct module_instance* instance);
     g_module.callbacks = (struct module_callbacks) {  \
       __VA_ARGS__                                     \
     };                                                \
-    if (!list_is_initialized(&g_modules))             \
-      list_init(&g_modules);                          \
-    list_insert(&g_modules, &g_module.link);          \
+    module_register(&g_module);                       \
   }                                                   \
+  static void DESTRUCTOR _unregister_module(void) {   \
+    module_unregister(&g_module);                     \
+  }
 
 #define module_trace(x, ...) \
   log_trace("%s: " x, g_module.name, ##__VA_ARGS__)
@@ -71,6 +115,9 @@ void module_cleanup(struct module_instance* instance);
 #define module_fatal(x, ...) \
   log_fatal("%s: " x, g_module.name, ##__VA_ARGS__)
 
+#define module_warn_ratelimited(x, ...) \
+  log_warn_ratelimited("%s: " x, g_module.name, ##__VA_ARGS__)
+
 #define MODULE_INIT_FAIL ((void*)-1)
 
 #endif
@@ -7,6 +7,7 @@ struct params {
   enum log_level log_level;
   char* log_file;
   char* config_file;
+  char* trace_file;
 };
 
 #define param_env(name) \
@@ -0,0 +1,50 @@
+#ifndef PARSE_H_
+#define PARSE_H_
+
+#include <gaybar/types.h>
+
+/* Decimal numbers, as found in the files under /proc and /sys. These run
+ * on every tick of the modules that read them, so they are inline and
+ * don't check for the end of the buffer: it must be NUL terminated.
+ */
+
+/* Parses the next space separated number. Returns where it ends, or NULL
+ * if there is no number there.
+ */
+static inline const char* parse_u64(const char* s, u64* out) {
+  u64 value;
+  u32 digit;
+
+  while (*s == ' ')
+    ++s;
+  if ((u32)(*s - '0') > 9)
+    return NULL;
+
+  value = 0;
+  while ((digit = (u32)(*s - '0')) <= 9) {
+    value = value * 10 + digit;
+    ++s;
+  }
+
+  *out = value;
+  return s;
+}
+
+/* Same as parse_u64(..), for a number that may be negative */
+static inline const char* parse_i64(const char* s, i64* out) {
+  b8 negative;
+  u64 value;
+
+  while (*s == ' ')
+    ++s;
+  negative = *s == '-';
+  if (negative)
+    ++s;
+  if ((u32)(*s - '0') > 9 || (s = parse_u64(s, &value)) == NULL)
+    return NULL;
+
+  *out = negative ? -(i64)value : (i64)value;
+  return s;
+}
+
+#endif
@@ -3,7 +3,12 @@
 
 #include <gaybar/types.h>
 
+#define SCHED_MAX_WATCHES 32
+
+struct pollfd;
+
 typedef void (*task_t)(void);
+typedef void (*watch_t)(int fd, void* data);
 
 void sched_init(void);
 void sched_cleanup(void);
@@ -15,4 +20,12 @@ u64  sched_task_delayed(task_t task, size_t delay_ms);
 u64  sched_task_interval(task_t task, size_t interval_ms, b8 run_immediately);
 void sched_task_delete(u64 id);
 
+/* Watched file descriptors are polled by the main loop, together with the
+ * wayland display. The callback runs when the descriptor becomes readable.
+ */
+void   sched_watch_fd(int fd, watch_t callback, void* data);
+void   sched_unwatch_fd(int fd);
+size_t sched_watch_pollfds(struct pollfd* pfds, size_t max);
+void   sched_watch_dispatch(struct pollfd* pfds, size_t n);
+
 #endif
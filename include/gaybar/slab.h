@@ -0,0 +1,32 @@
+#ifndef SLAB_H_
+#define SLAB_H_
+
+#include <gaybar/types.h>
+
+/* An allocator for objects of a single size. Objects are carved out of
+ * pages that are kept until the slab is destroyed, and freed objects are
+ * handed out again first: once a subsystem reached the most objects it
+ * ever has at once, allocating and freeing them never goes to malloc.
+ */
+
+#define SLAB_PAGE_SIZE 4096
+
+struct slab_page;
+
+struct slab {
+  size_t object_size;
+  /* Singly linked through the objects themselves */
+  void* free_objects;
+  struct slab_page* pages;
+};
+
+#define SLAB_INITIALIZER(T) { .object_size = sizeof(T) }
+
+void  slab_init(struct slab* slab, size_t object_size);
+void  slab_destroy(struct slab* slab);
+
+/* Objects are zeroed */
+void* slab_alloc(struct slab* slab);
+void  slab_free(struct slab* slab, void* object);
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <gaybar/types.h>
+#include <gaybar/util.h>
+
+/* Bucket i counts the samples that took [2^i, 2^(i+1)) nanoseconds */
+#define STATS_HISTOGRAM_BUCKETS 40
+
+struct stats_histogram {
+  u64 count;
+  u64 total_ns;
+  u64 max_ns;
+  u64 buckets[STATS_HISTOGRAM_BUCKETS];
+};
+
+enum stats_timer {
+  STATS_TIMER_FRAME,  /* Rendering and committing a frame */
+  STATS_TIMER_RENDER, /* Blitting the zones that need a redraw */
+  STATS_TIMER_COMMIT, /* Committing the surfaces */
+  STATS_TIMER_TASKS,  /* Running the scheduler queue */
+  STATS_TIMER_MAX
+};
+
+enum stats_counter {
+  STATS_COUNTER_WAKEUPS,
+  STATS_COUNTER_COMMITS,
+  STATS_COUNTER_MAX
+};
+
+void stats_init(void);
+void stats_cleanup(void);
+
+/* Call this every time the main loop wakes up */
+void stats_wakeup(void);
+
+void stats_record(struct stats_histogram* histogram, u64 start_ns, u64 end_ns);
+void stats_record_timer(enum stats_timer timer, u64 start_ns, u64 end_ns);
+void stats_count(enum stats_counter counter);
+
+/* Scheduler tasks created while a histogram is current, record their
+ * execution time in it.
+ */
+void                    stats_set_current(struct stats_histogram* histogram);
+struct stats_histogram* stats_get_current(void);
+
+/* Returns a JSON dump of all the statistics, allocated with malloc(..) */
+char* stats_to_json(void);
+
+static inline u64 stats_now(void) {
+  struct timespec tm;
+  monotonic_time(&tm);
+  return tm.tv_sec * 1000000000ULL + tm.tv_nsec;
+}
+
+#endif
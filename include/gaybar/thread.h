@@ -0,0 +1,24 @@
+#ifndef THREAD_H_
+#define THREAD_H_
+
+#include <pthread.h>
+#include <signal.h>
+
+/* Starts a background thread that never receives signals. The main loop
+ * relies on signals interrupting its poll(..), so they must always be
+ * delivered to the main thread. Returns 0 on success, an errno otherwise.
+ */
+static inline int thread_spawn(pthread_t* thread,
+                               void* (*start)(void*), void* arg) {
+  int rc;
+  sigset_t all, old;
+
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  rc = pthread_create(thread, NULL, start, arg);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  return rc;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <gaybar/types.h>
+#include <gaybar/stats.h>
+
+/* Tracing writes Chrome trace events (which Perfetto can load) to the file
+ * given with -t or GB_TRACE. Names and categories must be strings that
+ * outlive the tracer, since they are formatted by a background thread.
+ */
+
+#define TRACE_NO_ID ((u64)-1)
+
+extern b8 g_trace_enabled;
+
+void trace_init(void);
+void trace_cleanup(void);
+
+void _trace_span(const char* category, const char* name, u64 id,
+                 u64 start_ns, u64 end_ns);
+void _trace_instant(const char* category, const char* name, u64 id);
+
+/* Returns the current time if tracing is enabled, 0 otherwise */
+static inline u64 trace_now(void) {
+  return g_trace_enabled ? stats_now() : 0;
+}
+
+#define trace_span(category, name, id, start_ns, end_ns)        \
+  do {                                                          \
+    if (g_trace_enabled)                                        \
+      _trace_span(category, name, id, start_ns, end_ns);        \
+  } while (0)
+
+#define trace_instant(category, name, id)    \
+  do {                                       \
+    if (g_trace_enabled)                     \
+      _trace_instant(category, name, id);    \
+  } while (0)
+
+#endif
@@ -28,6 +28,17 @@ static inline i64 signi(i64 x) {
   return x == 0 ? 0 : x > 0 ? +1 : -1;
 }
 
+/* Per second rate of a counter that went from prev to now. Counters go
+ * back to zero when their device is reset or added back.
+ */
+static inline u64 rate_per_second(u64 prev, u64 now, u64 elapsed_ns) {
+  if (now < prev || elapsed_ns == 0)
+    return 0;
+  return (now - prev) * 1000000000ULL / elapsed_ns;
+}
+
+#define MS_TO_NS(ms) ((u64)(ms) * 1000000ULL)
+
 static inline void monotonic_time(struct timespec* tm) {
   ASSERT(clock_gettime(CLOCK_MONOTONIC, tm) == 0);
 }
@@ -4,14 +4,20 @@
 #include <gaybar/types.h>
 
 enum bar_position;
+enum zone_position;
 struct zone;
 
 int  wl_init(void);
 int  wl_should_close(void);
 void wl_cleanup(void);
+b8   wl_frame_ready(void);
 b8   wl_draw_begin(void);
 void wl_draw_end(void);
 void wl_draw_zone(struct zone* zone, u32 offset, u32 position_width);
 void wl_clear(u32 color);
+void wl_clear_area(enum zone_position position, u32 offset, u32 width,
+                   u32 position_width, u32 color);
+/* Length of the bar on the smallest output, 0 if there are none yet */
+u32  wl_get_length(void);
 
 #endif
@@ -0,0 +1,95 @@
+#include <gaybar/arena.h>
+#include <gaybar/assert.h>
+
+#include <stdlib.h>
+
+#define ARENA_ALIGN 16
+
+/* Overflow blocks are at least this big, so that small allocations share
+ * them instead of going to malloc(..) one by one.
+ */
+#define ARENA_BLOCK_SIZE 4096
+
+struct arena_block {
+  struct arena_block* next;
+  size_t size;
+  size_t used;
+  /* Keeps data aligned like malloc(..) */
+  u8 _pad[2 * ARENA_ALIGN - sizeof(struct arena_block*) - 2 * sizeof(size_t)];
+  u8 data[];
+};
+
+static inline size_t align_up(size_t size) {
+  return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static void free_overflow(struct arena* arena) {
+  struct arena_block *block, *next_block;
+
+  for (block = arena->overflow; block != NULL; block = next_block) {
+    next_block = block->next;
+    free(block);
+  }
+
+  arena->overflow = NULL;
+  arena->overflow_size = 0;
+}
+
+void arena_destroy(struct arena* arena) {
+  ASSERT(arena != NULL);
+
+  free_overflow(arena);
+  free(arena->base);
+  arena->base = NULL;
+  arena->size = arena->used = 0;
+}
+
+void* arena_alloc(struct arena* arena, size_t size) {
+  void* p;
+  size_t block_size;
+  struct arena_block* block;
+
+  ASSERT(arena != NULL);
+
+  size = align_up(size);
+  if (arena->base != NULL && size <= arena->size - arena->used) {
+    p = &arena->base[arena->used];
+    arena->used += size;
+    return p;
+  }
+
+  block = arena->overflow;
+  if (block == NULL || size > block->size - block->used) {
+    block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    block = malloc(sizeof(*block) + block_size);
+    ASSERT(block != NULL);
+    block->next = arena->overflow;
+    block->size = block_size;
+    block->used = 0;
+    arena->overflow = block;
+  }
+
+  p = &block->data[block->used];
+  block->used += size;
+  arena->overflow_size += size;
+
+  return p;
+}
+
+void arena_reset(struct arena* arena) {
+  size_t size;
+
+  ASSERT(arena != NULL);
+
+  arena->used = 0;
+  if (arena->overflow == NULL)
+    return;
+
+  /* Make room for everything this round needed */
+  size = arena->size + arena->overflow_size;
+  free_overflow(arena);
+  free(arena->base);
+  arena->base = malloc(size);
+  ASSERT(arena->base != NULL);
+  arena->size = size;
+}
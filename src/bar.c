@@ -8,6 +8,10 @@
 #include <gaybar/module.h>
 #include <gaybar/sched.h>
 #include <gaybar/font.h>
+#include <gaybar/stats.h>
+#include <gaybar/trace.h>
+#include <gaybar/ipc.h>
+#include <gaybar/slab.h>
 
 #include <stdlib.h>
 #include <string.h>
@@ -21,6 +25,14 @@ struct zone_private {
   struct list link;
   b8 redraw;
   u32 offset;
+  /* The width of the zone is decided by the layout, within these */
+  struct zone_size size;
+  /* In pixels, the image buffer is only grown */
+  size_t capacity;
+  /* Rendered again when the layout resizes the zone, NULL if it can't be */
+  struct module_instance* instance;
+  /* The widget that was being initialized when the zone was allocated */
+  struct widget* widget;
   struct zone zone;
 };
 #define ZONE_PRIVATE(x) CONTAINER_OF(x, struct zone_private, zone)
@@ -31,31 +43,176 @@ struct bar {
   struct color background_color;
   struct color foreground_color;
   u32 sizes[ZONE_POSITION_MAX];
+  /* How far the zones of a position went before they were shrunk */
+  u32 stale_sizes[ZONE_POSITION_MAX];
+  /* Bar length the zones were laid out for */
+  u32 layout_length;
+  b8 relayout;
+  /* Set when the whole bar has to be cleared and drawn again */
+  b8 clear;
   struct wl_list zones;
+  struct widget* initializing;
 };
 
 struct widget {
   struct list link;
   struct module_instance* instance;
+  enum zone_position position;
+  /* Point into config_root, which the widget keeps alive */
+  const char* name;
+  struct config_node* config;
+  struct config_node* config_root;
+  /* Set while the config is reloaded, if the new config has the widget */
+  b8 kept;
+};
+
+/* What changed in the config being reloaded */
+struct config_changes {
+  b8 colors;
+  b8 font;
 };
 
 static struct list g_widgets;
+static struct config_changes g_changes;
 static struct bar g_bar = {0};
+static struct slab g_zones = SLAB_INITIALIZER(struct zone_private);
 
 u32 bar_get_thickness(void) { return g_bar.thickness; }
 enum bar_position bar_get_position(void) { return g_bar.position; }
+b8 bar_is_vertical(void) {
+  return g_bar.position == BAR_POSITION_LEFT ||
+         g_bar.position == BAR_POSITION_RIGHT;
+}
 struct color bar_get_background_color() { return g_bar.background_color; }
 struct color bar_get_foreground_color() { return g_bar.foreground_color; }
 
-static void render(void) {
+static void resize_zone(struct zone_private* zone_private, u32 width) {
+  size_t pixels;
+  struct zone* zone = &zone_private->zone;
+
+  pixels = (size_t)width * zone->height;
+  if (pixels > zone_private->capacity) {
+    zone->image_buffer = realloc(zone->image_buffer,
+                                 pixels * sizeof(*zone->image_buffer));
+    ASSERT(zone->image_buffer != NULL);
+    zone_private->capacity = pixels;
+  }
+
+  zone->width = width;
+  if (zone_private->instance != NULL)
+    module_redraw(zone_private->instance);
+}
+
+/* Gives every zone its width and packs the zones of each position in the
+ * order they were allocated. When the preferred widths don't fit on the
+ * smallest output, every zone gives up a share of the missing space in
+ * proportion to how much it can shrink. Only the zones that were resized or
+ * moved are drawn again.
+ */
+static void layout(void) {
+  u32 available, width, sizes[ZONE_POSITION_MAX];
+  u64 preferred, shrinkable, missing;
+  enum zone_position position;
   struct zone_private* zone_private;
+  struct zone* zone;
+
+  available = wl_get_length();
+  if (!g_bar.relayout && available == g_bar.layout_length)
+    return;
+
+  preferred = shrinkable = 0;
+  list_for_each(zone_private, &g_bar.zones, link) {
+    preferred += zone_private->size.preferred;
+    shrinkable += zone_private->size.preferred - zone_private->size.min;
+  }
+  /* Until an output shows up, assume everything fits */
+  missing = available > 0 && preferred > available ? preferred - available : 0;
+  missing = min(missing, shrinkable);
+
+  memset(sizes, 0, sizeof(sizes));
+  list_for_each(zone_private, &g_bar.zones, link) {
+    zone = &zone_private->zone;
+    width = zone_private->size.preferred;
+    if (missing > 0)
+      width -= ((u64)(width - zone_private->size.min) * missing +
+                shrinkable - 1) / shrinkable;
+
+    if (width != zone->width)
+      resize_zone(zone_private, width);
+    if (zone_private->offset != sizes[zone->position]) {
+      zone_private->offset = sizes[zone->position];
+      zone_private->redraw = true;
+    }
+    sizes[zone->position] += width;
+  }
+
+  for (position = 0; position < ZONE_POSITION_MAX; ++position) {
+    if (sizes[position] < g_bar.sizes[position])
+      g_bar.stale_sizes[position] = max(g_bar.stale_sizes[position],
+                                        g_bar.sizes[position]);
+  }
+
+  /* The center zones all move when the width of the center changes */
+  if (sizes[ZONE_POSITION_CENTER] != g_bar.sizes[ZONE_POSITION_CENTER]) {
+    list_for_each(zone_private, &g_bar.zones, link) {
+      if (zone_private->zone.position == ZONE_POSITION_CENTER)
+        zone_private->redraw = true;
+    }
+  }
+
+  memcpy(g_bar.sizes, sizes, sizeof(sizes));
+  g_bar.layout_length = available;
+  g_bar.relayout = false;
+}
+
+/* Clears what the zones left behind when their position got narrower */
+static b8 clear_stale_areas(void) {
+  b8 cleared = false;
+  u32 size, stale_size;
+  enum zone_position position;
+
+  for (position = 0; position < ZONE_POSITION_MAX; ++position) {
+    size = g_bar.sizes[position];
+    stale_size = g_bar.stale_sizes[position];
+    g_bar.stale_sizes[position] = 0;
+    if (stale_size <= size)
+      continue;
+
+    if (position == ZONE_POSITION_CENTER)
+      /* Everything moved, the center zones are all drawn again */
+      wl_clear_area(position, 0, stale_size, stale_size,
+                    g_bar.background_color.as_u32);
+    else
+      wl_clear_area(position, size, stale_size - size, stale_size,
+                    g_bar.background_color.as_u32);
+    cleared = true;
+  }
+
+  return cleared;
+}
+
+/* Returns true if at least one zone was drawn */
+static b8 render(void) {
+  b8 drawn;
+  struct zone_private* zone_private;
+
+  if (g_bar.clear) {
+    wl_clear(g_bar.background_color.as_u32);
+    list_for_each(zone_private, &g_bar.zones, link)
+      zone_private->redraw = true;
+    g_bar.clear = false;
+  }
+
+  drawn = clear_stale_areas();
   list_for_each(zone_private, &g_bar.zones, link) {
     if (zone_private->redraw) {
       wl_draw_zone(&zone_private->zone, zone_private->offset,
                    g_bar.sizes[zone_private->zone.position]);
       zone_private->redraw = false;
+      drawn = true;
     }
   }
+  return drawn;
 }
 
 static const char* position_string(enum bar_position position) {
@@ -64,6 +221,10 @@ static const char* position_string(enum bar_position position) {
       return "top";
     case BAR_POSITION_BOTTOM:
       return "bottom";
+    case BAR_POSITION_LEFT:
+      return "left";
+    case BAR_POSITION_RIGHT:
+      return "right";
     default:
       log_fatal("invalid bar position %d", position);
   }
@@ -74,105 +235,217 @@ static enum bar_position position_from_string(const char* s) {
     return BAR_POSITION_BOTTOM;
   else if (strcmp(s, "top") == 0)
     return BAR_POSITION_TOP;
+  else if (strcmp(s, "left") == 0)
+    return BAR_POSITION_LEFT;
+  else if (strcmp(s, "right") == 0)
+    return BAR_POSITION_RIGHT;
   else {
-    log_error("invalid position '%s' (can be either 'top' or 'bottom')", s);
+    log_error("invalid position '%s' "
+              "(can be one of 'top', 'bottom', 'left' or 'right')", s);
     return position_from_string(BAR_DEFAULT_POSITION);
   }
 }
 
-static void init_widget_from_config(struct config_node* node,
-                                    enum zone_position position) {
-  char* widget_name;
+/* Widgets take the colors of the bar that they don't set themselves */
+static b8 uses_bar_colors(struct config_node* config) {
+  struct config_node* colors = config_get_node(config, "colors");
+
+  return config_get_node(colors, "foreground") == NULL ||
+         config_get_node(colors, "background") == NULL;
+}
+
+static b8 can_keep_widget(struct widget* widget, const char* name,
+                          enum zone_position position,
+                          struct config_node* config) {
+  if (widget->kept || widget->position != position ||
+      strcmp(widget->name, name))
+    return false;
+
+  /* Every width was measured with the old font */
+  if (g_changes.font)
+    return false;
+  if (g_changes.colors && uses_bar_colors(config))
+    return false;
+
+  return config_node_equal(widget->config, config);
+}
+
+/* Moves the widget over to next_widgets from the current config if it
+ * didn't change, otherwise adds a new one that is initialized later.
+ */
+static void add_widget(struct config_node* node, enum zone_position position,
+                       struct list* next_widgets) {
+  const char* name;
   struct config_node* config;
-  struct module* module;
-  struct module_instance* instance;
   struct widget* widget;
 
   CONFIG_PARSE(node,
     CONFIG_PARAM(
       CONFIG_PARAM_NAME(CONFIG_PARAM_SELF),
       CONFIG_PARAM_TYPE(STRING),
-      CONFIG_PARAM_STORE(widget_name)
+      CONFIG_PARAM_STORE(name)
     )
   );
-  ASSERT(widget_name != NULL);
-
-  module = module_find_by_name(widget_name);
-  if (module == NULL) {
-    log_error("no module widget '%s' found", widget_name);
-    goto out_module_name;
-  }
+  ASSERT(name != NULL);
 
-  config = config_get_node(CONFIG_ROOT, widget_name);
+  config = config_get_node(CONFIG_ROOT, name);
 
-  instance = module_init(module, config, position);
-  if (instance == NULL) {
-    log_error("could not initialize module '%s'",
-              widget_name);
-    goto out_config;
+  list_for_each(widget, &g_widgets, link) {
+    if (can_keep_widget(widget, name, position, config)) {
+      widget->kept = true;
+      list_remove(&widget->link);
+      list_insert(next_widgets->prev, &widget->link);
+      return;
+    }
   }
 
   widget = zalloc(sizeof(*widget));
   ASSERT(widget != NULL);
 
-  widget->instance = instance;
-  list_insert(&g_widgets, &widget->link);
+  widget->position = position;
+  widget->name = name;
+  widget->config = config;
+  widget->config_root = config_acquire();
+  list_insert(next_widgets->prev, &widget->link);
+}
+
+static b8 init_widget(struct widget* widget) {
+  struct module* module;
+
+  module = module_find_by_name(widget->name);
+  if (module == NULL) {
+    log_error("no module widget '%s' found", widget->name);
+    return false;
+  }
+
+  g_bar.initializing = widget;
+  widget->instance = module_init(module, widget->config, widget->position);
+  g_bar.initializing = NULL;
+  if (widget->instance == NULL) {
+    log_error("could not initialize module '%s'", widget->name);
+    return false;
+  }
+
+  return true;
+}
+
+static void destroy_widget(struct widget* widget) {
+  if (widget->instance != NULL)
+    module_cleanup(widget->instance);
+  config_release(widget->config_root);
 
-out_config:
-  config_destroy_node(config);
-out_module_name:
-  free(widget_name);
+  list_remove(&widget->link);
+  free(widget);
 }
 
-static void init_left_side_widget(size_t index, struct config_node* node) {
+static void add_left_side_widget(size_t index, struct config_node* node,
+                                 void* next_widgets) {
   UNUSED(index);
-  init_widget_from_config(node, ZONE_POSITION_LEFT);
+  add_widget(node, ZONE_POSITION_LEFT, next_widgets);
 }
 
-static void init_center_widget(size_t index, struct config_node* node) {
+static void add_center_widget(size_t index, struct config_node* node,
+                              void* next_widgets) {
   UNUSED(index);
-  init_widget_from_config(node, ZONE_POSITION_CENTER);
+  add_widget(node, ZONE_POSITION_CENTER, next_widgets);
 }
 
-static void init_right_side_widget(size_t index, struct config_node* node) {
+static void add_right_side_widget(size_t index, struct config_node* node,
+                                  void* next_widgets) {
   UNUSED(index);
-  init_widget_from_config(node, ZONE_POSITION_RIGHT);
+  add_widget(node, ZONE_POSITION_RIGHT, next_widgets);
 }
 
+/* Zones are packed in the order they were allocated, which is not the
+ * order of the widgets once some of them were kept across a reload.
+ */
+static void sort_zones(void) {
+  struct list zones;
+  struct widget* widget;
+  struct zone_private *zone_private, *next_zone_private;
+
+  list_init(&zones);
+  list_for_each(widget, &g_widgets, link) {
+    list_for_each_safe(zone_private, next_zone_private, &g_bar.zones, link) {
+      if (zone_private->widget != widget)
+        continue;
+      list_remove(&zone_private->link);
+      list_insert(zones.prev, &zone_private->link);
+    }
+  }
+
+  /* The zones no widget allocated while initializing go last */
+  list_insert_list(zones.prev, &g_bar.zones);
+  list_init(&g_bar.zones);
+  list_insert_list(&g_bar.zones, &zones);
+  g_bar.relayout = true;
+}
+
+/* Brings the widgets in line with the config. On the first call they are
+ * all initialized, on a reload only those that changed are.
+ */
 static void init_widgets(void) {
+  size_t kept, initialized;
+  struct list next_widgets;
   struct config_node* widgets_node;
+  struct widget *widget, *next_widget;
 
-  list_init(&g_widgets);
+  if (!list_is_initialized(&g_widgets))
+    list_init(&g_widgets);
+  list_init(&next_widgets);
 
   widgets_node = config_get_node(CONFIG_ROOT, "widgets");
   CONFIG_PARSE(widgets_node,
     CONFIG_PARAM(
       CONFIG_PARAM_NAME("left"),
       CONFIG_PARAM_TYPE(ARRAY),
-      CONFIG_PARAM_STORE(init_left_side_widget),
+      CONFIG_PARAM_STORE(add_left_side_widget),
+      CONFIG_PARAM_DATA(&next_widgets)
     )
   );
   CONFIG_PARSE(widgets_node,
     CONFIG_PARAM(
       CONFIG_PARAM_NAME("center"),
       CONFIG_PARAM_TYPE(ARRAY),
-      CONFIG_PARAM_STORE(init_center_widget),
+      CONFIG_PARAM_STORE(add_center_widget),
+      CONFIG_PARAM_DATA(&next_widgets)
     )
   );
   CONFIG_PARSE(widgets_node,
     CONFIG_PARAM(
       CONFIG_PARAM_NAME("right"),
       CONFIG_PARAM_TYPE(ARRAY),
-      CONFIG_PARAM_STORE(init_right_side_widget),
+      CONFIG_PARAM_STORE(add_right_side_widget),
+      CONFIG_PARAM_DATA(&next_widgets)
     )
   );
-  config_destroy_node(widgets_node);
+
+  /* The widgets that are left are gone from the config. They go first, so
+   * that what they hold (fds, ipc names) is free for the new ones.
+   */
+  list_for_each_safe(widget, next_widget, &g_widgets, link)
+    destroy_widget(widget);
+  list_insert_list(&g_widgets, &next_widgets);
+
+  kept = initialized = 0;
+  list_for_each_safe(widget, next_widget, &g_widgets, link) {
+    if (widget->kept) {
+      widget->kept = false;
+      ++kept;
+    } else if (init_widget(widget))
+      ++initialized;
+    else
+      destroy_widget(widget);
+  }
+
+  sort_zones();
+  log_trace("%zu widgets kept, %zu initialized", kept, initialized);
 }
 
 static void get_colors(struct color* background_color,
                        struct color* foreground_color) {
   struct config_node* colors;
-  char *foreground_color_hex, *background_color_hex;
+  const char *foreground_color_hex, *background_color_hex;
 
   colors = config_get_node(CONFIG_ROOT, "colors");
   if (colors == NULL) {
@@ -199,24 +472,11 @@ static void get_colors(struct color* background_color,
     ASSERT(color_from_hex(BAR_DEFAULT_COLOR_BACKGROUND, background_color));
   if (!color_from_hex(foreground_color_hex, foreground_color))
     ASSERT(color_from_hex(BAR_DEFAULT_COLOR_FOREGROUND, foreground_color));
-
-  /* If the config node is not NULL then these values have been strduped
-   * by CONFIG_PARSE(..).
-   */
-  if (colors != NULL) {
-    free(background_color_hex);
-    free(foreground_color_hex);
-  }
-
-  config_destroy_node(colors);
 }
 
-int bar_init(void) {
-  int rc;
-  enum bar_position position;
-  char* position_value;
-  long thickness;
-  struct color background_color, foreground_color;
+static void get_geometry(enum bar_position* position, u32* thickness) {
+  long thickness_value;
+  const char* position_value;
 
   CONFIG_PARSE(CONFIG_ROOT,
     CONFIG_PARAM(
@@ -228,19 +488,68 @@ int bar_init(void) {
     CONFIG_PARAM(
       CONFIG_PARAM_NAME("thickness"),
       CONFIG_PARAM_TYPE(INTEGER),
-      CONFIG_PARAM_STORE(thickness),
+      CONFIG_PARAM_STORE(thickness_value),
       CONFIG_PARAM_DEFAULT(BAR_DEFAULT_THICKNESS)
     )
   );
 
-  position = position_from_string(position_value);
-  free(position_value);
+  *position = position_from_string(position_value);
+
+  if (thickness_value < 0) {
+    log_error("thickness must be positive (got %ld)", thickness_value);
+    thickness_value = BAR_DEFAULT_THICKNESS;
+  }
+  *thickness = thickness_value;
+}
+
+/* Called when the config file changes. What can't change without a
+ * restart (the geometry of the bar) is left as it is.
+ */
+static void reload_config(void) {
+  u32 thickness;
+  enum bar_position position;
+  struct color background_color, foreground_color;
+  struct config_node* old_root;
+
+  old_root = config_acquire();
+  if (!config_reload()) {
+    config_release(old_root);
+    return;
+  }
+
+  get_geometry(&position, &thickness);
+  if (position != g_bar.position || thickness != g_bar.thickness)
+    log_warn("the position and thickness of the bar change on restart");
+
+  get_colors(&background_color, &foreground_color);
+  if (background_color.as_u32 != g_bar.background_color.as_u32 ||
+      foreground_color.as_u32 != g_bar.foreground_color.as_u32) {
+    g_bar.background_color = background_color;
+    g_bar.foreground_color = foreground_color;
+    g_bar.clear = true;
+    g_changes.colors = true;
+  }
+
+  g_changes.font = !config_node_equal(config_get_node(old_root, "font"),
+                                      config_get_node(CONFIG_ROOT, "font"));
+  config_release(old_root);
 
-  if (thickness < 0) {
-    log_error("thickness must be positive (got %ld)", thickness);
-    thickness = BAR_DEFAULT_THICKNESS;
+  if (g_changes.font && font_reload() < 0) {
+    log_error("could not load the new font, keeping the current one");
+    g_changes.font = false;
   }
 
+  init_widgets();
+  memset(&g_changes, 0, sizeof(g_changes));
+}
+
+int bar_init(void) {
+  int rc;
+  u32 thickness;
+  enum bar_position position;
+  struct color background_color, foreground_color;
+
+  get_geometry(&position, &thickness);
   get_colors(&background_color, &foreground_color);
 
   log_trace("creating bar anchored on the %s of the screen with:",
@@ -268,6 +577,9 @@ int bar_init(void) {
     goto out;
 
   sched_init();
+  stats_init();
+  ipc_init();
+  config_watch(reload_config);
 
   init_widgets();
 
@@ -285,77 +597,126 @@ out:
 }
 
 void bar_loop(void) {
+  b8 drawn;
+  u64 loop_start, frame_start, render_end, frame_end;
+
   {
     sched_queue_prepare();
   }
 
   while (!wl_should_close()) {
+    loop_start = trace_now();
+    stats_wakeup();
     sched_queue_run();
+    /* Widgets are rendered once per frame, whatever the number of updates */
+    if (wl_frame_ready()) {
+      layout();
+      module_render_dirty();
+    }
     if (wl_draw_begin()) {
-      render();
+      frame_start = stats_now();
+      drawn = render();
+      render_end = stats_now();
       wl_draw_end();
+      /* Don't let empty frames skew the timings */
+      if (drawn) {
+        frame_end = stats_now();
+        stats_record_timer(STATS_TIMER_RENDER, frame_start, render_end);
+        stats_record_timer(STATS_TIMER_COMMIT, render_end, frame_end);
+        stats_record_timer(STATS_TIMER_FRAME, frame_start, frame_end);
+        trace_span("bar", "frame", TRACE_NO_ID, frame_start, frame_end);
+      }
     }
     sched_queue_prepare();
+    trace_span("bar", "bar_loop", TRACE_NO_ID, loop_start, stats_now());
   }
 }
 
 static void destroy_zone_private(struct zone_private* zone_private) {
   list_remove(&zone_private->link);
+  /* Pack the neighbours in the space it leaves */
+  g_bar.relayout = true;
 
   free(zone_private->zone.image_buffer);
-  free(zone_private);
+  slab_free(&g_zones, zone_private);
 }
 
 void bar_cleanup(void) {
   struct widget *widget, *next_widget;
   struct zone_private *zone_private, *next_zone_private;
 
-  list_for_each_safe(widget, next_widget, &g_widgets, link) {
-    module_cleanup(widget->instance);
-    free(widget);
+  config_unwatch();
+  if (list_is_initialized(&g_widgets)) {
+    list_for_each_safe(widget, next_widget, &g_widgets, link)
+      destroy_widget(widget);
   }
+  /* Only once no widget uses them */
+  module_unload_plugins();
 
   list_for_each_safe(zone_private, next_zone_private, &g_bar.zones, link)
     destroy_zone_private(zone_private);
+  slab_destroy(&g_zones);
 
+  ipc_cleanup();
+  stats_cleanup();
   sched_cleanup();
   font_cleanup();
   wl_cleanup();
 }
 
-struct zone* bar_alloc_zone(enum zone_position position, u32 size) {
+static struct zone* alloc_zone(enum zone_position position,
+                               struct zone_size size,
+                               struct module_instance* instance) {
   struct zone_private* zone_private;
   struct zone* zone;
 
-  ASSERT(position <= ZONE_POSITION_MAX);
+  ASSERT(position < ZONE_POSITION_MAX);
+  ASSERT(size.min > 0);
+  ASSERT(size.min <= size.preferred && size.preferred <= size.max);
 
-  zone_private = zalloc(sizeof(*zone_private));
-  ASSERT(zone_private != NULL);
+  zone_private = slab_alloc(&g_zones);
 
+  /* Until the first layout, the zone goes after the others */
   {
     zone_private->redraw = false;
     zone_private->offset = g_bar.sizes[position];
-    list_insert(&g_bar.zones, &zone_private->link);
+    zone_private->size = size;
+    zone_private->capacity = (size_t)size.preferred * g_bar.thickness;
+    zone_private->instance = instance;
+    zone_private->widget = g_bar.initializing;
+    list_insert(g_bar.zones.prev, &zone_private->link);
   }
 
-  g_bar.sizes[position] += size;
+  g_bar.sizes[position] += size.preferred;
+  g_bar.relayout = true;
 
   zone = &zone_private->zone;
-  /* NOTE: This works for bars that are horizontal. For vertical bars, the
-   *       dimensions should be reversed.
-   */
+  /* The draw functions take care of rotating the zones of vertical bars */
   {
     zone->position = position;
-    zone->width = size;
+    zone->width = size.preferred;
     zone->height = g_bar.thickness;
   }
   zone->image_buffer =
-    zalloc(size * g_bar.thickness * sizeof(*zone->image_buffer));
+    zalloc(zone_private->capacity * sizeof(*zone->image_buffer));
   ASSERT(zone->image_buffer != NULL);
 
   return zone;
 }
 
+struct zone* bar_alloc_zone(enum zone_position position, u32 size) {
+  struct zone_size zone_size = { size, size, size };
+
+  return alloc_zone(position, zone_size, NULL);
+}
+
+struct zone* bar_alloc_resizable_zone(enum zone_position position,
+                                      struct zone_size size,
+                                      struct module_instance* instance) {
+  ASSERT(instance != NULL);
+  return alloc_zone(position, size, instance);
+}
+
 void bar_destroy_zone(struct zone** zonep) {
   struct zone_private* zone_private;
 
@@ -377,3 +738,17 @@ b8 zone_should_redraw(struct zone* zone) {
   ASSERT(zone != NULL);
   return ZONE_PRIVATE(zone)->redraw;
 }
+
+void zone_resize(struct zone* zone, u32 width) {
+  struct zone_private* zone_private;
+
+  ASSERT(zone != NULL);
+  zone_private = ZONE_PRIVATE(zone);
+
+  width = clamp(width, zone_private->size.min, zone_private->size.max);
+  if (width == zone_private->size.preferred)
+    return;
+
+  zone_private->size.preferred = width;
+  g_bar.relayout = true;
+}
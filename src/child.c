@@ -0,0 +1,242 @@
+#include <gaybar/child.h>
+#include <gaybar/sched.h>
+#include <gaybar/stats.h>
+#include <gaybar/list.h>
+#include <gaybar/log.h>
+#include <gaybar/util.h>
+#include <gaybar/assert.h>
+#include <gaybar/compiler.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+/* A stopped child that is still around after this gets a SIGKILL */
+#define CHILD_KILL_DELAY_MS 3000
+
+extern char** environ;
+
+/* A child that was stopped, until it is reaped */
+struct stopped_child {
+  struct list link;
+  pid_t pid;
+  int pidfd;
+  u64 stopped_ns;
+};
+
+static struct list g_stopped = LIST_UNINITIALIZED;
+
+void child_init(struct child* child, const char* command,
+                const struct child_callbacks* callbacks) {
+  ASSERT(child != NULL);
+  ASSERT(command != NULL);
+  ASSERT(callbacks->output != NULL);
+  ASSERT(callbacks->exit != NULL);
+
+  child->command = command;
+  child->callbacks = *callbacks;
+  child->pid = -1;
+  child->fd = -1;
+  child->pidfd = -1;
+  child->started_ns = 0;
+}
+
+static void close_fd(int* fd) {
+  if (*fd < 0)
+    return;
+
+  sched_unwatch_fd(*fd);
+  close(*fd);
+  *fd = -1;
+}
+
+static void read_output(int fd, void* data) {
+  ssize_t length;
+  char buffer[4096];
+  struct child* child = data;
+
+  for (;;) {
+    length = read(fd, buffer, sizeof(buffer));
+    if (length < 0 && errno == EINTR)
+      continue;
+    if (length <= 0)
+      break;
+    child->callbacks.output(child, buffer, length);
+  }
+
+  if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return;
+  if (length < 0)
+    log_warn("could not read the output of '%s': %m", child->command);
+
+  close_fd(&child->fd);
+  child->callbacks.output(child, buffer, 0);
+}
+
+/* The pidfd becomes readable once the child has exited */
+static void reap(int fd, void* data) {
+  int status;
+  pid_t pid;
+  struct child* child = data;
+
+  UNUSED(fd);
+
+  pid = waitpid(child->pid, &status, WNOHANG);
+  if (pid == 0)
+    return;
+  if (pid < 0) {
+    log_warn("could not reap '%s' (pid %d): %m", child->command, child->pid);
+    status = 0;
+  }
+
+  close_fd(&child->pidfd);
+  child->pid = -1;
+  child->callbacks.exit(child, status);
+}
+
+b8 child_spawn(struct child* child) {
+  int rc, pidfd, pipe_fds[2];
+  sigset_t signals;
+  posix_spawnattr_t attr;
+  posix_spawn_file_actions_t actions;
+  char* argv[] = { "/bin/sh", "-c", (char*)child->command, NULL };
+
+  ASSERT(!child_is_running(child));
+
+  if (pipe(pipe_fds) < 0) {
+    log_error("could not create a pipe for '%s': %m", child->command);
+    return false;
+  }
+  /* Only the child's stdout copy of the write end must survive the exec */
+  fcntl(pipe_fds[0], F_SETFD, FD_CLOEXEC);
+  fcntl(pipe_fds[1], F_SETFD, FD_CLOEXEC);
+
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+                                   O_RDONLY, 0);
+  posix_spawn_file_actions_adddup2(&actions, pipe_fds[1], STDOUT_FILENO);
+
+  /* The child gets its own process group, so that whatever it starts can
+   * be stopped with it. It must not inherit our signal mask and handlers.
+   */
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP |
+                                  POSIX_SPAWN_SETSIGMASK |
+                                  POSIX_SPAWN_SETSIGDEF);
+  posix_spawnattr_setpgroup(&attr, 0);
+  sigemptyset(&signals);
+  posix_spawnattr_setsigmask(&attr, &signals);
+  sigfillset(&signals);
+  posix_spawnattr_setsigdefault(&attr, &signals);
+
+  rc = posix_spawn(&child->pid, argv[0], &actions, &attr, argv, environ);
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+  close(pipe_fds[1]);
+
+  if (rc != 0) {
+    log_error("could not run '%s': %s", child->command, strerror(rc));
+    close(pipe_fds[0]);
+    child->pid = -1;
+    return false;
+  }
+
+  /* The pid can't be reused before it's reaped, so this can't race with
+   * the child exiting.
+   */
+  pidfd = syscall(SYS_pidfd_open, child->pid, 0);
+  if (pidfd < 0) {
+    log_error("could not watch '%s' (pid %d): %m",
+              child->command, child->pid);
+    kill(-child->pid, SIGKILL);
+    waitpid(child->pid, NULL, 0);
+    close(pipe_fds[0]);
+    child->pid = -1;
+    return false;
+  }
+
+  fcntl(pipe_fds[0], F_SETFL, O_NONBLOCK);
+  child->fd = pipe_fds[0];
+  child->pidfd = pidfd;
+  child->started_ns = stats_now();
+  sched_watch_fd(child->fd, read_output, child);
+  sched_watch_fd(child->pidfd, reap, child);
+
+  log_trace("started '%s' (pid %d)", child->command, child->pid);
+  return true;
+}
+
+static void release_stopped(struct stopped_child* stopped) {
+  close_fd(&stopped->pidfd);
+  list_remove(&stopped->link);
+  free(stopped);
+}
+
+static void reap_stopped(int fd, void* data) {
+  struct stopped_child* stopped = data;
+
+  UNUSED(fd);
+
+  if (waitpid(stopped->pid, NULL, WNOHANG) != 0)
+    release_stopped(stopped);
+}
+
+static void kill_stopped(void) {
+  u64 now_ns;
+  struct stopped_child* stopped;
+
+  now_ns = stats_now();
+  list_for_each(stopped, &g_stopped, link) {
+    if (now_ns - stopped->stopped_ns < MS_TO_NS(CHILD_KILL_DELAY_MS))
+      continue;
+    log_warn("pid %d is still running after SIGTERM, killing it",
+             stopped->pid);
+    kill(-stopped->pid, SIGKILL);
+  }
+}
+
+void child_stop(struct child* child) {
+  struct stopped_child* stopped;
+
+  close_fd(&child->fd);
+  if (child->pid <= 0)
+    return;
+
+  kill(-child->pid, SIGTERM);
+  sched_unwatch_fd(child->pidfd);
+
+  /* The instance that owns the child is about to go away, whatever is
+   * left to reap it must outlive it.
+   */
+  stopped = zalloc(sizeof(*stopped));
+  ASSERT(stopped != NULL);
+
+  stopped->pid = child->pid;
+  stopped->pidfd = child->pidfd;
+  stopped->stopped_ns = stats_now();
+
+  if (!list_is_initialized(&g_stopped))
+    list_init(&g_stopped);
+  list_insert(g_stopped.prev, &stopped->link);
+
+  if (waitpid(stopped->pid, NULL, WNOHANG) != 0)
+    release_stopped(stopped);
+  else {
+    sched_watch_fd(stopped->pidfd, reap_stopped, stopped);
+    sched_task_delayed(kill_stopped, CHILD_KILL_DELAY_MS);
+  }
+
+  child->pid = -1;
+  child->pidfd = -1;
+}
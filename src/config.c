@@ -1,13 +1,16 @@
 #include <gaybar/config.h>
 #include <gaybar/types.h>
 #include <gaybar/log.h>
+#include <gaybar/arena.h>
 #include <gaybar/assert.h>
 #include <gaybar/params.h>
+#include <gaybar/sched.h>
 #include <gaybar/util.h>
 #include <gaybar/compiler.h>
 
-#include <cJSON/cJSON.h>
-
+#include <ctype.h>
+#include <errno.h>
+#include <libgen.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,31 +18,84 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
-
-#define JSON_PATH_INDEX_MAX_LENGTH 16
+#include <sys/inotify.h>
 
 /* Needed because we cast a void* -> uintptr_t -> double */
 STATIC_ASSERT(sizeof(void*) == sizeof(uintptr_t));
 STATIC_ASSERT(sizeof(uintptr_t) == sizeof(double));
 
-static cJSON* g_root;
-static char g_config_path[PATH_MAX];
+/* Nesting deeper than this is refused, instead of running out of stack */
+#define CONFIG_MAX_DEPTH 64
+#define CONFIG_NUMBER_MAX_LENGTH 64
+/* Must be a power of two */
+#define CONFIG_INTERN_BUCKETS 256
+
+enum config_value_type {
+  CONFIG_VALUE_NULL,
+  CONFIG_VALUE_BOOL,
+  CONFIG_VALUE_NUMBER,
+  CONFIG_VALUE_STRING,
+  CONFIG_VALUE_ARRAY,
+  CONFIG_VALUE_OBJECT
+};
 
 struct config_node {
-  char* name;
-  struct config_node* parent;
-  cJSON* json;
+  enum config_value_type type;
+  /* Interned, NULL for the root and the elements of arrays */
+  const char* name;
+  struct config_node* next;
+  union {
+    b8 boolean;
+    double number;
+    /* Interned */
+    const char* string;
+    struct {
+      struct config_node* first;
+      size_t count;
+      /* The config the node belongs to, for its interned names */
+      struct config* config;
+    } children;
+  };
+};
+
+struct interned_string {
+  struct interned_string* next;
+  u32 hash;
+  u32 length;
+  char string[];
+};
+
+struct config {
+  /* Held by the loaded config, and by those who acquired it */
+  size_t refs;
+  /* Holds the nodes and the strings */
+  struct arena arena;
+  struct config_node* root;
+  struct interned_string* strings[CONFIG_INTERN_BUCKETS];
 };
 
+struct parser {
+  struct config* config;
+  char* start;
+  char* s;
+  char* end;
+  /* The first error, s is left where it happened */
+  const char* error;
+};
+
+/* NULL if there is no config */
+static struct config* g_config;
+static char g_config_path[PATH_MAX];
+/* Set once a config file is found, only that file is watched */
+static b8 g_config_found;
+static int g_watch_fd = -1;
+static config_change_callback_t g_on_change;
+
 #define PATH_SPRINTF(x, ...) \
   snprintf(g_config_path, sizeof(g_config_path), x, ##__VA_ARGS__)
 
 #define CONFIG_PATH "gaybar/config.jsonc"
 
-static inline cJSON* unwrap_config_node(struct config_node* node) {
-  return node == CONFIG_ROOT ? g_root : node->json;
-}
-
 static inline b8 can_read_config_file(void) {
   return access(g_config_path, R_OK) == 0;
 }
@@ -81,19 +137,34 @@ static b8 load_config_file_path(void) {
   return false;
 }
 
+/* Returns NULL if the file can't be read, it may be gone for a moment
+ * while an editor replaces it.
+ */
 static char* load_config_file(size_t* buffer_size) {
   int fd;
   char* buffer;
   struct stat statbuf;
 
-  fd = open(g_config_path, O_RDONLY);
-  ASSERT(fd > 0 && "could not open config file");
+  fd = open(g_config_path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    log_error("could not open config file '%s': %m", g_config_path);
+    return NULL;
+  }
 
-  ASSERT(fstat(fd, &statbuf) == 0 && "could not stat config file");
+  if (fstat(fd, &statbuf) < 0 || statbuf.st_size == 0) {
+    log_error("config file '%s' is empty or can't be read", g_config_path);
+    close(fd);
+    return NULL;
+  }
 
-  buffer =
-    mmap(NULL, statbuf.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
-  ASSERT(buffer != MAP_FAILED && "could not map config file");
+  /* The mapping is private, strings are unescaped in place */
+  buffer = mmap(NULL, statbuf.st_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (buffer == MAP_FAILED) {
+    log_error("could not map config file '%s': %m", g_config_path);
+    return NULL;
+  }
 
   *buffer_size = statbuf.st_size;
   return buffer;
@@ -103,46 +174,675 @@ static void unload_config_file(char* buffer, size_t buffer_size) {
   ASSERT(munmap(buffer, buffer_size) == 0);
 }
 
-void config_load(void) {
+static u32 hash_string(const char* s, size_t length) {
+  u32 hash = 2166136261u;
+
+  /* FNV-1a */
+  while (length-- > 0) {
+    hash ^= (u8)*s++;
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+static struct interned_string* find_interned(struct config* config,
+                                             const char* s, size_t length,
+                                             u32 hash) {
+  struct interned_string* interned;
+
+  interned = config->strings[hash & (CONFIG_INTERN_BUCKETS - 1)];
+  for (; interned != NULL; interned = interned->next) {
+    if (interned->hash == hash && interned->length == length &&
+        !memcmp(interned->string, s, length))
+      return interned;
+  }
+
+  return NULL;
+}
+
+/* s does not need to be NUL terminated */
+static const char* intern(struct config* config, const char* s, size_t length) {
+  u32 hash;
+  struct interned_string *interned, **bucket;
+
+  hash = hash_string(s, length);
+  interned = find_interned(config, s, length, hash);
+  if (interned != NULL)
+    return interned->string;
+
+  interned = arena_alloc(&config->arena, sizeof(*interned) + length + 1);
+  interned->hash = hash;
+  interned->length = length;
+  memcpy(interned->string, s, length);
+  interned->string[length] = '\0';
+
+  bucket = &config->strings[hash & (CONFIG_INTERN_BUCKETS - 1)];
+  interned->next = *bucket;
+  *bucket = interned;
+
+  return interned->string;
+}
+
+static inline struct interned_string* interned_of(const char* s) {
+  return CONTAINER_OF(s, struct interned_string, string);
+}
+
+static void free_config(struct config* config) {
+  arena_destroy(&config->arena);
+  free(config);
+}
+
+static b8 fail(struct parser* parser, const char* error) {
+  if (parser->error == NULL)
+    parser->error = error;
+  return false;
+}
+
+/* Skips whitespace and comments, which are allowed since the config is
+ * jsonc.
+ */
+static b8 skip_space(struct parser* parser) {
+  char* s;
+
+  for (;;) {
+    while (parser->s < parser->end && isspace((u8)*parser->s))
+      ++parser->s;
+    if (parser->end - parser->s < 2 || parser->s[0] != '/')
+      return true;
+
+    if (parser->s[1] == '/') {
+      s = memchr(parser->s, '\n', parser->end - parser->s);
+      parser->s = s != NULL ? s : parser->end;
+    } else if (parser->s[1] == '*') {
+      for (s = parser->s + 2; s < parser->end - 1; ++s) {
+        if (s[0] == '*' && s[1] == '/')
+          break;
+      }
+      if (s >= parser->end - 1)
+        return fail(parser, "unterminated comment");
+      parser->s = s + 2;
+    } else
+      return true;
+  }
+}
+
+static inline b8 at(struct parser* parser, char c) {
+  return parser->s < parser->end && *parser->s == c;
+}
+
+static b8 parse_hex4(const char* s, const char* end, u32* out) {
+  size_t i;
+  u32 value;
+
+  if (end - s < 4)
+    return false;
+
+  value = 0;
+  for (i = 0; i < 4; ++i) {
+    if (!isxdigit((u8)s[i]))
+      return false;
+    value = value * 16 + (isdigit((u8)s[i]) ? s[i] - '0'
+                                            : (tolower((u8)s[i]) - 'a' + 10));
+  }
+
+  *out = value;
+  return true;
+}
+
+/* Returns the number of bytes written, at most 4 */
+static size_t encode_utf8(char* out, u32 c) {
+  if (c < 0x80) {
+    out[0] = c;
+    return 1;
+  } else if (c < 0x800) {
+    out[0] = 0xc0 | (c >> 6);
+    out[1] = 0x80 | (c & 0x3f);
+    return 2;
+  } else if (c < 0x10000) {
+    out[0] = 0xe0 | (c >> 12);
+    out[1] = 0x80 | ((c >> 6) & 0x3f);
+    out[2] = 0x80 | (c & 0x3f);
+    return 3;
+  }
+
+  out[0] = 0xf0 | (c >> 18);
+  out[1] = 0x80 | ((c >> 12) & 0x3f);
+  out[2] = 0x80 | ((c >> 6) & 0x3f);
+  out[3] = 0x80 | (c & 0x3f);
+  return 4;
+}
+
+/* *r points right after the 'u'. An escape is at least as long as what it
+ * encodes, so the output never overtakes the input.
+ */
+static b8 parse_unicode_escape(struct parser* parser, char** r, char** w) {
+  u32 c, low;
+  char* s = *r;
+
+  if (!parse_hex4(s, parser->end, &c))
+    goto invalid;
+  s += 4;
+
+  if (c >= 0xd800 && c < 0xdc00) {
+    /* A surrogate pair */
+    if (parser->end - s < 6 || s[0] != '\\' || s[1] != 'u' ||
+        !parse_hex4(s + 2, parser->end, &low) ||
+        low < 0xdc00 || low >= 0xe000)
+      goto invalid;
+    c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+    s += 6;
+  } else if (c >= 0xdc00 && c < 0xe000)
+    goto invalid;
+
+  *w += encode_utf8(*w, c);
+  *r = s;
+  return true;
+
+invalid:
+  parser->s = *r - 2;
+  return fail(parser, "invalid unicode escape");
+}
+
+/* Unescapes the string in place, and returns it interned */
+static const char* parse_string(struct parser* parser) {
+  char *start, *r, *w;
+
+  start = r = w = parser->s + 1;
+  while (r < parser->end && *r != '"') {
+    if ((u8)*r < 0x20) {
+      parser->s = r;
+      fail(parser, "unescaped control character in string");
+      return NULL;
+    }
+
+    if (*r != '\\') {
+      *w++ = *r++;
+      continue;
+    }
+
+    if (++r == parser->end)
+      break;
+    switch (*r++) {
+      case '"':  *w++ = '"';  break;
+      case '\\': *w++ = '\\'; break;
+      case '/':  *w++ = '/';  break;
+      case 'b':  *w++ = '\b'; break;
+      case 'f':  *w++ = '\f'; break;
+      case 'n':  *w++ = '\n'; break;
+      case 'r':  *w++ = '\r'; break;
+      case 't':  *w++ = '\t'; break;
+      case 'u':
+        if (!parse_unicode_escape(parser, &r, &w))
+          return NULL;
+        break;
+      default:
+        parser->s = r - 2;
+        fail(parser, "invalid escape sequence");
+        return NULL;
+    }
+  }
+
+  if (r >= parser->end) {
+    fail(parser, "unterminated string");
+    return NULL;
+  }
+
+  parser->s = r + 1;
+  return intern(parser->config, start, w - start);
+}
+
+static b8 parse_literal(struct parser* parser, const char* literal) {
+  size_t length = strlen(literal);
+
+  if ((size_t)(parser->end - parser->s) < length ||
+      memcmp(parser->s, literal, length))
+    return fail(parser, "unexpected character");
+
+  parser->s += length;
+  return true;
+}
+
+static inline b8 is_number_char(char c) {
+  return isdigit((u8)c) || c == '-' || c == '+' || c == '.' ||
+         c == 'e' || c == 'E';
+}
+
+static b8 parse_number(struct parser* parser, struct config_node* node) {
+  char* e;
+  size_t length;
+  char buffer[CONFIG_NUMBER_MAX_LENGTH];
+
+  /* The file is not NUL terminated, strtod(..) needs a copy */
+  for (e = parser->s; e < parser->end && is_number_char(*e); ++e)
+    ;
+  length = e - parser->s;
+  if (length == 0)
+    return fail(parser, "unexpected character");
+  if (length >= sizeof(buffer))
+    return fail(parser, "number is too long");
+
+  memcpy(buffer, parser->s, length);
+  buffer[length] = '\0';
+  node->number = strtod(buffer, &e);
+  if (*e != '\0')
+    return fail(parser, "invalid number");
+
+  node->type = CONFIG_VALUE_NUMBER;
+  parser->s += length;
+  return true;
+}
+
+static struct config_node* parse_value(struct parser* parser, size_t depth);
+
+/* Objects and arrays may have a trailing comma */
+static b8 parse_container(struct parser* parser, struct config_node* node,
+                          size_t depth) {
+  char close;
+  const char* name;
+  b8 is_object;
+  struct config_node *child, **tail;
+
+  is_object = *parser->s == '{';
+  close = is_object ? '}' : ']';
+
+  node->type = is_object ? CONFIG_VALUE_OBJECT : CONFIG_VALUE_ARRAY;
+  node->children.first = NULL;
+  node->children.count = 0;
+  node->children.config = parser->config;
+  tail = &node->children.first;
+  ++parser->s;
+
+  for (;;) {
+    if (!skip_space(parser))
+      return false;
+    if (at(parser, close))
+      break;
+
+    name = NULL;
+    if (is_object) {
+      if (!at(parser, '"'))
+        return fail(parser, "expected a key");
+      if ((name = parse_string(parser)) == NULL)
+        return false;
+      if (!skip_space(parser))
+        return false;
+      if (!at(parser, ':'))
+        return fail(parser, "expected ':'");
+      ++parser->s;
+    }
+
+    if ((child = parse_value(parser, depth + 1)) == NULL)
+      return false;
+    child->name = name;
+    *tail = child;
+    tail = &child->next;
+    ++node->children.count;
+
+    if (!skip_space(parser))
+      return false;
+    if (at(parser, ',')) {
+      ++parser->s;
+      continue;
+    }
+    if (at(parser, close))
+      break;
+    return fail(parser, is_object ? "expected ',' or '}'"
+                                  : "expected ',' or ']'");
+  }
+
+  ++parser->s;
+  return true;
+}
+
+static struct config_node* parse_value(struct parser* parser, size_t depth) {
+  b8 ok;
+  struct config_node* node;
+
+  if (depth > CONFIG_MAX_DEPTH) {
+    fail(parser, "nested too deep");
+    return NULL;
+  }
+
+  if (!skip_space(parser))
+    return NULL;
+  if (parser->s == parser->end) {
+    fail(parser, "unexpected end of file");
+    return NULL;
+  }
+
+  node = arena_alloc(&parser->config->arena, sizeof(*node));
+  node->name = NULL;
+  node->next = NULL;
+
+  switch (*parser->s) {
+    case '{':
+    case '[':
+      ok = parse_container(parser, node, depth);
+      break;
+    case '"':
+      node->type = CONFIG_VALUE_STRING;
+      node->string = parse_string(parser);
+      ok = node->string != NULL;
+      break;
+    case 't':
+    case 'f':
+      node->type = CONFIG_VALUE_BOOL;
+      node->boolean = *parser->s == 't';
+      ok = parse_literal(parser, node->boolean ? "true" : "false");
+      break;
+    case 'n':
+      node->type = CONFIG_VALUE_NULL;
+      ok = parse_literal(parser, "null");
+      break;
+    default:
+      ok = parse_number(parser, node);
+      break;
+  }
+
+  return ok ? node : NULL;
+}
+
+static void log_parse_error(struct parser* parser) {
+  char* s;
+  size_t line, column;
+
+  line = column = 1;
+  for (s = parser->start; s < parser->s; ++s) {
+    if (*s == '\n') {
+      ++line;
+      column = 1;
+    } else
+      ++column;
+  }
+
+  log_error("%s:%zu:%zu: %s", g_config_path, line, column, parser->error);
+}
+
+/* content is modified. Returns a config with a single reference, or NULL
+ * if content can't be parsed.
+ */
+static struct config* parse_config(char* content, size_t content_size) {
+  struct config* config;
+  struct config_node* root;
+  struct parser parser = {
+    .start = content,
+    .s = content,
+    .end = content + content_size,
+    .error = NULL
+  };
+
+  config = zalloc(sizeof(*config));
+  ASSERT(config != NULL);
+  config->refs = 1;
+  parser.config = config;
+
+  root = parse_value(&parser, 0);
+  if (root != NULL && root->type != CONFIG_VALUE_OBJECT) {
+    parser.s = parser.start;
+    fail(&parser, "the config must be an object");
+    root = NULL;
+  }
+  /* fail(..) keeps the error of an unterminated comment */
+  if (root != NULL && (!skip_space(&parser) || parser.s != parser.end)) {
+    fail(&parser, "unexpected data after the end of the config");
+    root = NULL;
+  }
+
+  if (root == NULL) {
+    log_parse_error(&parser);
+    free_config(config);
+    return NULL;
+  }
+
+  config->root = root;
+  return config;
+}
+
+static struct config* read_config(void) {
   char* content;
   size_t content_size;
+  struct config* config;
+
+  content = load_config_file(&content_size);
+  if (content == NULL)
+    return NULL;
+
+  config = parse_config(content, content_size);
+  unload_config_file(content, content_size);
+
+  return config;
+}
 
+void config_load(void) {
   if (!load_config_file_path()) {
     log_info("could not find config file, running with default options");
     return;
   }
+  g_config_found = true;
 
-  content = load_config_file(&content_size);
+  g_config = read_config();
+  if (g_config == NULL)
+    log_error("could not parse config file, running with default options");
+}
+
+void config_unload(void) {
+  if (g_config != NULL)
+    config_release(g_config->root);
+  g_config = NULL;
+}
 
-  g_root = cJSON_ParseWithLength(content, content_size);
-  if (g_root == NULL)
-    /* FIXME: Print where the error is */
-    log_error("could not parse config file");
+b8 config_reload(void) {
+  struct config* config;
 
-  unload_config_file(content, content_size);
+  if (!g_config_found)
+    return false;
+
+  config = read_config();
+  if (config == NULL) {
+    log_error("could not parse config file, keeping the current one");
+    return false;
+  }
+
+  config_unload();
+  g_config = config;
+  return true;
 }
 
-void config_unload(void) {
-  cJSON_Delete(g_root);
+struct config_node* config_root(void) {
+  return g_config != NULL ? g_config->root : NULL;
+}
+
+struct config_node* config_acquire(void) {
+  if (g_config == NULL)
+    return NULL;
+
+  ++g_config->refs;
+  return g_config->root;
+}
+
+void config_release(struct config_node* root) {
+  struct config* config;
+
+  if (root == NULL)
+    return;
+
+  config = root->children.config;
+  ASSERT(config->root == root);
+  ASSERT(config->refs > 0);
+  if (--config->refs == 0)
+    free_config(config);
+}
+
+/* Strings are interned, their hashes and lengths are already known */
+static b8 strings_equal(const char* a, const char* b) {
+  struct interned_string *interned_a, *interned_b;
+
+  if (a == b)
+    return true;
+  if (a == NULL || b == NULL)
+    return false;
+
+  interned_a = interned_of(a);
+  interned_b = interned_of(b);
+  return interned_a->hash == interned_b->hash &&
+         interned_a->length == interned_b->length &&
+         !memcmp(a, b, interned_a->length);
+}
+
+b8 config_node_equal(struct config_node* a, struct config_node* b) {
+  struct config_node *child_a, *child_b;
+
+  if (a == b)
+    return true;
+  if (a == NULL || b == NULL || a->type != b->type)
+    return false;
+
+  switch (a->type) {
+    case CONFIG_VALUE_NULL:
+      return true;
+    case CONFIG_VALUE_BOOL:
+      return a->boolean == b->boolean;
+    case CONFIG_VALUE_NUMBER:
+      return a->number == b->number;
+    case CONFIG_VALUE_STRING:
+      return strings_equal(a->string, b->string);
+    case CONFIG_VALUE_ARRAY:
+    case CONFIG_VALUE_OBJECT:
+      break;
+  }
+
+  /* Objects with the same members in another order are not equal */
+  if (a->children.count != b->children.count)
+    return false;
+  child_a = a->children.first;
+  child_b = b->children.first;
+  for (; child_a != NULL; child_a = child_a->next, child_b = child_b->next) {
+    if (!strings_equal(child_a->name, child_b->name) ||
+        !config_node_equal(child_a, child_b))
+      return false;
+  }
+
+  return true;
+}
+
+/* Reads every pending event, the callback runs once however many there
+ * are: saving a file can take more than one write.
+ */
+static void read_watch_events(int fd, void* data) {
+  b8 changed;
+  ssize_t length;
+  char* s;
+  const char* name;
+  struct inotify_event* event;
+  char buffer[4096] ALIGNED(__alignof__(struct inotify_event));
+
+  UNUSED(data);
+
+  name = strrchr(g_config_path, '/');
+  name = name != NULL ? name + 1 : g_config_path;
+
+  changed = false;
+  for (;;) {
+    length = read(fd, buffer, sizeof(buffer));
+    if (length < 0 && errno == EINTR)
+      continue;
+    if (length <= 0)
+      break;
+
+    for (s = buffer; s < buffer + length; s += sizeof(*event) + event->len) {
+      event = (struct inotify_event*)s;
+      if (event->len > 0 && !strcmp(event->name, name))
+        changed = true;
+    }
+  }
+
+  if (changed) {
+    log_info("config file '%s' changed, reloading it", g_config_path);
+    g_on_change();
+  }
+}
+
+void config_watch(config_change_callback_t on_change) {
+  int fd;
+  char dir[PATH_MAX];
+
+  ASSERT(on_change != NULL);
+
+  if (!g_config_found)
+    return;
+
+  fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    log_warn("could not watch the config file: %m");
+    return;
+  }
+
+  /* Editors often save by renaming a new file over the old one, which only
+   * the directory sees.
+   */
+  snprintf(dir, sizeof(dir), "%s", g_config_path);
+  if (inotify_add_watch(fd, dirname(dir), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    log_warn("could not watch the config file: %m");
+    close(fd);
+    return;
+  }
+
+  g_watch_fd = fd;
+  g_on_change = on_change;
+  sched_watch_fd(fd, read_watch_events, NULL);
+}
+
+void config_unwatch(void) {
+  if (g_watch_fd < 0)
+    return;
+
+  sched_unwatch_fd(g_watch_fd);
+  close(g_watch_fd);
+  g_watch_fd = -1;
+  g_on_change = NULL;
+}
+
+struct config_node* config_get_node(struct config_node* parent,
+                                    const char* name) {
+  size_t length;
+  struct config_node* node;
+  struct interned_string* interned;
+
+  if (parent == NULL || parent->type != CONFIG_VALUE_OBJECT)
+    return NULL;
+
+  /* Names are interned, a name that was never seen matches no node */
+  length = strlen(name);
+  interned = find_interned(parent->children.config, name, length,
+                           hash_string(name, length));
+  if (interned == NULL)
+    return NULL;
+
+  for (node = parent->children.first; node != NULL; node = node->next) {
+    if (node->name == interned->string)
+      return node;
+  }
+
+  return NULL;
 }
 
 static inline b8 is_int(double x) {
   return (x - (double)((i64)x)) == 0.0;
 }
 
-static b8 is_same_type(struct _config_param* param, cJSON* json) {
+static b8 is_same_type(struct _config_param* param, struct config_node* node) {
   switch (param->type) {
     case _CONFIG_PARAM_TYPE_INTEGER:
-      return cJSON_IsNumber(json) &&
-             is_int(cJSON_GetNumberValue(json));
+      return node->type == CONFIG_VALUE_NUMBER && is_int(node->number);
     case _CONFIG_PARAM_TYPE_FLOAT:
-      return cJSON_IsNumber(json);
+      return node->type == CONFIG_VALUE_NUMBER;
     case _CONFIG_PARAM_TYPE_STRING:
-      return cJSON_IsString(json);
+      return node->type == CONFIG_VALUE_STRING;
     case _CONFIG_PARAM_TYPE_BOOL:
-      return cJSON_IsBool(json);
+      return node->type == CONFIG_VALUE_BOOL;
     case _CONFIG_PARAM_TYPE_ARRAY:
-      return cJSON_IsArray(json);
+      return node->type == CONFIG_VALUE_ARRAY;
 
     default:
       /* FIXME: Print full json path of parameter */
@@ -168,21 +868,28 @@ static const char* param_type_string(struct _config_param* param) {
   }
 }
 
-static const char* json_type_string(cJSON* json) {
-  if (cJSON_IsNumber(json))
-    return is_int(cJSON_GetNumberValue(json)) ? "INTEGER"
-                                              : "FLOAT";
-  else if (cJSON_IsBool(json))
-    return "BOOL";
-  else if (cJSON_IsString(json))
-    return "STRING";
-  else if (cJSON_IsArray(json))
-    return "ARRAY";
-  else
-    return "(invalid type)";
+static const char* node_type_string(struct config_node* node) {
+  switch (node->type) {
+    case CONFIG_VALUE_NUMBER:
+      return is_int(node->number) ? "INTEGER" : "FLOAT";
+    case CONFIG_VALUE_BOOL:
+      return "BOOL";
+    case CONFIG_VALUE_STRING:
+      return "STRING";
+    case CONFIG_VALUE_ARRAY:
+      return "ARRAY";
+    case CONFIG_VALUE_OBJECT:
+      return "OBJECT";
+    case CONFIG_VALUE_NULL:
+      return "NULL";
+    default:
+      return "(invalid type)";
+  }
 }
 
-static void store_param_value(struct _config_param* param, void* value) {
+static void store_default_value(struct _config_param* param) {
+  void* value = param->default_value;
+
   switch (param->type) {
   case _CONFIG_PARAM_TYPE_INTEGER:
     *((long*)param->store) = (long)value;
@@ -193,7 +900,11 @@ static void store_param_value(struct _config_param* param, void* value) {
     break;
 
   case _CONFIG_PARAM_TYPE_STRING:
-    *((char**)param->store) = value != NULL ? strdup(value) : NULL;
+    *((const char**)param->store) = value;
+    break;
+
+  case _CONFIG_PARAM_TYPE_BOOL:
+    *((b8*)param->store) = (b8)(uintptr_t)value;
     break;
 
   default:
@@ -201,34 +912,41 @@ static void store_param_value(struct _config_param* param, void* value) {
   }
 }
 
-static void get_json_value(cJSON* item, void** out) {
-  double number;
+static void store_node_value(struct _config_param* param,
+                             struct config_node* node) {
+  switch (param->type) {
+  case _CONFIG_PARAM_TYPE_INTEGER:
+    *((long*)param->store) = (long)node->number;
+    break;
 
-  if (cJSON_IsNumber(item)) {
-    number = cJSON_GetNumberValue(item);
-    *out = (void*)
-      (is_int(cJSON_GetNumberValue(item)) ? (intptr_t)number
-                                          : *(intptr_t*)&number);
-  }
-  else if (cJSON_IsBool(item))
-    *out = (void*)(uintptr_t)(cJSON_IsTrue(item) ? true : false);
-  else if (cJSON_IsString(item))
-    *out = cJSON_GetStringValue(item);
-  else
+  case _CONFIG_PARAM_TYPE_FLOAT:
+    *((double*)param->store) = node->number;
+    break;
+
+  case _CONFIG_PARAM_TYPE_STRING:
+    *((const char**)param->store) = node->string;
+    break;
+
+  case _CONFIG_PARAM_TYPE_BOOL:
+    *((b8*)param->store) = node->boolean;
+    break;
+
+  default:
     ASSERT(false && "unreachable");
+  }
 }
 
-static void array_parse(struct _config_param* param, cJSON* array) {
+static void array_parse(struct _config_param* param, struct config_node* array) {
   size_t i;
-  cJSON* elem;
+  struct config_node* elem;
   config_array_parse_callback_t cb;
 
   cb = param->store;
   ASSERT(cb != NULL);
 
   i = 0;
-  cJSON_ArrayForEach(elem, array)
-    cb(i++, &((struct config_node) { .json = elem }));
+  for (elem = array->children.first; elem != NULL; elem = elem->next)
+    cb(i++, elem, param->data);
 }
 
 static void array_empty(struct _config_param* param) {
@@ -239,14 +957,15 @@ static void array_empty(struct _config_param* param) {
   }
 }
 
-static inline cJSON* item_by_name(cJSON* container, const char* name) {
+static inline struct config_node* item_by_name(struct config_node* container,
+                                               const char* name) {
   return name == CONFIG_PARAM_SELF ? container
-                                   : cJSON_GetObjectItem(container, name);
+                                   : config_get_node(container, name);
 }
 
-static b8 parse_parameter(cJSON* container, struct _config_param* param) {
-  cJSON* item;
-  void* value;
+static b8 parse_parameter(struct config_node* container,
+                          struct _config_param* param) {
+  struct config_node* item;
 
   item = item_by_name(container, param->name);
   if (item == NULL) {
@@ -255,7 +974,7 @@ try_store_default_value:
     if (param->type == _CONFIG_PARAM_TYPE_ARRAY)
       array_empty(param);
     else if (param->has_default_value)
-      store_param_value(param, param->default_value);
+      store_default_value(param);
     else
       log_fatal("missing required configuration parameter '%s' of type %s",
                 param->name, param_type_string(param));
@@ -265,17 +984,15 @@ try_store_default_value:
   if (!is_same_type(param, item)) {
     log_error("type mismatch for configuration parameter %s", param->name);
     log_error("expected %s, but got %s",
-              param_type_string(param), json_type_string(item));
+              param_type_string(param), node_type_string(item));
     goto try_store_default_value;
   }
 
   if (param->type == _CONFIG_PARAM_TYPE_ARRAY)
-    cJSON_GetArraySize(item) == 0 ? array_empty(param)
-                                  : array_parse(param, item);
-  else {
-    get_json_value(item, &value);
-    store_param_value(param, value);
-  }
+    item->children.count == 0 ? array_empty(param)
+                              : array_parse(param, item);
+  else
+    store_node_value(param, item);
 
   return true;
 }
@@ -284,37 +1001,14 @@ size_t _config_parse(struct config_node* node,
                      struct _config_param* params, size_t params_count) {
   size_t parsed;
   struct _config_param* param;
-  cJSON* json_node;
 
   parsed = 0;
   param = params;
-  json_node = unwrap_config_node(node);
 
   for (; params_count > 0; --params_count) {
-    parsed += parse_parameter(json_node, param);
+    parsed += parse_parameter(node, param);
     ++param;
   }
 
   return parsed;
 }
-
-struct config_node* config_get_node(struct config_node* parent,
-                                    const char* name) {
-  struct config_node* node = zalloc(sizeof(*node));
-  ASSERT(node != NULL);
-  node->name = strdup(name);
-  node->parent = parent;
-  node->json = cJSON_GetObjectItem(unwrap_config_node(parent), name);
-  return node;
-}
-
-void config_destroy_node(struct config_node* node) {
-  /* We do not delete the cJSON pointer inside the node, because it will
-   * be deleted by config_unload(..) and somebody else might request the
-   * a the same node.
-   *
-   * NOTE: Should we refcount the struct instead?
-   */
-  free(node->name);
-  free(node);
-}
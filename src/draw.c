@@ -3,21 +3,42 @@
 #include <gaybar/util.h>
 #include <gaybar/bar.h>
 #include <gaybar/assert.h>
+#include <gaybar/compiler.h>
+#include <gaybar/slab.h>
+#include <gaybar/arena.h>
 
 #include <stdlib.h>
+#include <string.h>
+
+/* Index of the pixel (x, y) of a zone of a vertical bar, see struct zone */
+#define ROTATED_INDEX(x, y, height) ((x) * (height) + (height) - 1 - (y))
 
 struct draw {
   struct zone* zone;
+  b8 vertical;
   b8 dirty;
 };
 
+static struct slab g_draws = SLAB_INITIALIZER(struct draw);
+static size_t g_draws_active;
+
+/* Scratch data of the draws in progress, thrown away when the last one
+ * ends.
+ */
+static struct arena g_scratch = ARENA_INITIALIZER;
+
+DESTRUCTOR static void free_draws(void) {
+  slab_destroy(&g_draws);
+  arena_destroy(&g_scratch);
+}
+
 static inline void mark_dirty(struct draw* draw) {
   if (!draw->dirty)
     draw->dirty = true;
 }
 
 struct draw* _draw_start(struct zone** zonep) {
-  struct draw* draw = zalloc(sizeof(*draw));
+  struct draw* draw = slab_alloc(&g_draws);
 
   ASSERT(draw != NULL);
   ASSERT(zonep != NULL);
@@ -25,8 +46,10 @@ struct draw* _draw_start(struct zone** zonep) {
 
   /* Take ownership of the zone */
   draw->zone = *zonep;
+  draw->vertical = bar_is_vertical();
   draw->dirty = false;
   *zonep = NULL;
+  ++g_draws_active;
 
   return draw;
 }
@@ -44,9 +67,12 @@ struct zone* _draw_end(struct draw** drawp) {
   if (draw->dirty)
     zone_request_redraw(zone);
 
-  free(draw);
+  slab_free(&g_draws, draw);
   *drawp = NULL;
 
+  if (--g_draws_active == 0)
+    arena_reset(&g_scratch);
+
   return zone;
 }
 
@@ -68,6 +94,15 @@ void draw_rect(struct draw* draw, u32 x, u32 y, u32 w, u32 h, u32 color) {
   ex = min(sx + w, width);
   ey = min(sy + h, height);
 
+  if (draw->vertical) {
+    /* The pixels of a column are contiguous */
+    for (x = sx; x < ex; ++x) {
+      for (y = sy; y < ey; ++y)
+        c[ROTATED_INDEX(x, y, height)] = color;
+    }
+    return;
+  }
+
   for (y = sy; y < ey; ++y) {
     for (x = sx; x < ex; ++x)
       c[x + y * width] = color;
@@ -93,9 +128,47 @@ void draw_icon(struct draw* draw, u32 x, u32 y, u32 w, u32 h, u32* icon) {
   ex = min(sx + w, width);
   ey = min(sy + h, height);
 
-  for (iy = 0, y = sy; y < ey; ++iy, ++y) {
-    for (ix = 0, x = sx; x < ex; ++ix, ++x)
-      c[x + y * width] = icon[ix + iy * w];
+  if (sx >= ex)
+    return;
+
+  if (draw->vertical) {
+    for (ix = 0, x = sx; x < ex; ++ix, ++x) {
+      for (iy = 0, y = sy; y < ey; ++iy, ++y)
+        c[ROTATED_INDEX(x, y, height)] = icon[ix + iy * w];
+    }
+    return;
+  }
+
+  /* Rows are contiguous in both buffers */
+  for (iy = 0, y = sy; y < ey; ++iy, ++y)
+    memcpy(&c[sx + y * width], &icon[iy * w], (ex - sx) * sizeof(*c));
+}
+
+/* Glyphs are blended with what is below them, so the area of the zone the
+ * string covers is rotated back in a scratch buffer, drawn on, and rotated
+ * again.
+ */
+static void draw_rotated_string(struct draw* draw, u32 x, u32 y,
+                                const char* string, u32 color) {
+  u32 w, h, ix, iy, height, *c, *scratch;
+
+  height = draw->zone->height;
+  c = draw->zone->image_buffer;
+
+  w = draw->zone->width - x;
+  h = height - y;
+  scratch = arena_alloc(&g_scratch, (size_t)w * h * sizeof(*scratch));
+
+  for (iy = 0; iy < h; ++iy) {
+    for (ix = 0; ix < w; ++ix)
+      scratch[ix + iy * w] = c[ROTATED_INDEX(x + ix, y + iy, height)];
+  }
+
+  font_string_render(string, false, color, scratch, w, h, w);
+
+  for (ix = 0; ix < w; ++ix) {
+    for (iy = 0; iy < h; ++iy)
+      c[ROTATED_INDEX(x + ix, y + iy, height)] = scratch[ix + iy * w];
   }
 }
 
@@ -114,8 +187,14 @@ void draw_string(struct draw* draw, u32 x, u32 y,
   zone = draw->zone;
 
   if (x >= zone->width || y >= zone->height) {
-    log_warn("drawing out of bounds (x=%zu, y=%zu) on zone (w=%zu, h=%zu)",
-             x, y, zone->width, zone->height);
+    log_warn_ratelimited("drawing out of bounds (x=%zu, y=%zu) "
+                         "on zone (w=%zu, h=%zu)",
+                         x, y, zone->width, zone->height);
+    return;
+  }
+
+  if (draw->vertical) {
+    draw_rotated_string(draw, x, y, string, color);
     return;
   }
 
@@ -138,3 +217,31 @@ u32 draw_height(struct draw* draw) {
   ASSERT(draw->zone != NULL);
   return draw->zone->height;
 }
+
+void fill_buffer_region(u32 src_x, u32 src_y,
+                        u32 dst_x, u32 dst_y,
+                        u32 width, u32 height,
+                        u32* src, u32 src_stride,
+                        u32* dst, u32 dst_stride) {
+  size_t i_src, i_dst;
+  size_t w, h;
+
+  i_src = src_y * src_stride + src_x;
+  i_dst = dst_y * dst_stride + dst_x;
+
+  /* Full rows of the same length, as when blitting on vertical bars */
+  if (width == src_stride && width == dst_stride) {
+    memcpy(&dst[i_dst], &src[i_src], (size_t)width * height * sizeof(*dst));
+    return;
+  }
+
+  /* NOTE: Drawing is done on the CPU, and is very slow.
+   *       Call this function sparingly.
+   */
+  for (h = 0; h < height; ++h) {
+    for (w = 0; w < width; ++w)
+      dst[i_dst + w] = src[i_src + w];
+    i_src += src_stride;
+    i_dst += dst_stride;
+  }
+}
@@ -6,12 +6,14 @@
 #include <gaybar/util.h>
 #include <gaybar/compiler.h>
 #include <gaybar/config.h>
+#include <gaybar/slab.h>
 
 #include <fontconfig/fontconfig.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H
 
 #include <ctype.h>
+#include <string.h>
 #include <unistd.h>
 
 #define FONT_DEFAULT_SIZE 14
@@ -29,6 +31,7 @@ struct vec2u32 {
 };
 
 struct rendered_glyph {
+  /* Set when the bitmap didn't fit in the cache entry, and was malloc'ed */
   b8 owns_bitmap;
   u32 width, height;
   struct vec2u32 offset, advance;
@@ -39,6 +42,8 @@ struct cached_glyph {
   struct rendered_glyph glyph;
   u32 char_code;
   u32 hits;
+  /* Big enough for the bitmap of most glyphs, see glyph_bitmap_capacity() */
+  unsigned char bitmap[];
 };
 STATIC_ASSERT(OFFSET_OF(struct cached_glyph, glyph) == 0);
 
@@ -61,6 +66,7 @@ struct font_cache {
 
 static struct font g_font;
 static struct font_cache g_font_cache;
+static struct slab g_glyph_slab;
 static FT_Library g_library;
 
 static const char* ft_strerror(FT_Error error) {
@@ -77,15 +83,15 @@ static const char* ft_strerror(FT_Error error) {
 #undef FTERRORS_H_
 }
 
-static b8 render_glyph(u32 char_code, struct rendered_glyph* res, b8 copy) {
-  size_t y;
+/* NOTE: res->bitmap is only valid until the next call to this function */
+static b8 render_glyph(u32 char_code, struct rendered_glyph* res) {
   FT_GlyphSlot glyph;
   FT_Error error;
 
   error = FT_Load_Char(g_font.face, char_code, FT_LOAD_RENDER);
   if (error) {
-    log_warn("could not load glyph for character code %#lx: %s",
-             char_code, ft_strerror(error));
+    log_warn_ratelimited("could not load glyph for character code %#lx: %s",
+                         char_code, ft_strerror(error));
     return false;
   }
 
@@ -100,39 +106,57 @@ static b8 render_glyph(u32 char_code, struct rendered_glyph* res, b8 copy) {
   res->advance.y = glyph->advance.y;
   res->offset.x = glyph->bitmap_left;
   res->offset.y = g_font.size_in_pixels - glyph->bitmap_top;
-  res->owns_bitmap = copy;
-  if (copy) {
-    res->bitmap = malloc(res->height * res->width);
-    ASSERT(res->bitmap != NULL);
-    for (y = 0; y < res->height; ++y)
-      memcpy(res->bitmap + y * res->width,
-             glyph->bitmap.buffer + y * glyph->bitmap.pitch,
-             res->width);
-  } else
-    /* NOTE: If copy is not true, res->bitmap is only valid until the next
-     *       call to this function.
-     */
-    res->bitmap = glyph->bitmap.buffer;
+  res->owns_bitmap = false;
+  res->bitmap = glyph->bitmap.buffer;
 
   return true;
 }
 
+/* Glyphs are about as big as the font size */
+static inline size_t glyph_bitmap_capacity(void) {
+  return g_font.size_in_pixels * g_font.size_in_pixels;
+}
+
+static void uncache_glyph(struct cached_glyph* cached) {
+  if (cached->glyph.owns_bitmap)
+    free(cached->glyph.bitmap);
+  slab_free(&g_glyph_slab, cached);
+}
+
 static struct rendered_glyph* cache_glyph(u32 char_code,
                                           struct cached_glyph** slot) {
+  size_t y;
+  unsigned char* bitmap;
   struct rendered_glyph glyph;
+  struct cached_glyph* cached;
+  FT_Bitmap* ft_bitmap = &g_font.face->glyph->bitmap;
 
-  if (!render_glyph(char_code, &glyph, true))
+  if (!render_glyph(char_code, &glyph))
     return NULL;
 
-  *slot = malloc(sizeof(**slot));
-  ASSERT(*slot != NULL);
-  (*slot)->char_code = char_code;
-  (*slot)->hits = 1;
-  (*slot)->glyph = glyph;
+  cached = slab_alloc(&g_glyph_slab);
+  if ((size_t)glyph.width * glyph.height <= glyph_bitmap_capacity())
+    bitmap = cached->bitmap;
+  else {
+    bitmap = malloc((size_t)glyph.width * glyph.height);
+    ASSERT(bitmap != NULL);
+    glyph.owns_bitmap = true;
+  }
+
+  for (y = 0; y < glyph.height; ++y)
+    memcpy(bitmap + y * glyph.width,
+           ft_bitmap->buffer + y * ft_bitmap->pitch,
+           glyph.width);
+  glyph.bitmap = bitmap;
+
+  cached->char_code = char_code;
+  cached->hits = 1;
+  cached->glyph = glyph;
+  *slot = cached;
 
   log_trace("caching glyph for char code %#lx", char_code);
 
-  return &(*slot)->glyph;
+  return &cached->glyph;
 }
 
 static inline u8 get_char_code_hash(u32 char_code) {
@@ -168,7 +192,7 @@ static struct rendered_glyph* try_fetch_from_cache(u32 char_code,
     return &(*slot)->glyph;
   }
 
-  log_trace("font cache collision on character %#lx", char_code);
+  log_trace_ratelimited("font cache collision on character %#lx", char_code);
 
   /* If a lot of characters hit that slot, evict the glyph currently occupying
    * it, the most used character should (statistically) retake it.
@@ -176,7 +200,7 @@ static struct rendered_glyph* try_fetch_from_cache(u32 char_code,
   if (fill_on_miss /* Don't run this check if we don't plan to fill the slot */
       && ++g_font_cache.wants_slot[char_code_hash] > (*slot)->hits) {
     g_font_cache.wants_slot[char_code_hash] = 0;
-    free(*slot);
+    uncache_glyph(*slot);
     *slot = NULL;
   }
 
@@ -188,8 +212,8 @@ static b8 glyph_load_metrics(u32 char_code) {
 
   error = FT_Load_Char(g_font.face, char_code, FT_LOAD_BITMAP_METRICS_ONLY);
   if (error) {
-    log_warn("could not load glyph for character code %#lx: %s",
-             char_code, ft_strerror(error));
+    log_warn_ratelimited("could not load glyph for character code %#lx: %s",
+                         char_code, ft_strerror(error));
     return false;
   }
 
@@ -228,7 +252,7 @@ static struct vec2u32 render_colored_glyph(u32 char_code,
     goto skip_rendering;
   }
 
-  if (!render_glyph(char_code, &glyph, false))
+  if (!render_glyph(char_code, &glyph))
     /* That glyph does not exist, skip it */
     return (struct vec2u32) { .x = PX2px(g_font.size_in_pixels), .y = 0 };
 
@@ -338,6 +362,13 @@ size_t font_string_width(const char* string) {
   return (max_w64ths >> 6) + ((max_w64ths & 0x3F) != 0);
 }
 
+size_t font_chars_width(size_t length) {
+  size_t w64ths;
+
+  w64ths = glyph_advance('0').x * length;
+  return (w64ths >> 6) + ((w64ths & 0x3F) != 0);
+}
+
 void font_string_render(const char* string, b8 wrap, u32 color, u32* buffer,
                         size_t buffer_width, size_t buffer_height,
                         size_t buffer_stride_in_pixels) {
@@ -398,6 +429,51 @@ new_line:
   }
 }
 
+/* Length of the UTF-8 sequence starting with c, or 0 if c can't start one */
+static size_t utf8_sequence_length(u8 c) {
+  if ((c >> 7) == 0)
+    return 1;
+  if ((c >> 5) == 0b110)
+    return 2;
+  if ((c >> 4) == 0b1110)
+    return 3;
+  if ((c >> 3) == 0b11110)
+    return 4;
+  return 0;
+}
+
+void font_string_sanitize(char* text, size_t text_size,
+                          const char* string, size_t string_length,
+                          size_t length) {
+  size_t i, j, sequence, written, characters;
+
+  written = 0;
+  characters = 0;
+  for (i = 0; i < string_length && characters < length; i += sequence) {
+    sequence = utf8_sequence_length(string[i]);
+    for (j = 1; j < sequence; ++j) {
+      if (i + j >= string_length || ((u8)string[i + j] >> 6) != 0b10)
+        break;
+    }
+
+    if (sequence == 0 || j < sequence ||
+        (sequence == 1 && (u8)string[i] < ' ')) {
+      sequence = 1;
+      if (written + 1 >= text_size)
+        break;
+      text[written++] = '?';
+    } else {
+      if (written + sequence >= text_size)
+        break;
+      memcpy(&text[written], &string[i], sequence);
+      written += sequence;
+    }
+    ++characters;
+  }
+
+  text[written] = '\0';
+}
+
 void font_cache_clear(void) {
   size_t i;
   struct cached_glyph *cached;
@@ -407,9 +483,7 @@ void font_cache_clear(void) {
     cached = g_font_cache.all_cached_glyphs[i];
     if (cached != NULL) {
       log_trace("freeing cached glyph for char code %#lx", cached->char_code);
-      ASSERT(cached->glyph.owns_bitmap);
-      free(cached->glyph.bitmap);
-      free(cached);
+      uncache_glyph(cached);
     }
   }
 
@@ -426,8 +500,12 @@ void font_set_size(size_t pixels) {
     return;
   }
 
-  g_font.size_in_pixels = pixels;
   font_cache_clear();
+  g_font.size_in_pixels = pixels;
+  /* The cache entries are sized for the glyphs */
+  slab_destroy(&g_glyph_slab);
+  slab_init(&g_glyph_slab,
+            sizeof(struct cached_glyph) + glyph_bitmap_capacity());
 }
 
 size_t font_get_size(void) {
@@ -473,9 +551,16 @@ static char* find_font_by_name(const char* font_name) {
   return font_path;
 }
 
-static void parse_config(void) {
+/* Resolves the font file from the config and opens it into font. Nothing
+ * global is touched, so that a font that doesn't load leaves the current
+ * one in place.
+ */
+static b8 load_font(struct font* font) {
   long font_size;
-  char *font_path, *font_name;
+  char* file_path;
+  FT_Error error;
+  FT_Face face;
+  const char *font_path, *font_name;
   struct config_node* font_node = config_get_node(CONFIG_ROOT, "font");
 
   CONFIG_PARSE(font_node,
@@ -499,61 +584,96 @@ static void parse_config(void) {
     )
   );
 
-  if (font_path == NULL) {
-    font_path = find_font_by_name(font_name);
-    free(font_name);
-  }
-  log_trace("loading font file '%s'", font_path);
+  /* The font outlives the config, keep a copy of the path */
+  if (font_path != NULL) {
+    file_path = strdup(font_path);
+    ASSERT(file_path != NULL);
+  } else
+    file_path = find_font_by_name(font_name);
+  if (file_path == NULL)
+    return false;
+  log_trace("loading font file '%s'", file_path);
 
-  if (access(font_path, R_OK) == 0)
-    g_font.file_path = font_path;
-  else
-    log_fatal("could not access font file '%s'", font_path);
+  if (access(file_path, R_OK) != 0) {
+    log_error("could not access font file '%s': %m", file_path);
+    goto fail;
+  }
 
   if (font_size <= 0) {
     log_error("invalid font size %ld, it must be > 0", font_size);
     font_size = FONT_DEFAULT_SIZE;
   }
-  g_font.size_in_pixels = font_size;
 
-  config_destroy_node(font_node);
+  error = FT_New_Face(g_library, file_path, 0, &face);
+  if (error) {
+    log_error("could not load font '%s': %s", file_path, ft_strerror(error));
+    goto fail;
+  }
+
+  error = FT_Set_Pixel_Sizes(face, 0, font_size);
+  if (error) {
+    log_error("could not set character size: %s", ft_strerror(error));
+    goto fail_face;
+  }
+
+  error = FT_Select_Charmap(face, FT_ENCODING_UNICODE);
+  if (error) {
+    log_error("could not select unicode charmap: %s", ft_strerror(error));
+    goto fail_face;
+  }
+
+  font->file_path = file_path;
+  font->size_in_pixels = font_size;
+  font->face = face;
+  return true;
+
+fail_face:
+  FT_Done_Face(face);
+fail:
+  free(file_path);
+  return false;
 }
 
 int font_init(void) {
   FT_Error error;
 
-  parse_config();
-
   error = FT_Init_FreeType(&g_library);
   if (error) {
     log_error("could not initialize freetype: %s", ft_strerror(error));
     return -1;
   }
 
-  error = FT_New_Face(g_library, g_font.file_path, 0, &g_font.face);
-  if (error) {
-    log_error("could not load font '%s': %s",
-              g_font.file_path, ft_strerror(error));
+  if (!load_font(&g_font))
     return -1;
-  }
 
-  error = FT_Set_Pixel_Sizes(g_font.face, 0, g_font.size_in_pixels);
-  if (error) {
-    log_error("could not set character size: %s", ft_strerror(error));
-    return -1;
-  }
+  slab_init(&g_glyph_slab,
+            sizeof(struct cached_glyph) + glyph_bitmap_capacity());
 
-  error = FT_Select_Charmap(g_font.face, FT_ENCODING_UNICODE);
-  if (error) {
-    log_error("could not select unicode charmap: %s", ft_strerror(error));
+  return 0;
+}
+
+int font_reload(void) {
+  struct font font;
+
+  if (!load_font(&font))
     return -1;
-  }
+
+  font_cache_clear();
+  slab_destroy(&g_glyph_slab);
+  FT_Done_Face(g_font.face);
+  free(g_font.file_path);
+
+  g_font = font;
+  /* The cache entries are sized for the glyphs */
+  slab_init(&g_glyph_slab,
+            sizeof(struct cached_glyph) + glyph_bitmap_capacity());
 
   return 0;
 }
 
 void font_cleanup(void) {
   font_cache_clear();
+  slab_destroy(&g_glyph_slab);
   FT_Done_Face(g_font.face);
   FT_Done_FreeType(g_library);
   free(g_font.file_path);
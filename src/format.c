@@ -55,7 +55,7 @@ static inline void fmtbuf_init(struct fmtbuf* buf,
                                char* buffer, size_t buffer_size) {
   buf->ptr = buffer;
   buf->end = buffer + buffer_size;
-  buf->full = false;
+  buf->full = buffer_size == 0;
 }
 
 static b8 get_tag(struct fmtstr* fmt, char* tag_buffer, size_t buffer_size) {
@@ -123,7 +123,10 @@ b8 _format(char* buffer, size_t buffer_size, const char* format,
   ASSERT(format != NULL);
   ASSERT(params != NULL);
 
-  fmtbuf_init(&buf, buffer, buffer_size);
+  ASSERT(buffer_size > 0);
+
+  /* Leave room for the NUL terminator */
+  fmtbuf_init(&buf, buffer, buffer_size - 1);
   fmtstr_init(&fmt, format);
 
   while (!fmtbuf_is_full(&buf) && (c = fmtstr_next(&fmt))) {
@@ -162,5 +165,19 @@ fail_format:
       goto fail_format;
   }
 
+  *buf.ptr = '\0';
+
   return fmtbuf_is_full(&buf);
 }
+
+void format_rate(char* buffer, size_t buffer_size, u64 rate) {
+  size_t unit;
+  f64 value;
+  static const char units[] = { 'B', 'K', 'M', 'G', 'T' };
+
+  value = rate;
+  for (unit = 0; value >= 1000.0 && unit < ARRAY_LENGTH(units) - 1; ++unit)
+    value /= 1024.0;
+
+  snprintf(buffer, buffer_size, "%.1f%c", value, units[unit]);
+}
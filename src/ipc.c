@@ -0,0 +1,369 @@
+#include <gaybar/ipc.h>
+#include <gaybar/sched.h>
+#include <gaybar/stats.h>
+#include <gaybar/log.h>
+#include <gaybar/util.h>
+#include <gaybar/assert.h>
+#include <gaybar/compiler.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define IPC_MAX_CLIENTS 8
+#define IPC_LINE_SIZE   1024
+
+/* Bytes read from a client in one wakeup. A client that sends more than
+ * this waits for the next one, so that it can't starve the main loop.
+ */
+#define IPC_READ_BUDGET (64 * 1024)
+
+struct ipc_client {
+  int fd;
+  /* Set when a line didn't fit the buffer, until its end is read */
+  b8 discard;
+  /* The part of a line that was read so far */
+  size_t length;
+  char buffer[IPC_LINE_SIZE];
+};
+
+struct ipc {
+  int socket_fd;
+  struct sockaddr_un socket_addr;
+  struct list targets;
+  struct ipc_client clients[IPC_MAX_CLIENTS];
+};
+
+static struct ipc g_ipc = {
+  .socket_fd = -1,
+  .targets = LIST_UNINITIALIZED
+};
+
+static void reply(struct ipc_client* client, const char* fmt, ...) {
+  int length;
+  char buffer[IPC_LINE_SIZE];
+  va_list ap;
+
+  va_start(ap, fmt);
+  length = vsnprintf(buffer, sizeof(buffer), fmt, ap);
+  va_end(ap);
+
+  if (length < 0)
+    return;
+  length = min(length, (int)sizeof(buffer) - 1);
+  /* A client that doesn't read its replies loses them */
+  send(client->fd, buffer, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+}
+
+/* Returns the number of targets that were found */
+static size_t set_text(const char* name, const char* text, size_t length) {
+  size_t found;
+  struct ipc_target* target;
+
+  found = 0;
+  list_for_each(target, &g_ipc.targets, link) {
+    if (strcmp(target->name, name))
+      continue;
+    target->callbacks.set_text(target, text, length);
+    ++found;
+  }
+
+  return found;
+}
+
+static size_t redraw(const char* name) {
+  size_t found;
+  struct ipc_target* target;
+
+  found = 0;
+  list_for_each(target, &g_ipc.targets, link) {
+    if (name != NULL && strcmp(target->name, name))
+      continue;
+    target->callbacks.redraw(target);
+    ++found;
+  }
+
+  return found;
+}
+
+static void send_stats(struct ipc_client* client) {
+  char* json;
+
+  json = stats_to_json();
+  if (json == NULL) {
+    reply(client, "error: out of memory\n");
+    return;
+  }
+
+  send(client->fd, json, strlen(json), MSG_DONTWAIT | MSG_NOSIGNAL);
+  send(client->fd, "\n", 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+  free(json);
+}
+
+/* Splits the first word off s, returns the rest of it */
+static char* split_word(char* s) {
+  char* space;
+
+  space = strchr(s, ' ');
+  if (space == NULL)
+    return NULL;
+
+  *space = '\0';
+  return space + 1;
+}
+
+/* line is NUL terminated, without its line break */
+static void handle_line(struct ipc_client* client, char* line, size_t length) {
+  char *command, *args, *text;
+
+  if (length > 0 && line[length - 1] == '\r')
+    line[--length] = '\0';
+  if (length == 0)
+    return;
+
+  command = line;
+  args = split_word(command);
+
+  if (!strcmp(command, "set")) {
+    if (args == NULL) {
+      reply(client, "error: usage: set NAME [TEXT]\n");
+      return;
+    }
+    text = split_word(args);
+    if (text == NULL)
+      text = &line[length];
+    if (set_text(args, text, &line[length] - text) == 0)
+      reply(client, "error: no target called '%s'\n", args);
+  } else if (!strcmp(command, "redraw")) {
+    if (redraw(args) == 0 && args != NULL)
+      reply(client, "error: no target called '%s'\n", args);
+  } else if (!strcmp(command, "stats"))
+    send_stats(client);
+  else
+    reply(client, "error: unknown command '%s'\n", command);
+}
+
+/* Handles the lines completed by the length bytes just read */
+static void parse_lines(struct ipc_client* client, size_t length) {
+  char *start, *s, *end, *newline;
+
+  start = client->buffer;
+  s = &client->buffer[client->length];
+  end = s + length;
+
+  while ((newline = memchr(s, '\n', end - s)) != NULL) {
+    *newline = '\0';
+    if (!client->discard)
+      handle_line(client, start, newline - start);
+    client->discard = false;
+    start = s = newline + 1;
+  }
+
+  client->length = end - start;
+  if (client->length == sizeof(client->buffer)) {
+    log_warn_ratelimited("ipc: lines are at most %d bytes long",
+                         IPC_LINE_SIZE - 1);
+    client->discard = true;
+    client->length = 0;
+  } else if (start != client->buffer)
+    memmove(client->buffer, start, client->length);
+}
+
+static void close_client(struct ipc_client* client) {
+  sched_unwatch_fd(client->fd);
+  close(client->fd);
+  client->fd = -1;
+}
+
+static void read_client(int fd, void* data) {
+  ssize_t length;
+  size_t budget;
+  struct ipc_client* client = data;
+
+  budget = IPC_READ_BUDGET;
+  while (budget > 0) {
+    length = read(fd, &client->buffer[client->length],
+                  sizeof(client->buffer) - client->length);
+    if (length < 0 && errno == EINTR)
+      continue;
+    if (length <= 0)
+      break;
+
+    budget -= min(budget, (size_t)length);
+    parse_lines(client, length);
+  }
+
+  /* The rest is read on the next wakeup */
+  if (budget == 0)
+    return;
+  if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    return;
+  if (length < 0)
+    log_warn("ipc: could not read from client: %m");
+
+  close_client(client);
+}
+
+static struct ipc_client* find_free_client(void) {
+  size_t i;
+
+  for (i = 0; i < ARRAY_LENGTH(g_ipc.clients); ++i) {
+    if (g_ipc.clients[i].fd < 0)
+      return &g_ipc.clients[i];
+  }
+
+  return NULL;
+}
+
+static void add_client(int fd) {
+  struct ipc_client* client;
+
+  client = find_free_client();
+  if (client == NULL) {
+    log_warn_ratelimited("ipc: too many clients (max %d)", IPC_MAX_CLIENTS);
+    close(fd);
+    return;
+  }
+
+  if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0 ||
+      fcntl(fd, F_SETFD, FD_CLOEXEC) < 0) {
+    log_warn("ipc: could not set up client: %m");
+    close(fd);
+    return;
+  }
+
+  client->fd = fd;
+  client->discard = false;
+  client->length = 0;
+  sched_watch_fd(fd, read_client, client);
+}
+
+static void accept_clients(int fd, void* data) {
+  int client_fd;
+
+  UNUSED(data);
+
+  for (;;) {
+    client_fd = accept(fd, NULL, NULL);
+    if (client_fd < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        log_warn("ipc: could not accept client: %m");
+      return;
+    }
+    add_client(client_fd);
+  }
+}
+
+/* A socket is only left behind by a bar that is gone. If another bar still
+ * listens on it, it keeps it.
+ */
+static void remove_stale_socket(const struct sockaddr_un* addr) {
+  int fd;
+  b8 stale;
+
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return;
+
+  stale = connect(fd, (const struct sockaddr*)addr, sizeof(*addr)) < 0 &&
+          errno == ECONNREFUSED;
+  close(fd);
+
+  if (stale)
+    unlink(addr->sun_path);
+}
+
+static void open_socket(void) {
+  int fd;
+  size_t written;
+  const char* runtime_dir;
+  struct sockaddr_un* addr = &g_ipc.socket_addr;
+
+  runtime_dir = getenv("XDG_RUNTIME_DIR");
+  if (runtime_dir == NULL) {
+    log_info("XDG_RUNTIME_DIR is not set, not serving ipc");
+    return;
+  }
+
+  addr->sun_family = AF_UNIX;
+  written = snprintf(addr->sun_path, sizeof(addr->sun_path),
+                     "%s/" IPC_SOCKET_NAME, runtime_dir);
+  if (written >= sizeof(addr->sun_path)) {
+    log_error("ipc socket path is too long");
+    return;
+  }
+
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    log_error("could not create ipc socket: %m");
+    return;
+  }
+
+  remove_stale_socket(addr);
+
+  if (bind(fd, (struct sockaddr*)addr, sizeof(*addr)) < 0 ||
+      listen(fd, IPC_MAX_CLIENTS) < 0) {
+    if (errno == EADDRINUSE)
+      log_error("'%s' is in use, is another bar running?", addr->sun_path);
+    else
+      log_error("could not listen on '%s': %m", addr->sun_path);
+    close(fd);
+    return;
+  }
+
+  g_ipc.socket_fd = fd;
+  sched_watch_fd(fd, accept_clients, NULL);
+  log_trace("serving ipc on '%s'", addr->sun_path);
+}
+
+void ipc_init(void) {
+  size_t i;
+
+  for (i = 0; i < ARRAY_LENGTH(g_ipc.clients); ++i)
+    g_ipc.clients[i].fd = -1;
+
+  if (!list_is_initialized(&g_ipc.targets))
+    list_init(&g_ipc.targets);
+
+  open_socket();
+}
+
+void ipc_cleanup(void) {
+  size_t i;
+
+  for (i = 0; i < ARRAY_LENGTH(g_ipc.clients); ++i) {
+    if (g_ipc.clients[i].fd >= 0)
+      close_client(&g_ipc.clients[i]);
+  }
+
+  if (g_ipc.socket_fd >= 0) {
+    sched_unwatch_fd(g_ipc.socket_fd);
+    close(g_ipc.socket_fd);
+    unlink(g_ipc.socket_addr.sun_path);
+    g_ipc.socket_fd = -1;
+  }
+}
+
+void ipc_add_target(struct ipc_target* target) {
+  ASSERT(target != NULL);
+  ASSERT(target->name != NULL);
+  ASSERT(target->callbacks.set_text != NULL);
+  ASSERT(target->callbacks.redraw != NULL);
+
+  if (!list_is_initialized(&g_ipc.targets))
+    list_init(&g_ipc.targets);
+  list_insert(&g_ipc.targets, &target->link);
+}
+
+void ipc_remove_target(struct ipc_target* target) {
+  ASSERT(target != NULL);
+  list_remove(&target->link);
+}
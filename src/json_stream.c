@@ -0,0 +1,328 @@
+#include <gaybar/json_stream.h>
+#include <gaybar/log.h>
+#include <gaybar/util.h>
+#include <gaybar/assert.h>
+
+#include <string.h>
+
+enum json_state {
+  JSON_STATE_VALUE,        /* Expecting a value */
+  JSON_STATE_AFTER_VALUE,  /* Expecting ',' or the end of the container */
+  JSON_STATE_KEY,          /* Expecting a key or the end of the object */
+  JSON_STATE_COLON,
+  JSON_STATE_STRING,
+  JSON_STATE_ESCAPE,
+  JSON_STATE_UNICODE,
+  JSON_STATE_LITERAL,
+  JSON_STATE_RESYNC        /* Skipping to the end of the line */
+};
+
+void json_stream_init(struct json_stream* stream,
+                      const struct json_stream_callbacks* callbacks,
+                      void* data) {
+  ASSERT(stream != NULL);
+  ASSERT(callbacks != NULL);
+
+  memset(stream, 0, sizeof(*stream));
+  stream->callbacks = *callbacks;
+  stream->data = data;
+  stream->state = JSON_STATE_VALUE;
+}
+
+static inline b8 is_space(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+static inline b8 is_literal(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+         c == '-' || c == '+' || c == '.' || c == 'E';
+}
+
+static inline void append(struct json_stream* stream, char c) {
+  /* Too long tokens are truncated, there's nothing better to do */
+  if (stream->token_length < sizeof(stream->token) - 1)
+    stream->token[stream->token_length++] = c;
+}
+
+static void append_codepoint(struct json_stream* stream, u32 code) {
+  if (code < 0x80)
+    append(stream, code);
+  else if (code < 0x800) {
+    append(stream, 0xC0 | (code >> 6));
+    append(stream, 0x80 | (code & 0x3F));
+  } else if (code < 0x10000) {
+    append(stream, 0xE0 | (code >> 12));
+    append(stream, 0x80 | ((code >> 6) & 0x3F));
+    append(stream, 0x80 | (code & 0x3F));
+  } else {
+    append(stream, 0xF0 | (code >> 18));
+    append(stream, 0x80 | ((code >> 12) & 0x3F));
+    append(stream, 0x80 | ((code >> 6) & 0x3F));
+    append(stream, 0x80 | (code & 0x3F));
+  }
+}
+
+/* The state to go to once a value is complete */
+static inline enum json_state after_value(struct json_stream* stream) {
+  /* The stream is a sequence of values at the top level */
+  return stream->depth == 0 ? JSON_STATE_VALUE : JSON_STATE_AFTER_VALUE;
+}
+
+static b8 open_container(struct json_stream* stream, char type) {
+  if (stream->depth >= JSON_STREAM_MAX_DEPTH)
+    return false;
+
+  stream->containers[stream->depth++] = type;
+  stream->key[0] = '\0';
+  if (stream->callbacks.open != NULL)
+    stream->callbacks.open(stream, type);
+
+  stream->state = type == '{' ? JSON_STATE_KEY : JSON_STATE_VALUE;
+  return true;
+}
+
+static b8 close_container(struct json_stream* stream, char type) {
+  if (stream->depth == 0 || stream->containers[stream->depth - 1] != type)
+    return false;
+
+  --stream->depth;
+  stream->key[0] = '\0';
+  if (stream->callbacks.close != NULL)
+    stream->callbacks.close(stream, type);
+
+  stream->state = after_value(stream);
+  return true;
+}
+
+static void emit_value(struct json_stream* stream, enum json_value_type type) {
+  stream->token[stream->token_length] = '\0';
+  if (stream->callbacks.value != NULL)
+    stream->callbacks.value(stream, type, stream->token, stream->token_length);
+  stream->state = after_value(stream);
+}
+
+static b8 finish_literal(struct json_stream* stream) {
+  enum json_value_type type;
+
+  stream->token[stream->token_length] = '\0';
+  if (!strcmp(stream->token, "true"))
+    type = JSON_VALUE_TRUE;
+  else if (!strcmp(stream->token, "false"))
+    type = JSON_VALUE_FALSE;
+  else if (!strcmp(stream->token, "null"))
+    type = JSON_VALUE_NULL;
+  else if ((stream->token[0] >= '0' && stream->token[0] <= '9') ||
+           stream->token[0] == '-')
+    type = JSON_VALUE_NUMBER;
+  else
+    return false;
+
+  emit_value(stream, type);
+  return true;
+}
+
+static void finish_string(struct json_stream* stream) {
+  size_t length;
+
+  if (!stream->is_key) {
+    emit_value(stream, JSON_VALUE_STRING);
+    return;
+  }
+
+  length = min(stream->token_length, sizeof(stream->key) - 1);
+  memcpy(stream->key, stream->token, length);
+  stream->key[length] = '\0';
+  stream->state = JSON_STATE_COLON;
+}
+
+static inline void start_token(struct json_stream* stream,
+                               enum json_state state) {
+  stream->token_length = 0;
+  stream->state = state;
+}
+
+static b8 parse_escape(struct json_stream* stream, char c) {
+  switch (c) {
+    case '"':
+    case '\\':
+    case '/':
+      append(stream, c);
+      break;
+    case 'b':
+      append(stream, '\b');
+      break;
+    case 'f':
+      append(stream, '\f');
+      break;
+    case 'n':
+      append(stream, '\n');
+      break;
+    case 'r':
+      append(stream, '\r');
+      break;
+    case 't':
+      append(stream, '\t');
+      break;
+    case 'u':
+      stream->unicode_digits = 0;
+      stream->codepoint = 0;
+      stream->state = JSON_STATE_UNICODE;
+      return true;
+    default:
+      return false;
+  }
+
+  stream->state = JSON_STATE_STRING;
+  return true;
+}
+
+static b8 parse_unicode(struct json_stream* stream, char c) {
+  u32 digit;
+
+  if (c >= '0' && c <= '9')
+    digit = c - '0';
+  else if (c >= 'a' && c <= 'f')
+    digit = c - 'a' + 10;
+  else if (c >= 'A' && c <= 'F')
+    digit = c - 'A' + 10;
+  else
+    return false;
+
+  stream->codepoint = (stream->codepoint << 4) | digit;
+  if (++stream->unicode_digits < 4)
+    return true;
+
+  stream->state = JSON_STATE_STRING;
+
+  /* Characters outside of the BMP come as a pair of surrogates */
+  if (stream->codepoint >= 0xD800 && stream->codepoint < 0xDC00) {
+    stream->high_surrogate = stream->codepoint;
+    return true;
+  }
+  if (stream->codepoint >= 0xDC00 && stream->codepoint < 0xE000) {
+    if (stream->high_surrogate == 0)
+      return false;
+    stream->codepoint = 0x10000 + ((stream->high_surrogate - 0xD800) << 10) +
+                        (stream->codepoint - 0xDC00);
+  }
+  stream->high_surrogate = 0;
+
+  append_codepoint(stream, stream->codepoint);
+  return true;
+}
+
+/* Returns false on a syntax error. A byte that ends a literal is also the
+ * first byte of what follows, so it's parsed again.
+ */
+static b8 parse_byte(struct json_stream* stream, char c) {
+  switch (stream->state) {
+    case JSON_STATE_VALUE:
+      if (is_space(c))
+        return true;
+      if (c == '{' || c == '[')
+        return open_container(stream, c);
+      if (c == ']')
+        /* An empty array */
+        return close_container(stream, c);
+      if (c == ',' && stream->depth == 1)
+        /* Lines of a stream that was resynchronized start with a comma */
+        return true;
+      if (c == '"') {
+        stream->is_key = false;
+        start_token(stream, JSON_STATE_STRING);
+        return true;
+      }
+      if (is_literal(c)) {
+        start_token(stream, JSON_STATE_LITERAL);
+        append(stream, c);
+        return true;
+      }
+      return false;
+
+    case JSON_STATE_AFTER_VALUE:
+      if (is_space(c))
+        return true;
+      if (c == ',') {
+        stream->state = stream->containers[stream->depth - 1] == '{'
+                          ? JSON_STATE_KEY : JSON_STATE_VALUE;
+        return true;
+      }
+      if (c == ']' || c == '}')
+        return close_container(stream, c == ']' ? '[' : '{');
+      return false;
+
+    case JSON_STATE_KEY:
+      if (is_space(c))
+        return true;
+      if (c == '}')
+        return close_container(stream, '{');
+      if (c == '"') {
+        stream->is_key = true;
+        start_token(stream, JSON_STATE_STRING);
+        return true;
+      }
+      return false;
+
+    case JSON_STATE_COLON:
+      if (is_space(c))
+        return true;
+      if (c == ':') {
+        stream->state = JSON_STATE_VALUE;
+        return true;
+      }
+      return false;
+
+    case JSON_STATE_STRING:
+      if (c == '"')
+        finish_string(stream);
+      else if (c == '\\')
+        stream->state = JSON_STATE_ESCAPE;
+      else
+        append(stream, c);
+      return true;
+
+    case JSON_STATE_ESCAPE:
+      return parse_escape(stream, c);
+
+    case JSON_STATE_UNICODE:
+      return parse_unicode(stream, c);
+
+    case JSON_STATE_LITERAL:
+      if (is_literal(c)) {
+        append(stream, c);
+        return true;
+      }
+      return finish_literal(stream) && parse_byte(stream, c);
+
+    case JSON_STATE_RESYNC:
+      if (c == '\n') {
+        stream->depth = min(stream->depth, (size_t)1);
+        stream->state = JSON_STATE_VALUE;
+      }
+      return true;
+  }
+
+  ASSERT(false && "unreachable");
+}
+
+b8 json_stream_feed(struct json_stream* stream,
+                    const char* bytes, size_t length) {
+  size_t i;
+  b8 ok = true;
+
+  ASSERT(stream != NULL);
+
+  for (i = 0; i < length; ++i) {
+    if (parse_byte(stream, bytes[i]))
+      continue;
+
+    log_trace_ratelimited("json: unexpected '%c' at depth %zu",
+                          bytes[i], stream->depth);
+    stream->state = JSON_STATE_RESYNC;
+    ok = false;
+    /* The byte may be the end of the line already */
+    parse_byte(stream, bytes[i]);
+  }
+
+  return ok;
+}
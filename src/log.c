@@ -2,6 +2,8 @@
 #include <gaybar/params.h>
 #include <gaybar/types.h>
 #include <gaybar/util.h>
+#include <gaybar/compiler.h>
+#include <gaybar/thread.h>
 
 #include <stdarg.h>
 #include <stdio.h>
@@ -9,9 +11,56 @@
 #include <string.h>
 #include <unistd.h>
 #include <time.h>
+#include <sys/eventfd.h>
 
-static FILE* g_log_file;
-static b8 g_use_stderr;
+#define LOG_RING_SIZE   512 /* Must be a power of two */
+#define LOG_RECORD_SIZE 256
+#define LOG_TRUNCATED   "...\n"
+
+/* How long a fatal error waits for the writer to flush the log */
+#define LOG_FLUSH_TIMEOUT_MS 1000
+
+STATIC_ASSERT((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0);
+STATIC_ASSERT(LOG_LEVEL_COMPILED_MAX >= LOG_LEVEL_MIN);
+
+struct log_record {
+  u64 sequence;
+  time_t time;
+  enum log_level level;
+  size_t length;
+  char text[LOG_RECORD_SIZE];
+};
+
+/* Bounded multi producer, single consumer queue. A record can be written
+ * when its sequence equals the position being claimed, and can be read
+ * when it equals the position + 1.
+ */
+struct log_ring {
+  struct log_record records[LOG_RING_SIZE];
+  u64 head;
+  u64 tail;
+  u64 flushed;
+  u64 dropped;
+};
+
+struct logger {
+  FILE* file;
+  b8 use_stderr;
+  int wake_fd;
+  pthread_t writer;
+  b8 running;
+  b8 stop;
+  b8 writer_idle;
+  u64 dropped_reported;
+  /* The date is formatted at most once per second */
+  time_t date_time;
+  char date[32];
+};
+
+enum log_level g_log_level = LOG_LEVEL_MIN;
+
+static struct log_ring g_ring;
+static struct logger g_logger = { .wake_fd = -1 };
 
 static void set_log_level(void) {
   char *env, *endptr;
@@ -20,8 +69,10 @@ static void set_log_level(void) {
     if (env)
       g_params.log_level = strtol(env, &endptr, 10);
   }
-  /* Clamp log level */
-  g_params.log_level = clamp(g_params.log_level, LOG_LEVEL_MIN, LOG_LEVEL_MAX);
+  /* Clamp log level, nothing above the compiled in level can be logged */
+  g_params.log_level = clamp(g_params.log_level, LOG_LEVEL_MIN,
+                             min(LOG_LEVEL_MAX, LOG_LEVEL_COMPILED_MAX));
+  g_log_level = g_params.log_level;
 }
 
 static FILE* open_log_file(const char* path) {
@@ -35,77 +86,326 @@ static FILE* open_log_file(const char* path) {
   return NULL;
 }
 
-static void get_date_time_string(char* buf, size_t len) {
+static void get_date_time_string(time_t t, char* buf, size_t len) {
   struct tm tm;
-  time_t t = time(NULL);
   localtime_r(&t, &tm);
   strftime(buf, len, "[%F %T]", &tm);
 }
 
+static const char* get_cached_date(time_t t) {
+  if (t != g_logger.date_time) {
+    get_date_time_string(t, g_logger.date, sizeof(g_logger.date));
+    g_logger.date_time = t;
+  }
+  return g_logger.date;
+}
+
 static void write_log_file_header(void) {
   char date_time[64];
-  get_date_time_string(date_time, sizeof(date_time));
-  fprintf(g_log_file,
+  get_date_time_string(time(NULL), date_time, sizeof(date_time));
+  fprintf(g_logger.file,
           "%1$s ####################################\n"
           "%1$s ######## gaybar is starting ########\n"
           "%1$s ####################################\n",
           date_time);
 }
 
+/* Generate log preamble: '[YYYY-MM-DD hh:mm:ss] [XXXXX]' */
+static size_t gen_preamble(enum log_level level, time_t t,
+                           char* buf, size_t len) {
+  static const char* type[] = {
+    [LOG_TRACE] = " [TRACE] ",
+    [LOG_INFO]  = " [INFO]  ",
+    [LOG_WARN]  = " [WARN]  ",
+    [LOG_ERROR] = " [ERROR] ",
+    [LOG_FATAL] = " [FATAL] "
+  };
+  return snprintf(buf, len, "%s%s", get_cached_date(t), type[level]);
+}
+
+/* Only called by the writer thread, or when there is no writer thread */
+static void write_record(struct log_record* record) {
+  size_t length;
+  char line[64 + LOG_RECORD_SIZE];
+
+  length = gen_preamble(record->level, record->time, line, sizeof(line));
+  memcpy(&line[length], record->text, record->length);
+  length += record->length;
+
+  if (g_logger.use_stderr)
+    fwrite(line, length, 1, stderr);
+  if (g_logger.file != NULL)
+    fwrite(line, length, 1, g_logger.file);
+}
+
+static void format_record(struct log_record* record, enum log_level level,
+                          const char* fmt, va_list ap) {
+  int length;
+
+  record->time = time(NULL);
+  record->level = level;
+
+  length = vsnprintf(record->text, sizeof(record->text), fmt, ap);
+  if (length < 0)
+    length = 0;
+  else if ((size_t)length >= sizeof(record->text)) {
+    length = sizeof(record->text) - 1;
+    memcpy(&record->text[length - STATIC_STRLEN(LOG_TRUNCATED)],
+           LOG_TRUNCATED, STATIC_STRLEN(LOG_TRUNCATED));
+  }
+  record->length = length;
+}
+
+static struct log_record* ring_claim(u64* position) {
+  i64 diff;
+  u64 pos, sequence;
+  struct log_record* record;
+
+  pos = __atomic_load_n(&g_ring.head, __ATOMIC_RELAXED);
+  for (;;) {
+    record = &g_ring.records[pos & (LOG_RING_SIZE - 1)];
+    sequence = __atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE);
+    diff = (i64)(sequence - pos);
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&g_ring.head, &pos, pos + 1, true,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        *position = pos;
+        return record;
+      }
+    } else if (diff < 0)
+      /* The ring is full */
+      return NULL;
+    else
+      pos = __atomic_load_n(&g_ring.head, __ATOMIC_RELAXED);
+  }
+}
+
+static void wake_writer(b8 force) {
+  u64 one = 1;
+  /* Sequentially consistent, pairs with the writer going idle */
+  if (__atomic_exchange_n(&g_logger.writer_idle, false, __ATOMIC_SEQ_CST)
+      || force)
+    UNUSED(write(g_logger.wake_fd, &one, sizeof(one)));
+}
+
+static void ring_publish(struct log_record* record, u64 position) {
+  __atomic_store_n(&record->sequence, position + 1, __ATOMIC_SEQ_CST);
+  wake_writer(false);
+}
+
+static b8 ring_is_readable(void) {
+  struct log_record* record;
+  record = &g_ring.records[g_ring.tail & (LOG_RING_SIZE - 1)];
+  return __atomic_load_n(&record->sequence, __ATOMIC_SEQ_CST)
+         == g_ring.tail + 1;
+}
+
+static void report_dropped(void) {
+  u64 dropped;
+  struct log_record record;
+
+  dropped = __atomic_load_n(&g_ring.dropped, __ATOMIC_RELAXED);
+  if (dropped == g_logger.dropped_reported)
+    return;
+
+  record.time = time(NULL);
+  record.level = LOG_WARN;
+  record.length = snprintf(record.text, sizeof(record.text),
+                           "log ring full, dropped %lu records\n",
+                           dropped - g_logger.dropped_reported);
+  write_record(&record);
+
+  g_logger.dropped_reported = dropped;
+}
+
+static void drain_ring(void) {
+  struct log_record* record;
+
+  while (ring_is_readable()) {
+    record = &g_ring.records[g_ring.tail & (LOG_RING_SIZE - 1)];
+    write_record(record);
+    /* Hand the record back to the producers, one lap later */
+    __atomic_store_n(&record->sequence, g_ring.tail + LOG_RING_SIZE,
+                     __ATOMIC_RELEASE);
+    ++g_ring.tail;
+  }
+
+  report_dropped();
+
+  if (g_logger.file != NULL)
+    fflush(g_logger.file);
+  __atomic_store_n(&g_ring.flushed, g_ring.tail, __ATOMIC_RELEASE);
+}
+
+static void* writer_main(void* arg) {
+  u64 value;
+
+  UNUSED(arg);
+
+  while (!__atomic_load_n(&g_logger.stop, __ATOMIC_ACQUIRE)) {
+    drain_ring();
+    /* Go idle, then check again: a producer either sees us idle and wakes
+     * us up, or we see its record here.
+     */
+    __atomic_store_n(&g_logger.writer_idle, true, __ATOMIC_SEQ_CST);
+    if (!ring_is_readable())
+      UNUSED(read(g_logger.wake_fd, &value, sizeof(value)));
+    __atomic_store_n(&g_logger.writer_idle, false, __ATOMIC_SEQ_CST);
+  }
+  drain_ring();
+
+  return NULL;
+}
+
+/* Waits until the record at position has been written out */
+static void wait_flushed(u64 position) {
+  size_t waited_ms;
+  const struct timespec interval = { .tv_sec = 0, .tv_nsec = 1000000L };
+
+  wake_writer(true);
+  for (waited_ms = 0; waited_ms < LOG_FLUSH_TIMEOUT_MS; ++waited_ms) {
+    if (__atomic_load_n(&g_ring.flushed, __ATOMIC_ACQUIRE) > position)
+      return;
+    nanosleep(&interval, NULL);
+  }
+}
+
+/* Claims a record once the writer made room for it, the ring being full.
+ * Returns NULL if the writer is stuck.
+ */
+static struct log_record* ring_claim_wait(u64* position) {
+  size_t waited_ms;
+  struct log_record* record;
+  const struct timespec interval = { .tv_sec = 0, .tv_nsec = 1000000L };
+
+  wake_writer(true);
+  for (waited_ms = 0; waited_ms < LOG_FLUSH_TIMEOUT_MS; ++waited_ms) {
+    record = ring_claim(position);
+    if (record != NULL)
+      return record;
+    nanosleep(&interval, NULL);
+  }
+  return NULL;
+}
+
+static void start_writer(void) {
+  int rc;
+  size_t i;
+
+  for (i = 0; i < LOG_RING_SIZE; ++i)
+    g_ring.records[i].sequence = i;
+
+  g_logger.wake_fd = eventfd(0, EFD_CLOEXEC);
+  if (g_logger.wake_fd < 0) {
+    log_error("could not create log eventfd, logging synchronously: %m");
+    return;
+  }
+
+  rc = thread_spawn(&g_logger.writer, writer_main, NULL);
+  if (rc != 0) {
+    close(g_logger.wake_fd);
+    g_logger.wake_fd = -1;
+    log_error("could not start log writer, logging synchronously: %s",
+              strerror(rc));
+    return;
+  }
+
+  __atomic_store_n(&g_logger.running, true, __ATOMIC_RELEASE);
+}
+
 void log_init(void) {
   set_log_level();
   {
-    g_use_stderr = isatty(STDERR_FILENO);
+    g_logger.use_stderr = isatty(STDERR_FILENO);
     setvbuf(stderr, NULL, _IONBF, 0);
   }
-  g_log_file = open_log_file(g_params.log_file);
-  if (g_log_file)
+  g_logger.file = open_log_file(g_params.log_file);
+  if (g_logger.file)
     write_log_file_header();
+  start_writer();
 }
 
 void log_cleanup(void) {
-  if (g_log_file)
-    fclose(g_log_file);
+  if (__atomic_load_n(&g_logger.running, __ATOMIC_ACQUIRE)) {
+    __atomic_store_n(&g_logger.running, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&g_logger.stop, true, __ATOMIC_RELEASE);
+    wake_writer(true);
+    pthread_join(g_logger.writer, NULL);
+    close(g_logger.wake_fd);
+    g_logger.wake_fd = -1;
+  }
+  if (g_logger.file)
+    fclose(g_logger.file);
+  g_logger.file = NULL;
 }
 
-/* Generate log preamble: '[YYYY-MM-DD hh:mm:ss] [XXXXX]' */
-static size_t gen_preamble(enum log_level level, char* buf, size_t len) {
-  static const char* type[] = {
-    [LOG_TRACE] = " [TRACE] ",
-    [LOG_INFO]  = " [INFO]  ",
-    [LOG_WARN]  = " [WARN]  ",
-    [LOG_ERROR] = " [ERROR] ",
-    [LOG_FATAL] = " [FATAL] "
-  };
-  get_date_time_string(buf, len);
-  strncat(buf, type[level], len);
-  return strlen(buf);
+static inline b8 should_log_synchronously(void) {
+  /* The writer thread itself (e.g. on a failed assertion) can't wait for
+   * the writer thread.
+   */
+  return !__atomic_load_n(&g_logger.running, __ATOMIC_ACQUIRE) ||
+         pthread_equal(pthread_self(), g_logger.writer);
 }
 
 void _log(enum log_level level, const char *fmt, ...) {
-  char pre[64];
-  size_t pre_len;
-  va_list ap_file, ap_stderr;
+  u64 position;
+  va_list ap;
+  struct log_record *record, sync_record;
 
   if (level > g_params.log_level)
     return;
 
-  va_start(ap_file, fmt);
-  va_copy(ap_stderr, ap_file);
+  va_start(ap, fmt);
 
-  pre_len = gen_preamble(level, pre, sizeof(pre));
+  if (should_log_synchronously()) {
+    format_record(&sync_record, level, fmt, ap);
+    write_record(&sync_record);
+    if (g_logger.file != NULL)
+      fflush(g_logger.file);
+    va_end(ap);
+    return;
+  }
 
-  /* Print to stderr */
-  if (g_use_stderr) {
-    fwrite(pre, pre_len, 1, stderr);
-    vfprintf(stderr, fmt, ap_stderr);
+  record = ring_claim(&position);
+  /* The writer owns the file, even a fatal error has to go through it */
+  if (record == NULL && level == LOG_FATAL)
+    record = ring_claim_wait(&position);
+  if (record == NULL)
+    __atomic_add_fetch(&g_ring.dropped, 1, __ATOMIC_RELAXED);
+  else {
+    format_record(record, level, fmt, ap);
+    ring_publish(record, position);
+    /* We're about to abort(..), make sure the message gets out */
+    if (level == LOG_FATAL)
+      wait_flushed(position);
   }
-  va_end(ap_stderr);
 
-  /* Print to log file */
-  if (g_log_file != NULL) {
-    fwrite(pre, pre_len, 1, g_log_file);
-    vfprintf(g_log_file, fmt, ap_file);
+  va_end(ap);
+}
+
+b8 _log_ratelimit(struct log_ratelimit* rl, enum log_level level) {
+  u32 suppressed;
+  u64 window, old;
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+  window = now.tv_sec;
+
+  old = __atomic_load_n(&rl->window, __ATOMIC_RELAXED);
+  /* Only one caller gets to start the new window */
+  if (old != window &&
+      __atomic_compare_exchange_n(&rl->window, &old, window, false,
+                                  __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    __atomic_store_n(&rl->count, 0, __ATOMIC_RELAXED);
+    suppressed = __atomic_exchange_n(&rl->suppressed, 0, __ATOMIC_RELAXED);
+    if (suppressed > 0)
+      _log(level, "suppressed %u similar messages\n", suppressed);
   }
-  va_end(ap_file);
+
+  if (__atomic_add_fetch(&rl->count, 1, __ATOMIC_RELAXED)
+      <= LOG_RATELIMIT_BURST)
+    return true;
+
+  __atomic_add_fetch(&rl->suppressed, 1, __ATOMIC_RELAXED);
+  return false;
 }
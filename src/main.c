@@ -2,6 +2,7 @@
 #include <gaybar/bar.h>
 #include <gaybar/log.h>
 #include <gaybar/config.h>
+#include <gaybar/trace.h>
 
 #include <stdbool.h>
 #include <stdio.h>
@@ -23,13 +24,16 @@ static void usage(const char* argv0) {
   eputs(" -L LEVEL    Set log level to LEVEL");
   eputs(" -f FILE     Set log file path to FILE");
   eputs(" -c FILE     Load configuration from FILE");
+  eputs(" -t FILE     Write a Chrome/Perfetto trace to FILE");
+  eputs("");
+  eputs("Send SIGUSR1 to dump timing statistics to the log (with -L3 or above).");
 }
 
 static int params_parse(int argc, char* argv[]) {
   int opt;
   char* endptr;
 
-  while ((opt = getopt(argc, argv, "hL:f:c:")) != -1) {
+  while ((opt = getopt(argc, argv, "hL:f:c:t:")) != -1) {
     switch (opt) {
       case 'h':
         usage(argv[0]);
@@ -45,6 +49,9 @@ static int params_parse(int argc, char* argv[]) {
       case 'c':
         g_params.config_file = strdup(optarg);
         break;
+      case 't':
+        g_params.trace_file = strdup(optarg);
+        break;
       case '?':
         if (isprint(optopt))
           eprintf("Unknown option '-%c'\n", optopt);
@@ -65,6 +72,8 @@ static void params_free(void) {
     free(g_params.log_file);
   if (g_params.config_file)
     free(g_params.config_file);
+  if (g_params.trace_file)
+    free(g_params.trace_file);
 }
 
 int main(int argc, char* argv[]) {
@@ -75,6 +84,7 @@ int main(int argc, char* argv[]) {
     goto args_fail;
 
   log_init();
+  trace_init();
   config_load();
 
   rc = bar_init();
@@ -86,6 +96,7 @@ int main(int argc, char* argv[]) {
 bar_fail:
   bar_cleanup();
   config_unload();
+  trace_cleanup();
   log_cleanup();
   params_free();
 args_fail:
@@ -1,36 +1,178 @@
 #include "gaybar/util.h"
 #include <gaybar/module.h>
 #include <gaybar/list.h>
+#include <gaybar/trace.h>
 
+#include <dlfcn.h>
+#include <limits.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef PLUGIN_DIR
+#define PLUGIN_DIR "/usr/local/lib/gaybar"
+#endif
+
+struct plugin {
+  struct list link;
+  void* handle;
+};
+
 struct module_instance {
+  struct list link;
   struct module* module;
   void* instance_data;
+  /* Set when the visible state changed since the instance was rendered */
+  b8 dirty;
 };
 
 struct list g_modules = LIST_UNINITIALIZED;
 
-struct module* module_find_by_name(const char* name) {
+static struct list g_instances = LIST_UNINITIALIZED;
+static struct list g_plugins = LIST_UNINITIALIZED;
+static char* g_plugin_dir;
+
+void module_register(struct module* module) {
+  ASSERT(module != NULL);
+
+  /* This runs from the constructor of a plugin, while it's being loaded */
+  if (module->abi_version != MODULE_ABI_VERSION) {
+    log_error("a module was built for ABI version %u, not %u",
+              module->abi_version, MODULE_ABI_VERSION);
+    return;
+  }
+
+  if (!list_is_initialized(&g_modules))
+    list_init(&g_modules);
+  list_insert(&g_modules, &module->link);
+}
+
+void module_unregister(struct module* module) {
+  ASSERT(module != NULL);
+
+  /* Rejected modules were never in the list */
+  if (module->abi_version != MODULE_ABI_VERSION ||
+      module->link.next == NULL)
+    return;
+
+  list_remove(&module->link);
+}
+
+static struct module* find_registered(const char* name, size_t length) {
   struct module* module;
+
+  if (!list_is_initialized(&g_modules))
+    return NULL;
+
   list_for_each(module, &g_modules, link) {
-    if (strncmp(module->name, name, strcspn(name, "#")) == 0)
+    if (strlen(module->name) == length &&
+        strncmp(module->name, name, length) == 0)
       return module;
   }
   return NULL;
 }
 
-static b8 parse_color_and_free(char* color_hex, struct color* out_color) {
-  b8 result = color_from_hex(color_hex, out_color);
-  free(color_hex);
-  return result;
+static const char* plugin_dir(void) {
+  const char* dir;
+
+  if (g_plugin_dir != NULL)
+    return g_plugin_dir;
+
+  CONFIG_PARSE(CONFIG_ROOT,
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("plugin_dir"),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(dir),
+      CONFIG_PARAM_DEFAULT(PLUGIN_DIR)
+    )
+  );
+
+  /* Plugins are loaded until the bar exits, the config may go before */
+  g_plugin_dir = strdup(dir);
+  ASSERT(g_plugin_dir != NULL);
+
+  return g_plugin_dir;
+}
+
+/* Maps <plugin_dir>/<name>.so, whose constructor registers the module */
+static struct module* load_plugin(const char* name, size_t length) {
+  int written;
+  void* handle;
+  char path[PATH_MAX];
+  struct plugin* plugin;
+  struct module* module;
+
+  /* The name must not lead out of the plugin directory */
+  if (memchr(name, '/', length) != NULL || (length > 0 && name[0] == '.'))
+    return NULL;
+
+  written = snprintf(path, sizeof(path), "%s/%.*s.so",
+                     plugin_dir(), (int)length, name);
+  if (written < 0 || (size_t)written >= sizeof(path))
+    return NULL;
+
+  /* A plugin is never unmapped, as threads it started may outlive its
+   * widgets. dlclose(..) only drops the reference.
+   */
+  handle = dlopen(path, RTLD_NOW | RTLD_LOCAL | RTLD_NODELETE);
+  if (handle == NULL) {
+    log_trace("could not load plugin: %s", dlerror());
+    return NULL;
+  }
+
+  module = find_registered(name, length);
+  if (module == NULL) {
+    log_error("plugin '%s' does not provide the module '%.*s'",
+              path, (int)length, name);
+    dlclose(handle);
+    return NULL;
+  }
+
+  plugin = zalloc(sizeof(*plugin));
+  ASSERT(plugin != NULL);
+
+  plugin->handle = handle;
+  if (!list_is_initialized(&g_plugins))
+    list_init(&g_plugins);
+  list_insert(&g_plugins, &plugin->link);
+
+  log_trace("loaded module '%s' from '%s'", module->name, path);
+  return module;
+}
+
+struct module* module_find_by_name(const char* name) {
+  size_t length;
+  struct module* module;
+
+  /* Widgets may be called 'module#tag', to tell instances apart */
+  length = strcspn(name, "#");
+
+  module = find_registered(name, length);
+  if (module == NULL)
+    module = load_plugin(name, length);
+
+  return module;
+}
+
+void module_unload_plugins(void) {
+  struct plugin *plugin, *next_plugin;
+
+  if (list_is_initialized(&g_plugins)) {
+    list_for_each_safe(plugin, next_plugin, &g_plugins, link) {
+      list_remove(&plugin->link);
+      dlclose(plugin->handle);
+      free(plugin);
+    }
+  }
+
+  free(g_plugin_dir);
+  g_plugin_dir = NULL;
 }
 
 static void get_colors_from_config(struct config_node* colors,
                                    struct color* background_color,
                                    struct color* foreground_color) {
-  char *foreground_color_hex, *background_color_hex;
+  const char *foreground_color_hex, *background_color_hex;
 
   CONFIG_PARSE(colors,
     CONFIG_PARAM(
@@ -48,11 +190,11 @@ static void get_colors_from_config(struct config_node* colors,
   );
 
   if (foreground_color_hex == NULL ||
-      !parse_color_and_free(foreground_color_hex, foreground_color))
+      !color_from_hex(foreground_color_hex, foreground_color))
     *foreground_color = bar_get_foreground_color();
 
   if (background_color_hex == NULL ||
-      !parse_color_and_free(background_color_hex, background_color))
+      !color_from_hex(background_color_hex, background_color))
     *background_color = bar_get_background_color();
 }
 
@@ -79,33 +221,91 @@ struct module_instance* module_init(struct module* module,
     get_colors_from_config(colors,
                            &init_data.background_color,
                            &init_data.foreground_color);
-    config_destroy_node(colors);
   }
 
-  instance_data = module->callbacks.init(&init_data);
-  if (instance_data == MODULE_INIT_FAIL)
-    return NULL;
-
   instance = zalloc(sizeof(*instance));
   ASSERT(instance != NULL);
 
-  instance->instance_data = instance_data;
   instance->module = module;
+  init_data.handle = instance;
+
+  /* The tasks scheduled by the module are accounted as its updates */
+  stats_set_current(&module->stats.update);
+  instance_data = module->callbacks.init(&init_data);
+  stats_set_current(NULL);
+  if (instance_data == MODULE_INIT_FAIL || instance_data == NULL) {
+    free(instance);
+    return NULL;
+  }
+
+  instance->instance_data = instance_data;
+
+  if (!list_is_initialized(&g_instances))
+    list_init(&g_instances);
+  list_insert(&g_instances, &instance->link);
+
+  /* The updates the module made while initializing went nowhere */
+  if (module->callbacks.update != NULL)
+    module->callbacks.update(instance_data);
+  instance->dirty = true;
 
   return instance;
 }
 
+void module_update(struct module_instance* instance) {
+  /* NULL for module data that module_init(..) didn't create. While the
+   * instance initializes, module_init(..) takes care of it.
+   */
+  if (instance == NULL || instance->instance_data == NULL)
+    return;
+
+  if (instance->module->callbacks.update == NULL ||
+      instance->module->callbacks.update(instance->instance_data))
+    instance->dirty = true;
+}
+
+void module_redraw(struct module_instance* instance) {
+  if (instance != NULL)
+    instance->dirty = true;
+}
+
+void module_render_dirty(void) {
+  struct module_instance* instance;
+
+  if (!list_is_initialized(&g_instances))
+    return;
+
+  list_for_each(instance, &g_instances, link) {
+    if (!instance->dirty)
+      continue;
+    instance->dirty = false;
+    module_render(instance);
+  }
+}
+
 void module_render(struct module_instance* instance) {
+  u64 start, end;
+  struct module* module;
+
   ASSERT(instance != NULL);
-  if (instance->module->callbacks.render == NULL)
+
+  module = instance->module;
+  if (module->callbacks.render == NULL) {
     log_warn("render requested for module %s, but it has no render method!",
-             instance->module->name);
-  else
-    instance->module->callbacks.render(instance->instance_data);
+             module->name);
+    return;
+  }
+
+  start = stats_now();
+  module->callbacks.render(instance->instance_data);
+  end = stats_now();
+  stats_record(&module->stats.render, start, end);
+  trace_span("module", module->name, TRACE_NO_ID, start, end);
 }
 
 void module_cleanup(struct module_instance* instance) {
   ASSERT(instance != NULL);
+  list_remove(&instance->link);
   if (instance->module->callbacks.cleanup != NULL)
     instance->module->callbacks.cleanup(instance->instance_data);
   free(instance);
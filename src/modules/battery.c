@@ -4,22 +4,44 @@
 #include <gaybar/draw.h>
 #include <gaybar/sched.h>
 #include <gaybar/font.h>
+#include <gaybar/stats.h>
 
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
 
 #define BATTERY_PATH "/sys/class/power_supply/%s/uevent"
 #define BATTERY_DEFAULT_NAME "BAT1"
+#define BATTERY_DEFAULT_AGGREGATE_LABEL "BAT"
 
-#define REFRESH_INTERVAL 1.0f /* In seconds */
+/* Maximum number of packs shown by a single instance */
+#define BATTERY_MAX_PACKS 4
+
+#define BATTERY_TEXT_SIZE 128
+
+/* With kernel uevents we only need to poll for the consumption samples */
+#define POLL_INTERVAL_MS      1000
+#define POLL_INTERVAL_PUSH_MS 30000
+
+#define UEVENT_GROUP_KERNEL 1
+#define UEVENT_SUBSYSTEM    "SUBSYSTEM=power_supply"
+#define UEVENT_NAME         "POWER_SUPPLY_NAME="
 
 #define PREFIX_CHARGE "POWER_SUPPLY_CHARGE_"
 #define PREFIX_ENERGY "POWER_SUPPLY_ENERGY_"
 
-#define AVG_SAMPLES 60
+#define ESTIMATOR_DEFAULT_MODE   "window"
+/* In seconds */
+#define ESTIMATOR_DEFAULT_WINDOW 60
+#define ESTIMATOR_MAX_WINDOW     3600
+
+/* Only redraw when the average consumption moves by at least this much */
+#define CONSUMPTION_THRESHOLD 10000 /* In µA or µW */
 
 enum acpi_mode {
   ACPI_MODE_UNKNOWN,
@@ -42,42 +64,156 @@ struct battery_info {
   u64 consumption_avg;
 };
 
-struct battery_samples {
-  size_t index;
-  u64 values[AVG_SAMPLES];
+enum estimator_mode {
+  ESTIMATOR_MODE_WINDOW,
+  ESTIMATOR_MODE_EWMA
+};
+
+/* A sample stands for the consumption since the one before it */
+struct battery_sample {
+  u64 value;
+  u64 elapsed_ms;
+};
+
+/* Estimates the average consumption over the last window seconds. Samples
+ * come at uneven times (on uevents, and at least every poll), so each one
+ * is weighted by the time it covers. Either the mean of the samples in the
+ * window (kept as running sums), or an exponentially weighted moving
+ * average with the same mean age. Both are O(1) per sample.
+ */
+struct battery_estimator {
+  enum estimator_mode mode;
+  u64 window_ms;
+  u64 last_ms;
+  /* The samples in the window, as a ring */
+  size_t capacity;
+  size_t first;
+  size_t count;
+  u64 elapsed_ms;
+  u64 sum;
+  struct battery_sample* samples;
+  f64 ewma;
+};
+
+struct battery_pack {
+  const char* name;
+  int uevent_fd;
+  struct battery_info info;
+  struct battery_estimator estimator;
 };
 
+/* An instance shows one or more packs, aggregated into info */
 struct battery_instance {
   struct list link;
-  char* name;
-  int uevent_fd;
+  const char* label;
+  b8 breakdown;
+  size_t packs_count;
+  struct battery_pack packs[BATTERY_MAX_PACKS];
   struct battery_info info;
-  struct battery_samples consumption_ring;
+  char text[BATTERY_TEXT_SIZE];
+  struct module_instance* handle;
   struct zone* zone;
   struct color bg_color;
   struct color fg_color;
 };
 
 static i64 g_task_id = -1;
+static int g_uevent_socket = -1;
 static struct list g_instances = LIST_UNINITIALIZED;
 
 MODULE("battery", "markx86", "Display battery information.");
 
-static void reset_consumption_ring(struct battery_instance* instance) {
-  struct battery_samples* ring = &instance->consumption_ring;
-  ring->index = 0;
-  memset(ring->values, 0xFF, sizeof(ring->values));
+static void estimator_init(struct battery_estimator* estimator,
+                           enum estimator_mode mode, size_t window) {
+  estimator->mode = mode;
+  estimator->window_ms = (u64)window * 1000;
+  estimator->count = 0;
+  if (mode == ESTIMATOR_MODE_WINDOW) {
+    /* Enough for a sample every second, more often the window gets shorter */
+    estimator->capacity = window + 1;
+    estimator->samples = zalloc(estimator->capacity *
+                                sizeof(*estimator->samples));
+    ASSERT(estimator->samples != NULL);
+  }
 }
 
-static void fill_consumption_ring(struct battery_instance* instance) {
-  u64 i;
-  struct battery_samples* ring = &instance->consumption_ring;
-  for (i = 0; i < ARRAY_LENGTH(ring->values); ++i)
-    ring->values[i] = ring->values[0];
+static void estimator_destroy(struct battery_estimator* estimator) {
+  free(estimator->samples);
+  estimator->samples = NULL;
 }
 
-static const char* battery_mode(struct battery_instance* instance) {
-  struct battery_info* info = &instance->info;
+static void estimator_reset(struct battery_estimator* estimator) {
+  estimator->first = 0;
+  estimator->count = 0;
+  estimator->elapsed_ms = 0;
+  estimator->sum = 0;
+  estimator->ewma = 0;
+}
+
+static void estimator_drop_oldest(struct battery_estimator* estimator) {
+  struct battery_sample* oldest = &estimator->samples[estimator->first];
+
+  estimator->elapsed_ms -= oldest->elapsed_ms;
+  estimator->sum -= oldest->value * oldest->elapsed_ms;
+  if (++estimator->first >= estimator->capacity)
+    estimator->first = 0;
+  --estimator->count;
+}
+
+/* Adds a sample taken at now_ms and returns the new average */
+static u64 estimator_add(struct battery_estimator* estimator,
+                         u64 sample, u64 now_ms) {
+  u64 elapsed_ms;
+  f64 alpha;
+  struct battery_sample* newest;
+
+  elapsed_ms = estimator->count > 0 ? now_ms - estimator->last_ms : 0;
+  estimator->last_ms = now_ms;
+
+  if (estimator->mode == ESTIMATOR_MODE_EWMA) {
+    if (estimator->count == 0) {
+      estimator->ewma = sample;
+      estimator->count = 1;
+    } else {
+      /* The average age of the samples is half the window */
+      alpha = (f64)elapsed_ms / (elapsed_ms + estimator->window_ms / 2);
+      estimator->ewma += alpha * ((f64)sample - estimator->ewma);
+    }
+    return estimator->ewma;
+  }
+
+  if (estimator->count == estimator->capacity)
+    estimator_drop_oldest(estimator);
+
+  newest = &estimator->samples[(estimator->first + estimator->count) %
+                               estimator->capacity];
+  newest->value = sample;
+  newest->elapsed_ms = elapsed_ms;
+  estimator->elapsed_ms += elapsed_ms;
+  estimator->sum += sample * elapsed_ms;
+  ++estimator->count;
+
+  /* Keep the oldest sample while the window needs it */
+  while (estimator->count > 1 &&
+         estimator->elapsed_ms - estimator->samples[estimator->first].elapsed_ms
+           >= estimator->window_ms)
+    estimator_drop_oldest(estimator);
+
+  return estimator->elapsed_ms > 0 ? estimator->sum / estimator->elapsed_ms
+                                   : sample;
+}
+
+static b8 parse_estimator_mode(enum estimator_mode* out, const char* s) {
+  if (!strcmp(s, "window"))
+    *out = ESTIMATOR_MODE_WINDOW;
+  else if (!strcmp(s, "ewma"))
+    *out = ESTIMATOR_MODE_EWMA;
+  else
+    return false;
+  return true;
+}
+
+static const char* battery_mode(struct battery_info* info) {
   if (info->mode == ACPI_MODE_CHARGE)
     return "charge";
   else if (info->mode == ACPI_MODE_ENERGY)
@@ -86,8 +222,7 @@ static const char* battery_mode(struct battery_instance* instance) {
     return "(unknown)";
 }
 
-static const char* battery_status(struct battery_instance* instance) {
-  struct battery_info* info = &instance->info;
+static const char* battery_status(struct battery_info* info) {
   if (info->status == BATTERY_STATUS_CHARGING)
     return "charging";
   else if (info->status == BATTERY_STATUS_DISCHARGING)
@@ -96,8 +231,7 @@ static const char* battery_status(struct battery_instance* instance) {
     return "(unknown)";
 }
 
-static char battery_unit(struct battery_instance* instance) {
-  struct battery_info* info = &instance->info;
+static char battery_unit(struct battery_info* info) {
   if (info->mode == ACPI_MODE_CHARGE)
     return 'A';
   else if (info->mode == ACPI_MODE_ENERGY)
@@ -106,17 +240,16 @@ static char battery_unit(struct battery_instance* instance) {
     return '?';
 }
 
-static int read_uevent_fd(int fd, char* buffer, size_t buffer_size) {
-  lseek(fd, 0, SEEK_SET);
-  return read(fd, buffer, buffer_size);
+static ssize_t read_uevent_fd(int fd, char* buffer, size_t buffer_size) {
+  return pread(fd, buffer, buffer_size, 0);
 }
 
 static enum acpi_mode determine_acpi_mode(const char* buffer,
-                                          size_t buffer_size) {
-  if (memmem(buffer, buffer_size,
+                                          size_t length) {
+  if (memmem(buffer, length,
              PREFIX_CHARGE, STATIC_STRLEN(PREFIX_CHARGE)))
     return ACPI_MODE_CHARGE;
-  else if (memmem(buffer, buffer_size,
+  else if (memmem(buffer, length,
                   PREFIX_ENERGY, STATIC_STRLEN(PREFIX_ENERGY)))
     return ACPI_MODE_ENERGY;
   else
@@ -124,62 +257,67 @@ static enum acpi_mode determine_acpi_mode(const char* buffer,
 }
 
 static enum acpi_mode get_acpi_mode(int uevent_fd) {
+  ssize_t length;
   char buffer[1024];
-  if (read_uevent_fd(uevent_fd, buffer, sizeof(buffer)) < 0)
+
+  length = read_uevent_fd(uevent_fd, buffer, sizeof(buffer));
+  if (length < 0)
     return ACPI_MODE_UNKNOWN;
   else
-    return determine_acpi_mode(buffer, sizeof(buffer));
+    return determine_acpi_mode(buffer, length);
 }
 
-static void parse_uevent_line(char* s, const char** key, const char** value) {
-  char *separator;
+/* Parses a decimal number that spans the whole value */
+static b8 parse_u64(u64* out, const char* value, size_t length) {
+  u64 parsed;
+  size_t i;
+
+  if (length == 0)
+    goto fail;
 
-  ASSERT(key != NULL);
-  ASSERT(value != NULL);
+  parsed = 0;
+  for (i = 0; i < length; ++i) {
+    if (value[i] < '0' || value[i] > '9')
+      goto fail;
+    parsed = parsed * 10 + (value[i] - '0');
+  }
 
-  if ((separator = strchr(s, '=')) == NULL)
-    /* Line is not in the format KEY=VALUE */
-    return;
-  *separator = '\0';
+  *out = parsed;
+  return true;
 
-  *key = s;
-  *value = separator + 1;
+fail:
+  module_error("could not parse %.*s as an unsigned integer",
+               (int)length, value);
+  return false;
 }
 
-static b8 parse_u64(u64* out, const char* value) {
-  b8 changed;
+static b8 update_u64(u64* out, const char* value, size_t length) {
   u64 parsed;
-  char* endptr;
-
-  endptr = NULL;
-  changed = false;
 
-  parsed = strtoul(value, &endptr, 0);
-
-  if (endptr == NULL || (endptr != value && *endptr != '\0')) {
-    module_error("could not parse %s as an unsigned integer", value);
-    goto out;
-  }
-
-  changed = *out != parsed;
-  if (changed)
-    *out = parsed;
+  if (!parse_u64(&parsed, value, length) || *out == parsed)
+    return false;
 
-out:
-  return changed;
+  *out = parsed;
+  return true;
 }
 
-static b8 parse_status(enum battery_status* out, const char* value) {
+static b8 update_status(enum battery_status* out,
+                        const char* value, size_t length) {
   b8 changed;
   enum battery_status parsed;
 
-  if (!strcmp(value, "Charging"))
+#define STATUS_IS(x) \
+  (length == STATIC_STRLEN(x) && !memcmp(value, x, STATIC_STRLEN(x)))
+
+  if (STATUS_IS("Charging"))
     parsed = BATTERY_STATUS_CHARGING;
-  else if (!strcmp(value, "Discharging"))
+  else if (STATUS_IS("Discharging"))
     parsed = BATTERY_STATUS_DISCHARGING;
   else
     parsed = BATTERY_STATUS_UNKNOWN;
 
+#undef STATUS_IS
+
   changed = *out != parsed;
   if (changed)
     *out = parsed;
@@ -187,109 +325,230 @@ static b8 parse_status(enum battery_status* out, const char* value) {
   return changed;
 }
 
-static b8 parse_consumption(struct battery_instance* instance,
-                            const char* value) {
-  b8 changed;
-  size_t i, count;
-  u64 avg, val;
-  struct battery_samples* ring = &instance->consumption_ring;
+static b8 update_consumption(struct battery_pack* pack,
+                             const char* value, size_t length) {
+  u64 avg, val, diff;
 
-  val = -1;
-  if (!parse_u64(&val, value))
+  /* Some drivers report a negative current while discharging */
+  if (length > 0 && value[0] == '-') {
+    ++value;
+    --length;
+  }
+
+  if (!parse_u64(&val, value, length))
     return false;
 
-  ring->values[ring->index++] = val;
-  if (ring->index >= ARRAY_LENGTH(ring->values))
-    ring->index = 0;
+  avg = estimator_add(&pack->estimator, val, stats_now() / 1000000);
 
-  avg = count = 0;
-  for (i = 0; i < ARRAY_LENGTH(ring->values); ++i) {
-    if ((val = ring->values[i]) != (u64)-1) {
-      avg += val;
-      ++count;
-    }
+  diff = avg > pack->info.consumption_avg
+           ? avg - pack->info.consumption_avg
+           : pack->info.consumption_avg - avg;
+  if (diff < CONSUMPTION_THRESHOLD)
+    return false;
+
+  pack->info.consumption_avg = avg;
+  return true;
+}
+
+enum battery_property {
+  PROPERTY_NONE,
+  PROPERTY_CAPACITY,
+  PROPERTY_STATUS,
+  PROPERTY_CAPACITY_MAX,
+  PROPERTY_CAPACITY_NOW,
+  PROPERTY_CONSUMPTION
+};
+
+struct property_key {
+  const char* name;
+  size_t length;
+  enum battery_property property;
+  /* ACPI_MODE_UNKNOWN if the property is valid in any mode */
+  enum acpi_mode mode;
+};
+
+#define PROPERTY_PREFIX "POWER_SUPPLY_"
+#define PROPERTY_KEYS_SIZE 16
+
+/* Perfect hash of the known keys, without the common prefix. The slots in
+ * g_property_keys must be updated if this function changes.
+ */
+static inline size_t property_key_hash(const char* key, size_t length) {
+  return (key[2] + key[length - 1] + length) & (PROPERTY_KEYS_SIZE - 1);
+}
+
+#define PROPERTY_KEY(slot, _name, _property, _mode) \
+  [slot] = {                                        \
+    .name = _name,                                  \
+    .length = STATIC_STRLEN(_name),                 \
+    .property = _property,                          \
+    .mode = _mode                                   \
   }
-  avg /= count;
 
-  changed = abs((int)(instance->info.consumption_avg - avg)) >= 10000;
-  if (changed)
-    instance->info.consumption_avg = avg;
+/* The list of all the possible properties can be found here:
+ * https://github.com/torvalds/linux/blob/master/drivers/acpi/battery.c
+ */
+static const struct property_key g_property_keys[PROPERTY_KEYS_SIZE] = {
+  PROPERTY_KEY(1,  "CAPACITY",    PROPERTY_CAPACITY,     ACPI_MODE_UNKNOWN),
+  PROPERTY_KEY(10, "STATUS",      PROPERTY_STATUS,       ACPI_MODE_UNKNOWN),
+  PROPERTY_KEY(8,  "CHARGE_FULL", PROPERTY_CAPACITY_MAX, ACPI_MODE_CHARGE),
+  PROPERTY_KEY(2,  "CHARGE_NOW",  PROPERTY_CAPACITY_NOW, ACPI_MODE_CHARGE),
+  PROPERTY_KEY(4,  "CURRENT_NOW", PROPERTY_CONSUMPTION,  ACPI_MODE_CHARGE),
+  PROPERTY_KEY(12, "ENERGY_FULL", PROPERTY_CAPACITY_MAX, ACPI_MODE_ENERGY),
+  PROPERTY_KEY(6,  "ENERGY_NOW",  PROPERTY_CAPACITY_NOW, ACPI_MODE_ENERGY),
+  PROPERTY_KEY(7,  "POWER_NOW",   PROPERTY_CONSUMPTION,  ACPI_MODE_ENERGY),
+};
 
-  return changed;
+static void check_property_keys(void) {
+  size_t i;
+  const struct property_key* entry;
+
+  for (i = 0; i < ARRAY_LENGTH(g_property_keys); ++i) {
+    entry = &g_property_keys[i];
+    if (entry->name != NULL)
+      ASSERT(property_key_hash(entry->name, entry->length) == i);
+  }
 }
 
-/* This function returns true if an element of g_battery was changed,
+static enum battery_property lookup_property(struct battery_pack* pack,
+                                             const char* key, size_t length) {
+  const struct property_key* entry;
+
+  if (length <= STATIC_STRLEN(PROPERTY_PREFIX) + 2 ||
+      memcmp(key, PROPERTY_PREFIX, STATIC_STRLEN(PROPERTY_PREFIX)))
+    return PROPERTY_NONE;
+  key += STATIC_STRLEN(PROPERTY_PREFIX);
+  length -= STATIC_STRLEN(PROPERTY_PREFIX);
+
+  entry = &g_property_keys[property_key_hash(key, length)];
+  if (entry->length != length || memcmp(entry->name, key, length))
+    return PROPERTY_NONE;
+  if (entry->mode != ACPI_MODE_UNKNOWN && entry->mode != pack->info.mode)
+    return PROPERTY_NONE;
+
+  return entry->property;
+}
+
+/* This function returns true if an element of pack->info was changed,
  * false otherwise.
  */
-static b8 handle_property(struct battery_instance* instance,
-                          const char* key, const char* value) {
+static b8 handle_property(struct battery_pack* pack,
+                          enum battery_property property,
+                          const char* value, size_t length) {
   b8 status_changed;
-  struct battery_info* info = &instance->info;
+  struct battery_info* info = &pack->info;
 
-  /* The list of all the possible properties can be found here:
-   * https://github.com/torvalds/linux/blob/master/drivers/acpi/battery.c
-   */
-
-  /* Generic specific properties */
-  if (!strcmp(key, "POWER_SUPPLY_CAPACITY"))
-    return parse_u64(&info->percentage, value);
-  else if (!strcmp(key, "POWER_SUPPLY_STATUS")) {
-    status_changed = parse_status(&info->status, value);
+  switch (property) {
+  case PROPERTY_CAPACITY:
+    return update_u64(&info->percentage, value, length);
+  case PROPERTY_STATUS:
+    status_changed = update_status(&info->status, value, length);
     if (status_changed)
-      reset_consumption_ring(instance);
+      estimator_reset(&pack->estimator);
     return status_changed;
-
-  /* ACPI mode specific properties */
-  } else if (info->mode == ACPI_MODE_CHARGE) {
-    if (!strcmp(key, PREFIX_CHARGE "FULL"))
-      return parse_u64(&info->capacity_max, value);
-    else if (!strcmp(key, PREFIX_CHARGE "NOW"))
-      return parse_u64(&info->capacity_now, value);
-    else if (!strcmp(key, "POWER_SUPPLY_CURRENT_NOW"))
-      return parse_consumption(instance, value);
-  } else if (info->mode == ACPI_MODE_ENERGY) {
-    if (!strcmp(key, PREFIX_ENERGY "FULL"))
-      return parse_u64(&info->capacity_max, value);
-    else if (!strcmp(key, PREFIX_ENERGY "NOW"))
-      return parse_u64(&info->capacity_now, value);
-    else if (!strcmp(key, "POWER_SUPPLY_POWER_NOW"))
-      return parse_consumption(instance, value);
+  case PROPERTY_CAPACITY_MAX:
+    return update_u64(&info->capacity_max, value, length);
+  case PROPERTY_CAPACITY_NOW:
+    return update_u64(&info->capacity_now, value, length);
+  case PROPERTY_CONSUMPTION:
+    return update_consumption(pack, value, length);
+  default:
+    return false;
   }
-
-  return false;
 }
 
-/* NOTE: This function modifies buffer */
-static b8 parse_uevent(struct battery_instance* instance,
-                       char* buffer, size_t buffer_size) {
-  size_t l;
-  char *s, *e;
-  const char *key, *value;
+/* Parses the KEY=VALUE lines in the first length bytes of buffer, in a
+ * single pass and without copying or modifying the buffer.
+ */
+static b8 parse_uevent(struct battery_pack* pack,
+                       const char* buffer, size_t length) {
   b8 changed;
+  const char *s, *e, *end, *separator;
+  enum battery_property property;
 
-  l = buffer_size;
   changed = false;
-  for (s = buffer; (e = memchr(s, '\n', l)) != NULL; s = e + 1) {
-    *e = '\0';
-    l -= (e - s) + 1;
-    parse_uevent_line(s, &key, &value);
-    changed |= handle_property(instance, key, value);
+  end = buffer + length;
+  for (s = buffer; s < end; s = e + 1) {
+    e = memchr(s, '\n', end - s);
+    if (e == NULL)
+      e = end;
+
+    separator = memchr(s, '=', e - s);
+    if (separator == NULL)
+      /* Line is not in the format KEY=VALUE */
+      continue;
+
+    property = lookup_property(pack, s, separator - s);
+    if (property != PROPERTY_NONE)
+      changed |= handle_property(pack, property,
+                                 separator + 1, e - (separator + 1));
   }
 
   return changed;
 }
 
-static void get_time_left(struct battery_instance* instance, i8* h, i8* m) {
-  f64 value;
+/* Combines the packs of an instance: capacities and consumptions add up,
+ * and the instance is charging or discharging if any of its packs is.
+ */
+static void aggregate_info(struct battery_instance* instance) {
+  size_t i;
+  u64 percentage_sum;
+  struct battery_pack* pack;
   struct battery_info* info = &instance->info;
 
+  if (instance->packs_count == 1) {
+    *info = instance->packs[0].info;
+    return;
+  }
+
+  info->status = BATTERY_STATUS_UNKNOWN;
+  info->capacity_max = info->capacity_now = info->consumption_avg = 0;
+  percentage_sum = 0;
+
+  for (i = 0; i < instance->packs_count; ++i) {
+    pack = &instance->packs[i];
+    info->capacity_max += pack->info.capacity_max;
+    info->capacity_now += pack->info.capacity_now;
+    info->consumption_avg += pack->info.consumption_avg;
+    percentage_sum += pack->info.percentage;
+
+    /* A pack being drained wins over one being charged */
+    if (pack->info.status == BATTERY_STATUS_DISCHARGING ||
+        (pack->info.status == BATTERY_STATUS_CHARGING &&
+         info->status == BATTERY_STATUS_UNKNOWN))
+      info->status = pack->info.status;
+  }
+
+  info->percentage = info->capacity_max > 0
+                       ? info->capacity_now * 100 / info->capacity_max
+                       : percentage_sum / instance->packs_count;
+}
+
+/* Time until the battery is empty while discharging, or until it is full
+ * while charging.
+ */
+static void get_time_left(struct battery_info* info, i8* h, i8* m) {
+  f64 value;
+  u64 capacity;
+
+  if (info->status == BATTERY_STATUS_CHARGING)
+    capacity = info->capacity_max > info->capacity_now
+                 ? info->capacity_max - info->capacity_now
+                 : 0;
+  else
+    capacity = info->capacity_now;
+
   if (info->consumption_avg == 0) {
     *h = *m = 0;
     return;
   }
 
-  /* Compute hours */
-  value = (double)info->capacity_now / info->consumption_avg;
+  /* Compute hours, the widget only has room for two digits */
+  value = (f64)capacity / info->consumption_avg;
+  if (value >= 100.0) {
+    *h = *m = 99;
+    return;
+  }
   *h = (i8)value;
 
   /* Compute minutes */
@@ -298,72 +557,139 @@ static void get_time_left(struct battery_instance* instance, i8* h, i8* m) {
 }
 
 static void get_formatted_text(char* buffer, size_t buffer_size,
-                               const char* battery_name,
+                               const char* label, b8 charging,
                                i8 hours, i8 minutes, u64 percentage) {
   size_t written;
   written = snprintf(buffer, buffer_size,
-                     "%s: %02hhd:%02hhd left\nLVL: %lu%%",
-                     battery_name, hours, minutes, percentage);
+                     "%s: %02hhd:%02hhd %s\nLVL: %lu%%",
+                     label, hours, minutes,
+                     charging ? "to full" : "left", percentage);
   ASSERT(written < buffer_size);
 }
 
+/* Appends ' (XX% YY%)' with the level of every pack */
+static void append_breakdown(char* buffer, size_t buffer_size,
+                             const u64* percentages, size_t count) {
+  size_t i, length;
+
+  length = strlen(buffer);
+  for (i = 0; i < count; ++i) {
+    length += snprintf(&buffer[length], buffer_size - length, "%s%lu%%%s",
+                       i == 0 ? " (" : " ", percentages[i],
+                       i == count - 1 ? ")" : "");
+    ASSERT(length < buffer_size);
+  }
+}
+
 static void generate_instance_text(struct battery_instance* instance,
                                    char* buffer, size_t buffer_size) {
+  size_t i;
   i8 hours, minutes;
-  get_time_left(instance, &hours, &minutes);
-  get_formatted_text(buffer, buffer_size,
-                     instance->name, hours, minutes, instance->info.percentage);
+  u64 percentages[BATTERY_MAX_PACKS];
+  struct battery_info* info = &instance->info;
+
+  get_time_left(info, &hours, &minutes);
+  get_formatted_text(buffer, buffer_size, instance->label,
+                     info->status == BATTERY_STATUS_CHARGING,
+                     hours, minutes, info->percentage);
+
+  if (instance->breakdown) {
+    for (i = 0; i < instance->packs_count; ++i)
+      percentages[i] = instance->packs[i].info.percentage;
+    append_breakdown(buffer, buffer_size, percentages, instance->packs_count);
+  }
 }
 
-static size_t compute_width(void) {
-  char buffer[128];
-  get_formatted_text(buffer, sizeof(buffer), BATTERY_DEFAULT_NAME, 99, 99, 100);
+static size_t compute_width(struct battery_instance* instance) {
+  size_t i;
+  char buffer[BATTERY_TEXT_SIZE];
+  u64 percentages[BATTERY_MAX_PACKS];
+
+  get_formatted_text(buffer, sizeof(buffer), instance->label, true,
+                     99, 99, 100);
+  if (instance->breakdown) {
+    for (i = 0; i < instance->packs_count; ++i)
+      percentages[i] = 100;
+    append_breakdown(buffer, sizeof(buffer),
+                     percentages, instance->packs_count);
+  }
+
   return font_string_width(buffer) + 8;
 }
 
-static void battery_render(void* instance_ptr) {
-  struct draw* draw;
-  char buffer[128];
+static b8 battery_update(void* instance_ptr) {
+  char buffer[BATTERY_TEXT_SIZE];
   struct battery_instance* instance = instance_ptr;
 
   generate_instance_text(instance, buffer, sizeof(buffer));
+  if (!strcmp(buffer, instance->text))
+    return false;
+
+  memcpy(instance->text, buffer, sizeof(buffer));
+  zone_resize(instance->zone, font_string_width(instance->text) + 8);
+  return true;
+}
+
+static void battery_render(void* instance_ptr) {
+  struct draw* draw;
+  struct battery_instance* instance = instance_ptr;
 
   draw_on_zone(instance->zone, draw) {
     draw_rect(draw,
               0, 0,
               draw_width(draw), draw_height(draw),
               instance->bg_color.as_u32);
-    draw_string(draw, 4, 0, buffer, instance->fg_color.as_u32);
+    draw_string(draw, 4, 0, instance->text, instance->fg_color.as_u32);
   }
 }
 
-static void trace_status(struct battery_instance* instance) {
+static void trace_status(struct battery_pack* pack) {
   char unit;
-  struct battery_info* info = &instance->info;
-
-  unit = battery_unit(instance);
-  module_trace("mode: %s", battery_mode(instance));
-  module_trace("status: %s", battery_status(instance));
-  module_trace("percentage: %lu%%", info->percentage);
-  module_trace("consumption: %lu µ%c", info->consumption_avg, unit);
-  module_trace("capacity_max: %lu µ%ch", info->capacity_max, unit);
-  module_trace("capacity_now: %lu µ%ch", info->capacity_now, unit);
+  struct battery_info* info = &pack->info;
+
+  unit = battery_unit(info);
+  module_trace("%s mode: %s", pack->name, battery_mode(info));
+  module_trace("%s status: %s", pack->name, battery_status(info));
+  module_trace("%s percentage: %lu%%", pack->name, info->percentage);
+  module_trace("%s consumption: %lu µ%c",
+               pack->name, info->consumption_avg, unit);
+  module_trace("%s capacity_max: %lu µ%ch",
+               pack->name, info->capacity_max, unit);
+  module_trace("%s capacity_now: %lu µ%ch",
+               pack->name, info->capacity_now, unit);
 }
 
-static void update_instance(struct battery_instance* instance) {
+/* Returns true if the information of the pack changed */
+static b8 update_pack(struct battery_pack* pack) {
   ssize_t rc;
   char buffer[1024];
 
-  rc = read_uevent_fd(instance->uevent_fd, buffer, sizeof(buffer));
+  rc = read_uevent_fd(pack->uevent_fd, buffer, sizeof(buffer));
   if (rc < 0) {
     module_error("could not read from uevent file '" BATTERY_PATH "': %m",
-                 instance->name);
-    return;
+                 pack->name);
+    return false;
   }
 
-  if (parse_uevent(instance, buffer, sizeof(buffer))) {
-    trace_status(instance);
-    battery_render(instance);
+  if (!parse_uevent(pack, buffer, rc))
+    return false;
+
+  trace_status(pack);
+  return true;
+}
+
+/* Reads every pack of the instance, and updates once if any changed */
+static void update_instance(struct battery_instance* instance) {
+  size_t i;
+  b8 changed;
+
+  changed = false;
+  for (i = 0; i < instance->packs_count; ++i)
+    changed |= update_pack(&instance->packs[i]);
+
+  if (changed) {
+    aggregate_info(instance);
+    module_update(instance->handle);
   }
 }
 
@@ -374,91 +700,350 @@ static void update_info(void) {
     update_instance(instance);
 }
 
+static struct battery_pack* find_pack(const char* name,
+                                      struct battery_instance** instance_out) {
+  size_t i;
+  struct battery_instance* instance;
+
+  list_for_each(instance, &g_instances, link) {
+    for (i = 0; i < instance->packs_count; ++i) {
+      if (!strcmp(instance->packs[i].name, name)) {
+        *instance_out = instance;
+        return &instance->packs[i];
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/* A kernel uevent is a header ('ACTION@DEVPATH') followed by KEY=VALUE
+ * properties, all NUL terminated. Returns the power supply name if the
+ * event is for a power supply, NULL otherwise.
+ */
+static const char* uevent_power_supply_name(const char* buffer, size_t length) {
+  b8 is_power_supply;
+  const char *s, *name;
+
+  name = NULL;
+  is_power_supply = false;
+  for (s = buffer; s < buffer + length; s += strlen(s) + 1) {
+    if (!strcmp(s, UEVENT_SUBSYSTEM))
+      is_power_supply = true;
+    else if (!strncmp(s, UEVENT_NAME, STATIC_STRLEN(UEVENT_NAME)))
+      name = s + STATIC_STRLEN(UEVENT_NAME);
+  }
+
+  return is_power_supply ? name : NULL;
+}
+
+static void handle_uevents(int fd, void* data) {
+  ssize_t length;
+  const char* name;
+  char buffer[4096];
+  socklen_t addr_length;
+  struct sockaddr_nl addr;
+  struct battery_pack* pack;
+  struct battery_instance* instance;
+
+  UNUSED(data);
+
+  for (;;) {
+    addr_length = sizeof(addr);
+    length = recvfrom(fd, buffer, sizeof(buffer) - 1, MSG_DONTWAIT,
+                      (struct sockaddr*)&addr, &addr_length);
+    if (length < 0)
+      break;
+    /* Only trust messages coming from the kernel */
+    if (addr.nl_pid != 0)
+      continue;
+    buffer[length] = '\0';
+
+    name = uevent_power_supply_name(buffer, length);
+    if (name == NULL || (pack = find_pack(name, &instance)) == NULL)
+      continue;
+
+    module_trace("got uevent for battery %s", name);
+    if (update_pack(pack)) {
+      aggregate_info(instance);
+      module_update(instance->handle);
+    }
+  }
+
+  /* The socket buffer overflowed and we lost some events, refresh everything */
+  if (errno == ENOBUFS) {
+    module_warn("uevent socket overrun, refreshing all batteries");
+    update_info();
+  }
+}
+
+static int open_uevent_socket(void) {
+  int fd;
+  struct sockaddr_nl addr = {
+    .nl_family = AF_NETLINK,
+    .nl_pid = 0,
+    .nl_groups = UEVENT_GROUP_KERNEL
+  };
+
+  fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+              NETLINK_KOBJECT_UEVENT);
+  if (fd < 0)
+    goto fail;
+
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    goto fail;
+
+  return fd;
+
+fail:
+  module_warn("could not open uevent socket, falling back to polling: %m");
+  if (fd >= 0)
+    close(fd);
+  return -1;
+}
+
+static void start_updates(void) {
+  size_t interval_ms;
+
+  g_uevent_socket = open_uevent_socket();
+  if (g_uevent_socket >= 0) {
+    sched_watch_fd(g_uevent_socket, handle_uevents, NULL);
+    interval_ms = POLL_INTERVAL_PUSH_MS;
+  } else
+    interval_ms = POLL_INTERVAL_MS;
+
+  g_task_id = sched_task_interval(update_info, interval_ms, true);
+}
+
+static void stop_updates(void) {
+  if (g_uevent_socket >= 0) {
+    sched_unwatch_fd(g_uevent_socket);
+    close(g_uevent_socket);
+    g_uevent_socket = -1;
+  }
+
+  if (g_task_id >= 0) {
+    sched_task_delete(g_task_id);
+    g_task_id = -1;
+  }
+}
+
 static void get_battery_path(char* buffer, size_t buffer_size,
                              const char* battery_name) {
   size_t written = snprintf(buffer, buffer_size, BATTERY_PATH, battery_name);
   ASSERT(written < buffer_size);
 }
 
-static void* battery_init(struct module_init_data* init_data) {
-  int rc, uevent_fd;
-  struct battery_instance* instance;
+static b8 pack_open(struct battery_pack* pack, const char* name,
+                    enum estimator_mode estimator_mode, size_t window) {
+  int uevent_fd;
   enum acpi_mode acpi_mode;
-  char* battery_name;
   char uevent_path[sizeof(BATTERY_PATH) * 2];
 
+  get_battery_path(uevent_path, sizeof(uevent_path), name);
+
+  uevent_fd = open(uevent_path, O_RDONLY | O_CLOEXEC);
+  if (uevent_fd < 0) {
+    module_error("could not open uevent file '%s': %m", uevent_path);
+    goto fail;
+  }
+
+  acpi_mode = get_acpi_mode(uevent_fd);
+  if (acpi_mode == ACPI_MODE_UNKNOWN) {
+    module_error("could not determine acpi mode of %s", name);
+    goto fail;
+  }
+
+  pack->name = name;
+  pack->uevent_fd = uevent_fd;
+  pack->info.mode = acpi_mode;
+  estimator_init(&pack->estimator, estimator_mode, window);
+
+  module_trace("detected acpi %s mode for %s", battery_mode(&pack->info), name);
+
+  return true;
+
+fail:
+  if (uevent_fd >= 0)
+    close(uevent_fd);
+  return false;
+}
+
+static void pack_close(struct battery_pack* pack) {
+  if (pack->uevent_fd >= 0)
+    close(pack->uevent_fd);
+  estimator_destroy(&pack->estimator);
+}
+
+/* The names of the batteries given in the config */
+struct pack_names {
+  size_t count;
+  const char* names[BATTERY_MAX_PACKS];
+};
+
+static void parse_pack_name(size_t index, struct config_node* node,
+                            void* data) {
+  struct pack_names* parsed = data;
+
+  if (index >= BATTERY_MAX_PACKS) {
+    module_warn("only %d batteries can be shown by one widget",
+                BATTERY_MAX_PACKS);
+    return;
+  }
+
+  CONFIG_PARSE(node,
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME(CONFIG_PARAM_SELF),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(parsed->names[index])
+    )
+  );
+  ASSERT(parsed->names[index] != NULL);
+
+  parsed->count = index + 1;
+}
+
+static void* battery_init(struct module_init_data* init_data) {
+  size_t i;
+  long window;
+  b8 breakdown;
+  struct zone_size zone_size;
+  struct pack_names parsed;
+  struct battery_instance* instance;
+  enum estimator_mode estimator_mode;
+  const char *battery_name, *label, *estimator_mode_name;
+
+  parsed.count = 0;
+
   CONFIG_PARSE(init_data->config,
     CONFIG_PARAM(
       CONFIG_PARAM_NAME("name"),
       CONFIG_PARAM_TYPE(STRING),
       CONFIG_PARAM_STORE(battery_name),
       CONFIG_PARAM_DEFAULT(BATTERY_DEFAULT_NAME)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("names"),
+      CONFIG_PARAM_TYPE(ARRAY),
+      CONFIG_PARAM_STORE(parse_pack_name),
+      CONFIG_PARAM_DATA(&parsed)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("label"),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(label),
+      CONFIG_PARAM_DEFAULT(NULL)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("breakdown"),
+      CONFIG_PARAM_TYPE(BOOL),
+      CONFIG_PARAM_STORE(breakdown),
+      CONFIG_PARAM_DEFAULT(false)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("estimator"),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(estimator_mode_name),
+      CONFIG_PARAM_DEFAULT(ESTIMATOR_DEFAULT_MODE)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("window"),
+      CONFIG_PARAM_TYPE(INTEGER),
+      CONFIG_PARAM_STORE(window),
+      CONFIG_PARAM_DEFAULT(ESTIMATOR_DEFAULT_WINDOW)
     )
   );
 
-  get_battery_path(uevent_path, sizeof(uevent_path), battery_name);
+  if (!parse_estimator_mode(&estimator_mode, estimator_mode_name)) {
+    module_error("invalid estimator '%s' (can be either 'window' or 'ewma')",
+                 estimator_mode_name);
+    estimator_mode = ESTIMATOR_MODE_WINDOW;
+  }
 
-  rc = uevent_fd = open(uevent_path, O_RDONLY);
-  if (rc < 0) {
-    module_error("could not open uevent file '%s': %m", uevent_path);
-    goto fail;
+  if (window < 1 || window > ESTIMATOR_MAX_WINDOW) {
+    module_error("window must be between 1 and %d seconds (got %ld)",
+                 ESTIMATOR_MAX_WINDOW, window);
+    window = ESTIMATOR_DEFAULT_WINDOW;
   }
 
-  acpi_mode = get_acpi_mode(uevent_fd);
-  if (acpi_mode == ACPI_MODE_UNKNOWN) {
-    module_error("could not determine acpi mode");
-    goto fail;
+  /* A list of names overrides the single name */
+  if (parsed.count == 0) {
+    parsed.names[0] = battery_name;
+    parsed.count = 1;
   }
 
+  if (label == NULL)
+    label = parsed.count > 1 ? BATTERY_DEFAULT_AGGREGATE_LABEL
+                             : parsed.names[0];
+
   instance = zalloc(sizeof(*instance));
   ASSERT(instance != NULL);
 
-  reset_consumption_ring(instance);
-  instance->name = battery_name;
-  instance->zone = bar_alloc_zone(init_data->position, compute_width());
-  instance->uevent_fd = uevent_fd;
-  instance->info.mode = acpi_mode;
+  instance->handle = init_data->handle;
+
+  instance->label = label;
+  instance->breakdown = breakdown && parsed.count > 1;
+
+  for (i = 0; i < parsed.count; ++i) {
+    if (!pack_open(&instance->packs[i], parsed.names[i],
+                   estimator_mode, window))
+      goto fail;
+    ++instance->packs_count;
+  }
+
+  for (i = 1; i < instance->packs_count; ++i) {
+    if (instance->packs[i].info.mode != instance->packs[0].info.mode) {
+      module_error("batteries %s and %s report in different acpi modes",
+                   instance->packs[0].name, instance->packs[i].name);
+      goto fail;
+    }
+  }
+
+  /* The zone fits the text, up to the widest it can get */
+  zone_size.min = zone_size.preferred = 8;
+  zone_size.max = compute_width(instance);
+  instance->zone = bar_alloc_resizable_zone(init_data->position, zone_size,
+                                            init_data->handle);
   instance->fg_color = init_data->foreground_color;
   instance->bg_color = init_data->background_color;
 
-  module_trace("detected acpi %s mode", battery_mode(instance));
-
-  if (!list_is_initialized(&g_instances))
+  if (!list_is_initialized(&g_instances)) {
+    check_property_keys();
     list_init(&g_instances);
+  }
   list_insert(&g_instances, &instance->link);
 
   if (g_task_id < 0)
-    g_task_id = sched_task_interval(update_info, 1000, true);
+    start_updates();
   else
     update_instance(instance);
 
-  fill_consumption_ring(instance);
-
   return instance;
 
 fail:
-  if (uevent_fd >= 0)
-    close(uevent_fd);
-  free(battery_name);
+  for (i = 0; i < instance->packs_count; ++i)
+    pack_close(&instance->packs[i]);
+  free(instance);
   return NULL;
 }
 
 static void battery_cleanup(void* instance_ptr) {
+  size_t i;
   struct battery_instance* instance = instance_ptr;
 
-  if (g_task_id >= 0 && list_length(&g_instances) == 1)
-    sched_task_delete(g_task_id);
+  if (list_length(&g_instances) == 1)
+    stop_updates();
 
-  if (instance->uevent_fd > 0)
-    close(instance->uevent_fd);
+  for (i = 0; i < instance->packs_count; ++i)
+    pack_close(&instance->packs[i]);
   if (instance->zone != NULL)
     bar_destroy_zone(&instance->zone);
 
   list_remove(&instance->link);
-  free(instance->name);
   free(instance);
 }
 
 MODULE_CALLBACKS(.init = battery_init,
+                 .update = battery_update,
                  .render = battery_render,
                  .cleanup = battery_cleanup);
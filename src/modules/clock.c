@@ -0,0 +1,346 @@
+#include <gaybar/module.h>
+#include <gaybar/bar.h>
+#include <gaybar/util.h>
+#include <gaybar/draw.h>
+#include <gaybar/sched.h>
+#include <gaybar/font.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CLOCK_DEFAULT_FORMAT "%H:%M"
+
+#define CLOCK_TEXT_SIZE 128
+
+/* Rendered up front, whatever the format */
+#define CLOCK_PRELOAD_GLYPHS "0123456789"
+
+/* Strip cells are only kept for printable ASCII */
+#define CLOCK_GLYPHS 128
+
+struct clock_glyph {
+  u32 offset; /* In pixels, in the strip */
+  u32 width;
+  b8 rendered;
+};
+
+/* Every character is rendered once, in its own cell of a strip that is
+ * zone height pixels tall. A frame is then composed by copying cells with
+ * draw_icon(..), instead of going through the font renderer.
+ */
+struct clock_strip {
+  u32* pixels;
+  size_t size; /* In pixels */
+  u32 height;
+  struct clock_glyph glyphs[CLOCK_GLYPHS];
+};
+
+struct clock_instance {
+  struct list link;
+  const char* format;
+  b8 seconds;
+  char text[CLOCK_TEXT_SIZE];
+  struct clock_strip strip;
+  struct module_instance* handle;
+  struct zone* zone;
+  struct color bg_color;
+  struct color fg_color;
+};
+
+static i64 g_task_id = -1;
+static size_t g_interval_ms;
+/* The time of the last tick, that every instance shows */
+static struct tm g_now;
+static struct list g_instances = LIST_UNINITIALIZED;
+
+MODULE("clock", "markx86", "Display the date and time.");
+
+static struct clock_glyph* strip_glyph(struct clock_instance* instance,
+                                       u8 c) {
+  size_t i;
+  u32 width, *cell;
+  char string[2];
+  struct clock_glyph* glyph;
+  struct clock_strip* strip = &instance->strip;
+
+  if (c >= CLOCK_GLYPHS || !isprint(c))
+    return NULL;
+
+  glyph = &strip->glyphs[c];
+  if (glyph->rendered)
+    return glyph;
+
+  string[0] = c;
+  string[1] = '\0';
+  width = font_string_width(string);
+
+  strip->pixels = realloc(strip->pixels, (strip->size + width * strip->height) *
+                                         sizeof(*strip->pixels));
+  ASSERT(strip->pixels != NULL);
+
+  cell = &strip->pixels[strip->size];
+  for (i = 0; i < width * strip->height; ++i)
+    cell[i] = instance->bg_color.as_u32;
+  font_string_render(string, false, instance->fg_color.as_u32, cell,
+                     width, strip->height, width);
+
+  glyph->offset = strip->size;
+  glyph->width = width;
+  glyph->rendered = true;
+  strip->size += width * strip->height;
+
+  return glyph;
+}
+
+static void strip_preload(struct clock_instance* instance, const char* chars) {
+  for (; *chars != '\0'; ++chars)
+    strip_glyph(instance, *chars);
+}
+
+/* Returns the width of text when composed from the strip, or 0 if some of
+ * its characters can't be (they're not ASCII, or a line break).
+ */
+static u32 strip_text_width(struct clock_instance* instance, const char* text) {
+  u32 width;
+  struct clock_glyph* glyph;
+
+  width = 0;
+  for (; *text != '\0'; ++text) {
+    glyph = strip_glyph(instance, *text);
+    if (glyph == NULL)
+      return 0;
+    width += glyph->width;
+  }
+
+  return width;
+}
+
+static void format_time(char* buffer, size_t buffer_size, const char* format,
+                        const struct tm* tm) {
+  if (strftime(buffer, buffer_size, format, tm) == 0)
+    buffer[0] = '\0';
+}
+
+static void get_local_time(struct tm* tm) {
+  time_t now;
+
+  now = time(NULL);
+  localtime_r(&now, tm);
+}
+
+/* True if the format shows seconds, which need a tick every second rather
+ * than every minute.
+ */
+static b8 format_has_seconds(const char* format) {
+  const char* s;
+
+  for (s = strchr(format, '%'); s != NULL; s = strchr(s + 2, '%')) {
+    /* Skip the E and O modifiers */
+    if (s[1] == 'E' || s[1] == 'O')
+      ++s;
+    if (s[1] == '\0')
+      break;
+    if (strchr("ScrsTX+", s[1]) != NULL)
+      return true;
+  }
+
+  return false;
+}
+
+/* The width is computed over every month and week day, at the time that
+ * gives the longest numbers. This also renders the names in the strip.
+ */
+static size_t compute_width(struct clock_instance* instance) {
+  u32 width, text_width;
+  size_t month, day;
+  char buffer[CLOCK_TEXT_SIZE];
+  struct tm tm = {
+    .tm_year = 2000 - 1900,
+    .tm_mday = 28,
+    .tm_hour = 23,
+    .tm_min = 59,
+    .tm_sec = 59
+  };
+
+  width = 0;
+  for (month = 0; month < 12; ++month) {
+    for (day = 0; day < 7; ++day) {
+      tm.tm_mon = month;
+      tm.tm_wday = day;
+      tm.tm_yday = 300 + day;
+      format_time(buffer, sizeof(buffer), instance->format, &tm);
+
+      text_width = strip_text_width(instance, buffer);
+      if (text_width == 0)
+        text_width = font_string_width(buffer);
+      width = max(width, text_width);
+    }
+  }
+
+  return width + 8;
+}
+
+static void clock_render(void* instance_ptr) {
+  u32 x, height;
+  const char* s;
+  struct draw* draw;
+  struct clock_glyph* glyph;
+  struct clock_instance* instance = instance_ptr;
+
+  height = instance->strip.height;
+
+  /* A character that isn't in the strip, draw the text the slow way */
+  if (strip_text_width(instance, instance->text) == 0 &&
+      instance->text[0] != '\0') {
+    draw_on_zone(instance->zone, draw) {
+      draw_rect(draw,
+                0, 0,
+                draw_width(draw), draw_height(draw),
+                instance->bg_color.as_u32);
+      draw_string(draw, 4, 0, instance->text, instance->fg_color.as_u32);
+    }
+    return;
+  }
+
+  draw_on_zone(instance->zone, draw) {
+    draw_rect(draw, 0, 0, 4, height, instance->bg_color.as_u32);
+
+    x = 4;
+    for (s = instance->text; *s != '\0'; ++s) {
+      glyph = &instance->strip.glyphs[(u8)*s];
+      draw_icon(draw, x, 0, glyph->width, height,
+                &instance->strip.pixels[glyph->offset]);
+      x += glyph->width;
+    }
+
+    /* Clear what's left of a longer text */
+    if (x < draw_width(draw))
+      draw_rect(draw, x, 0, draw_width(draw) - x, height,
+                instance->bg_color.as_u32);
+  }
+}
+
+static b8 clock_update(void* instance_ptr) {
+  char buffer[CLOCK_TEXT_SIZE];
+  struct clock_instance* instance = instance_ptr;
+
+  format_time(buffer, sizeof(buffer), instance->format, &g_now);
+  if (!strcmp(buffer, instance->text))
+    return false;
+
+  memcpy(instance->text, buffer, sizeof(buffer));
+  return true;
+}
+
+/* Milliseconds until the next multiple of interval_ms of the wall clock,
+ * plus one so that the task never runs just before the boundary.
+ */
+static size_t delay_to_boundary(size_t interval_ms) {
+  u64 now_ms;
+  struct timespec ts;
+
+  ASSERT(clock_gettime(CLOCK_REALTIME, &ts) == 0);
+  now_ms = (u64)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+
+  return interval_ms - now_ms % interval_ms + 1;
+}
+
+static void tick(void);
+
+static void schedule_tick(void) {
+  g_task_id = sched_task_delayed(tick, delay_to_boundary(g_interval_ms));
+}
+
+static void tick(void) {
+  struct clock_instance* instance;
+
+  get_local_time(&g_now);
+
+  list_for_each(instance, &g_instances, link)
+    module_update(instance->handle);
+
+  schedule_tick();
+}
+
+static void update_interval(void) {
+  size_t interval_ms;
+  struct clock_instance* instance;
+
+  interval_ms = 60 * 1000;
+  list_for_each(instance, &g_instances, link) {
+    if (instance->seconds)
+      interval_ms = 1000;
+  }
+
+  if (g_task_id >= 0 && interval_ms == g_interval_ms)
+    return;
+
+  if (g_task_id >= 0)
+    sched_task_delete(g_task_id);
+  g_interval_ms = interval_ms;
+  schedule_tick();
+}
+
+static void* clock_init(struct module_init_data* init_data) {
+  const char* format;
+  struct clock_instance* instance;
+
+  CONFIG_PARSE(init_data->config,
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("format"),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(format),
+      CONFIG_PARAM_DEFAULT(CLOCK_DEFAULT_FORMAT)
+    )
+  );
+
+  instance = zalloc(sizeof(*instance));
+  ASSERT(instance != NULL);
+
+  instance->handle = init_data->handle;
+
+  instance->format = format;
+  instance->seconds = format_has_seconds(format);
+  instance->fg_color = init_data->foreground_color;
+  instance->bg_color = init_data->background_color;
+
+  instance->strip.height = bar_get_thickness();
+  strip_preload(instance, CLOCK_PRELOAD_GLYPHS);
+  instance->zone = bar_alloc_zone(init_data->position, compute_width(instance));
+
+  if (!list_is_initialized(&g_instances))
+    list_init(&g_instances);
+  list_insert(&g_instances, &instance->link);
+
+  update_interval();
+  get_local_time(&g_now);
+
+  return instance;
+}
+
+static void clock_cleanup(void* instance_ptr) {
+  struct clock_instance* instance = instance_ptr;
+
+  list_remove(&instance->link);
+
+  if (list_empty(&g_instances)) {
+    if (g_task_id >= 0)
+      sched_task_delete(g_task_id);
+    g_task_id = -1;
+  } else
+    update_interval();
+
+  if (instance->zone != NULL)
+    bar_destroy_zone(&instance->zone);
+
+  free(instance->strip.pixels);
+  free(instance);
+}
+
+MODULE_CALLBACKS(.init = clock_init,
+                 .update = clock_update,
+                 .render = clock_render,
+                 .cleanup = clock_cleanup);
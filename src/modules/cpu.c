@@ -0,0 +1,371 @@
+#include <gaybar/module.h>
+#include <gaybar/bar.h>
+#include <gaybar/util.h>
+#include <gaybar/draw.h>
+#include <gaybar/sched.h>
+#include <gaybar/font.h>
+#include <gaybar/parse.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define STAT_PATH "/proc/stat"
+
+#define REFRESH_INTERVAL_MS 1000
+
+/* Upper bound for the length of a 'cpuN ...' line of /proc/stat */
+#define STAT_LINE_SIZE 256
+
+#define HISTORY_DEFAULT_LENGTH 10
+#define HISTORY_MAX_LENGTH     256
+
+#define SPARKLINE_GAP 2 /* In pixels, between the sparklines of two cores */
+
+/* The jiffies columns of a 'cpu' line, in order */
+enum cpu_jiffies {
+  JIFFIES_USER,
+  JIFFIES_NICE,
+  JIFFIES_SYSTEM,
+  JIFFIES_IDLE,
+  JIFFIES_IOWAIT,
+  JIFFIES_IRQ,
+  JIFFIES_SOFTIRQ,
+  JIFFIES_STEAL,
+  /* guest and guest_nice are already accounted in user and nice */
+  JIFFIES_COUNT
+};
+
+struct cpu_times {
+  u64 total;
+  u64 idle;
+};
+
+/* Shared by every instance: /proc/stat is read once per tick */
+struct cpu_sampler {
+  int stat_fd;
+  char* buffer;
+  size_t buffer_size;
+  /* Index 0 is the aggregate of all the cores, index n + 1 is core n */
+  size_t count;
+  struct cpu_times* times;
+  u8* usage;
+};
+
+struct cpu_instance {
+  struct list link;
+  b8 per_core;
+  u32 text_width;
+  size_t sparklines;
+  /* Ring of usages, history_length per sparkline */
+  u8* history;
+  size_t history_length;
+  size_t history_index;
+  struct module_instance* handle;
+  struct zone* zone;
+  struct color bg_color;
+  struct color fg_color;
+};
+
+static i64 g_task_id = -1;
+static struct cpu_sampler g_sampler = { .stat_fd = -1 };
+static struct list g_instances = LIST_UNINITIALIZED;
+
+MODULE("cpu", "markx86", "Display CPU usage.");
+
+/* Parses the rest of a 'cpu' or 'cpuN' line, after the 'cpu' prefix.
+ * Returns the index in the sampler, or -1 if the line is not valid.
+ */
+static i64 parse_cpu_line(const char** sp, struct cpu_times* times) {
+  size_t i;
+  i64 index;
+  const char* s;
+  u64 value, jiffies[JIFFIES_COUNT];
+
+  s = *sp;
+  if (*s == ' ')
+    index = 0;
+  else if ((s = parse_u64(s, &value)) != NULL)
+    index = value + 1;
+  else
+    return -1;
+
+  for (i = 0; i < JIFFIES_COUNT; ++i) {
+    if ((s = parse_u64(s, &jiffies[i])) == NULL)
+      return -1;
+  }
+  *sp = s;
+
+  times->idle = jiffies[JIFFIES_IDLE] + jiffies[JIFFIES_IOWAIT];
+  times->total = 0;
+  for (i = 0; i < JIFFIES_COUNT; ++i)
+    times->total += jiffies[i];
+
+  return index;
+}
+
+static u8 compute_usage(struct cpu_times* prev, struct cpu_times* now) {
+  u64 total, idle;
+
+  /* Counters can go backwards when a core goes offline */
+  if (now->total <= prev->total || now->idle < prev->idle)
+    return 0;
+
+  total = now->total - prev->total;
+  idle = min(now->idle - prev->idle, total);
+
+  return (total - idle) * 100 / total;
+}
+
+/* Updates the usage of every core from the 'cpu' lines at the start of
+ * buffer, which must be NUL terminated. Stops at the first line that isn't
+ * about a cpu.
+ */
+static void parse_stat(struct cpu_sampler* sampler, const char* buffer) {
+  i64 index;
+  const char *s, *e;
+  struct cpu_times times;
+
+  for (s = buffer; !strncmp(s, "cpu", 3); s = e + 1) {
+    e = s + 3;
+    index = parse_cpu_line(&e, &times);
+    if (index >= 0 && (size_t)index < sampler->count) {
+      sampler->usage[index] = compute_usage(&sampler->times[index], &times);
+      sampler->times[index] = times;
+    }
+
+    /* Skip the columns we don't care about */
+    e = strchr(e, '\n');
+    /* The last line was cut short */
+    if (e == NULL)
+      break;
+  }
+}
+
+static b8 sample(struct cpu_sampler* sampler) {
+  ssize_t length;
+
+  length = pread(sampler->stat_fd, sampler->buffer,
+                 sampler->buffer_size - 1, 0);
+  if (length < 0) {
+    module_error("could not read from '" STAT_PATH "': %m");
+    return false;
+  }
+  sampler->buffer[length] = '\0';
+
+  parse_stat(sampler, sampler->buffer);
+  return true;
+}
+
+static b8 sampler_open(struct cpu_sampler* sampler) {
+  long cores;
+
+  cores = sysconf(_SC_NPROCESSORS_CONF);
+  if (cores < 1)
+    cores = 1;
+
+  sampler->stat_fd = open(STAT_PATH, O_RDONLY | O_CLOEXEC);
+  if (sampler->stat_fd < 0) {
+    module_error("could not open '" STAT_PATH "': %m");
+    return false;
+  }
+
+  sampler->count = cores + 1;
+  sampler->buffer_size = sampler->count * STAT_LINE_SIZE;
+  sampler->buffer = malloc(sampler->buffer_size);
+  sampler->times = zalloc(sampler->count * sizeof(*sampler->times));
+  sampler->usage = zalloc(sampler->count * sizeof(*sampler->usage));
+  ASSERT(sampler->buffer != NULL);
+  ASSERT(sampler->times != NULL);
+  ASSERT(sampler->usage != NULL);
+
+  module_trace("sampling %zu cores", sampler->count - 1);
+
+  /* Prime the counters, so that the first tick has something to diff */
+  sample(sampler);
+  memset(sampler->usage, 0, sampler->count * sizeof(*sampler->usage));
+
+  return true;
+}
+
+static void sampler_close(struct cpu_sampler* sampler) {
+  if (sampler->stat_fd >= 0)
+    close(sampler->stat_fd);
+  sampler->stat_fd = -1;
+
+  free(sampler->buffer);
+  free(sampler->times);
+  free(sampler->usage);
+  sampler->buffer = NULL;
+  sampler->times = NULL;
+  sampler->usage = NULL;
+}
+
+static void get_formatted_text(char* buffer, size_t buffer_size, u8 usage) {
+  size_t written;
+  written = snprintf(buffer, buffer_size, "CPU: %hhu%%", usage);
+  ASSERT(written < buffer_size);
+}
+
+static size_t text_width(void) {
+  char buffer[32];
+  get_formatted_text(buffer, sizeof(buffer), 100);
+  return font_string_width(buffer) + 8;
+}
+
+static size_t compute_width(struct cpu_instance* instance) {
+  return instance->text_width +
+         instance->sparklines * (instance->history_length + SPARKLINE_GAP);
+}
+
+static void draw_sparkline(struct cpu_instance* instance, struct draw* draw,
+                           u32 x, size_t sparkline) {
+  size_t i, index;
+  u32 height, column;
+  u8* history;
+
+  history = &instance->history[sparkline * instance->history_length];
+  height = draw_height(draw);
+
+  /* Oldest sample on the left */
+  index = instance->history_index;
+  for (i = 0; i < instance->history_length; ++i) {
+    column = (history[index] * height + 99) / 100;
+    if (column > 0)
+      draw_rect(draw, x + i, height - column, 1, column,
+                instance->fg_color.as_u32);
+    if (++index >= instance->history_length)
+      index = 0;
+  }
+}
+
+static void cpu_render(void* instance_ptr) {
+  size_t i;
+  u32 x;
+  struct draw* draw;
+  char buffer[32];
+  struct cpu_instance* instance = instance_ptr;
+
+  get_formatted_text(buffer, sizeof(buffer), g_sampler.usage[0]);
+
+  draw_on_zone(instance->zone, draw) {
+    draw_rect(draw,
+              0, 0,
+              draw_width(draw), draw_height(draw),
+              instance->bg_color.as_u32);
+    draw_string(draw, 4, 0, buffer, instance->fg_color.as_u32);
+
+    x = instance->text_width;
+    for (i = 0; i < instance->sparklines; ++i) {
+      draw_sparkline(instance, draw, x, i);
+      x += instance->history_length + SPARKLINE_GAP;
+    }
+  }
+}
+
+static void push_history(struct cpu_instance* instance) {
+  size_t i, first;
+
+  /* Without the per core view, the only sparkline is the aggregate */
+  first = instance->per_core ? 1 : 0;
+  for (i = 0; i < instance->sparklines; ++i)
+    instance->history[i * instance->history_length + instance->history_index] =
+      g_sampler.usage[first + i];
+
+  if (++instance->history_index >= instance->history_length)
+    instance->history_index = 0;
+}
+
+static void update_info(void) {
+  struct cpu_instance* instance;
+
+  if (!sample(&g_sampler))
+    return;
+
+  /* The sparklines scroll with every sample, there's always something new
+   * to draw.
+   */
+  list_for_each(instance, &g_instances, link) {
+    push_history(instance);
+    module_update(instance->handle);
+  }
+}
+
+static void* cpu_init(struct module_init_data* init_data) {
+  long history_length;
+  b8 per_core;
+  struct cpu_instance* instance;
+
+  CONFIG_PARSE(init_data->config,
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("per_core"),
+      CONFIG_PARAM_TYPE(BOOL),
+      CONFIG_PARAM_STORE(per_core),
+      CONFIG_PARAM_DEFAULT(true)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("history"),
+      CONFIG_PARAM_TYPE(INTEGER),
+      CONFIG_PARAM_STORE(history_length),
+      CONFIG_PARAM_DEFAULT(HISTORY_DEFAULT_LENGTH)
+    )
+  );
+
+  if (history_length < 1 || history_length > HISTORY_MAX_LENGTH) {
+    module_error("history must be between 1 and %d samples (got %ld)",
+                 HISTORY_MAX_LENGTH, history_length);
+    history_length = HISTORY_DEFAULT_LENGTH;
+  }
+
+  if (g_sampler.stat_fd < 0 && !sampler_open(&g_sampler))
+    return NULL;
+
+  instance = zalloc(sizeof(*instance));
+  ASSERT(instance != NULL);
+
+  instance->handle = init_data->handle;
+
+  instance->per_core = per_core;
+  instance->text_width = text_width();
+  instance->sparklines = per_core ? g_sampler.count - 1 : 1;
+  instance->history_length = history_length;
+  instance->history = zalloc(instance->sparklines * history_length);
+  ASSERT(instance->history != NULL);
+
+  instance->zone = bar_alloc_zone(init_data->position, compute_width(instance));
+  instance->fg_color = init_data->foreground_color;
+  instance->bg_color = init_data->background_color;
+
+  if (!list_is_initialized(&g_instances))
+    list_init(&g_instances);
+  list_insert(&g_instances, &instance->link);
+
+  if (g_task_id < 0)
+    g_task_id = sched_task_interval(update_info, REFRESH_INTERVAL_MS, false);
+
+  return instance;
+}
+
+static void cpu_cleanup(void* instance_ptr) {
+  struct cpu_instance* instance = instance_ptr;
+
+  if (list_length(&g_instances) == 1) {
+    if (g_task_id >= 0)
+      sched_task_delete(g_task_id);
+    g_task_id = -1;
+    sampler_close(&g_sampler);
+  }
+
+  if (instance->zone != NULL)
+    bar_destroy_zone(&instance->zone);
+
+  list_remove(&instance->link);
+  free(instance->history);
+  free(instance);
+}
+
+MODULE_CALLBACKS(.init = cpu_init,
+                 .render = cpu_render,
+                 .cleanup = cpu_cleanup);
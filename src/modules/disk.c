@@ -0,0 +1,564 @@
+#include <gaybar/module.h>
+#include <gaybar/bar.h>
+#include <gaybar/util.h>
+#include <gaybar/draw.h>
+#include <gaybar/sched.h>
+#include <gaybar/font.h>
+#include <gaybar/format.h>
+#include <gaybar/parse.h>
+#include <gaybar/stats.h>
+#include <gaybar/thread.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/statvfs.h>
+
+#define DISKSTATS_PATH "/proc/diskstats"
+
+#define REFRESH_INTERVAL_MS 1000
+
+#define DISK_DEFAULT_MOUNT      "/"
+#define DISK_DEFAULT_TIMEOUT_MS 2000
+#define DISK_DEFAULT_FORMAT     "{mount}: {free}/{total}G"
+#define DISK_DEFAULT_FORMAT_IO  "{mount}: {free}G R {read} W {write}"
+
+#define DISK_TEXT_SIZE 256
+
+/* /proc/diskstats always counts 512 bytes sectors, whatever the device */
+#define SECTOR_SIZE 512
+
+#define BYTES_PER_GB (1024.0 * 1024.0 * 1024.0)
+
+/* Filesystems up to this size fit in the zone */
+#define DISK_WIDTH_TOTAL (9999ULL * 1024 * 1024 * 1024)
+
+struct disk_usage {
+  u64 total; /* In bytes */
+  u64 free;
+  u64 available;
+};
+
+/* A mount point whose statvfs(..) runs on its own thread, so that a hung
+ * network filesystem only ever stalls that thread. The thread is detached,
+ * as it can't be joined while stuck in the kernel: whoever of the instance
+ * and the thread lets go of the mount last frees it.
+ */
+struct disk_mount {
+  char* path;
+  u32 refs;
+  b8 quit;
+  b8 busy;
+  int request_fd; /* Wakes up the thread */
+  int done_fd;    /* Wakes up the main loop */
+  u64 requested_ns;
+  pthread_mutex_t lock;
+  /* Written by the thread, under lock */
+  struct disk_usage result;
+  int error;
+};
+
+struct disk_io {
+  u64 read_sectors;
+  u64 write_sectors;
+  u64 read_rate; /* In bytes per second */
+  u64 write_rate;
+  u64 sampled_ns;
+  b8 has_stats;
+};
+
+struct disk_instance {
+  struct list link;
+  const char* device; /* NULL if I/O is not displayed */
+  const char* format;
+  u64 timeout_ns;
+  struct disk_mount* mount;
+  /* Cached between ticks, the render never waits for the thread */
+  b8 timed_out;
+  struct disk_usage usage;
+  struct disk_io io;
+  char text[DISK_TEXT_SIZE];
+  struct module_instance* handle;
+  struct zone* zone;
+  struct color bg_color;
+  struct color fg_color;
+};
+
+struct diskstats {
+  int fd;
+  char* buffer;
+  size_t buffer_size;
+};
+
+static i64 g_task_id = -1;
+static struct diskstats g_diskstats = { .fd = -1 };
+static struct list g_instances = LIST_UNINITIALIZED;
+
+MODULE("disk", "markx86", "Display disk usage and throughput.");
+
+static void mount_release(struct disk_mount* mount) {
+  if (__atomic_sub_fetch(&mount->refs, 1, __ATOMIC_ACQ_REL) > 0)
+    return;
+
+  close(mount->request_fd);
+  close(mount->done_fd);
+  pthread_mutex_destroy(&mount->lock);
+  free(mount->path);
+  free(mount);
+}
+
+static void* mount_main(void* arg) {
+  int error;
+  u64 value;
+  struct statvfs st;
+  struct disk_usage usage;
+  struct disk_mount* mount = arg;
+
+  for (;;) {
+    if (read(mount->request_fd, &value, sizeof(value)) < 0 && errno != EINTR)
+      break;
+    if (__atomic_load_n(&mount->quit, __ATOMIC_ACQUIRE))
+      break;
+
+    /* This is the call that can block for as long as the server is gone */
+    error = statvfs(mount->path, &st) < 0 ? errno : 0;
+    if (error == 0) {
+      usage.total = (u64)st.f_blocks * st.f_frsize;
+      usage.free = (u64)st.f_bfree * st.f_frsize;
+      usage.available = (u64)st.f_bavail * st.f_frsize;
+    }
+
+    pthread_mutex_lock(&mount->lock);
+    mount->error = error;
+    if (error == 0)
+      mount->result = usage;
+    pthread_mutex_unlock(&mount->lock);
+
+    __atomic_store_n(&mount->busy, false, __ATOMIC_RELEASE);
+    value = 1;
+    UNUSED(write(mount->done_fd, &value, sizeof(value)));
+  }
+
+  mount_release(mount);
+  return NULL;
+}
+
+static struct disk_mount* mount_create(const char* path) {
+  int rc;
+  pthread_t thread;
+  struct disk_mount* mount;
+
+  mount = zalloc(sizeof(*mount));
+  ASSERT(mount != NULL);
+
+  mount->path = strdup(path);
+  ASSERT(mount->path != NULL);
+  mount->refs = 2;
+  pthread_mutex_init(&mount->lock, NULL);
+
+  mount->request_fd = eventfd(0, EFD_CLOEXEC);
+  mount->done_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (mount->request_fd < 0 || mount->done_fd < 0) {
+    module_error("could not create eventfd: %m");
+    goto fail;
+  }
+
+  rc = thread_spawn(&thread, mount_main, mount);
+  if (rc != 0) {
+    module_error("could not start statvfs thread for '%s': %s",
+                 path, strerror(rc));
+    goto fail;
+  }
+  pthread_detach(thread);
+
+  return mount;
+
+fail:
+  if (mount->request_fd >= 0)
+    close(mount->request_fd);
+  if (mount->done_fd >= 0)
+    close(mount->done_fd);
+  pthread_mutex_destroy(&mount->lock);
+  free(mount->path);
+  free(mount);
+  return NULL;
+}
+
+static void mount_destroy(struct disk_mount* mount) {
+  u64 one = 1;
+
+  __atomic_store_n(&mount->quit, true, __ATOMIC_RELEASE);
+  UNUSED(write(mount->request_fd, &one, sizeof(one)));
+  mount_release(mount);
+}
+
+static void mount_request(struct disk_mount* mount) {
+  u64 one = 1;
+
+  __atomic_store_n(&mount->busy, true, __ATOMIC_RELEASE);
+  mount->requested_ns = stats_now();
+  UNUSED(write(mount->request_fd, &one, sizeof(one)));
+}
+
+static void update_io(struct disk_io* io, u64 read_sectors, u64 write_sectors,
+                      u64 now_ns) {
+  if (io->has_stats) {
+    io->read_rate = rate_per_second(io->read_sectors * SECTOR_SIZE,
+                                    read_sectors * SECTOR_SIZE,
+                                    now_ns - io->sampled_ns);
+    io->write_rate = rate_per_second(io->write_sectors * SECTOR_SIZE,
+                                     write_sectors * SECTOR_SIZE,
+                                     now_ns - io->sampled_ns);
+  }
+
+  io->read_sectors = read_sectors;
+  io->write_sectors = write_sectors;
+  io->sampled_ns = now_ns;
+  io->has_stats = true;
+}
+
+/* Parses the rest of a line of /proc/diskstats, after the device name */
+static b8 parse_sectors(const char* s, u64* read_sectors, u64* write_sectors) {
+  size_t i;
+  u64 fields[7];
+
+  /* reads, reads merged, sectors read, time reading, writes, writes merged,
+   * sectors written
+   */
+  for (i = 0; i < ARRAY_LENGTH(fields); ++i) {
+    if ((s = parse_u64(s, &fields[i])) == NULL)
+      return false;
+  }
+
+  *read_sectors = fields[2];
+  *write_sectors = fields[6];
+  return true;
+}
+
+/* Updates the I/O counters of every instance that follows a device, in a
+ * single pass over buffer, which must be NUL terminated.
+ */
+static void parse_diskstats(const char* buffer, struct list* instances,
+                            u64 now_ns) {
+  u64 value, read_sectors, write_sectors;
+  size_t name_length;
+  const char *s, *e, *name;
+  struct disk_instance* instance;
+
+  for (s = buffer; *s != '\0'; s = e + 1) {
+    /* Skip major and minor numbers */
+    if ((e = parse_u64(s, &value)) == NULL ||
+        (e = parse_u64(e, &value)) == NULL)
+      goto next;
+
+    name = e + 1;
+    e = strchr(name, ' ');
+    if (e == NULL)
+      break;
+    name_length = e - name;
+
+    list_for_each(instance, instances, link) {
+      if (instance->device == NULL ||
+          strncmp(instance->device, name, name_length) ||
+          instance->device[name_length] != '\0')
+        continue;
+      if (!parse_sectors(e, &read_sectors, &write_sectors))
+        break;
+      update_io(&instance->io, read_sectors, write_sectors, now_ns);
+    }
+
+next:
+    e = strchr(s, '\n');
+    if (e == NULL)
+      break;
+  }
+}
+
+static b8 read_diskstats(struct diskstats* diskstats) {
+  ssize_t length;
+
+  for (;;) {
+    length = pread(diskstats->fd, diskstats->buffer,
+                   diskstats->buffer_size - 1, 0);
+    if (length < 0) {
+      module_error("could not read from '" DISKSTATS_PATH "': %m");
+      return false;
+    }
+    if ((size_t)length < diskstats->buffer_size - 1)
+      break;
+
+    /* Hotplugged devices made it grow */
+    diskstats->buffer_size *= 2;
+    diskstats->buffer = realloc(diskstats->buffer, diskstats->buffer_size);
+    ASSERT(diskstats->buffer != NULL);
+  }
+
+  diskstats->buffer[length] = '\0';
+  return true;
+}
+
+static b8 diskstats_open(struct diskstats* diskstats) {
+  diskstats->fd = open(DISKSTATS_PATH, O_RDONLY | O_CLOEXEC);
+  if (diskstats->fd < 0) {
+    module_error("could not open '" DISKSTATS_PATH "': %m");
+    return false;
+  }
+
+  diskstats->buffer_size = 4096;
+  diskstats->buffer = malloc(diskstats->buffer_size);
+  ASSERT(diskstats->buffer != NULL);
+
+  return true;
+}
+
+static void diskstats_close(struct diskstats* diskstats) {
+  if (diskstats->fd >= 0)
+    close(diskstats->fd);
+  diskstats->fd = -1;
+
+  free(diskstats->buffer);
+  diskstats->buffer = NULL;
+}
+
+static inline f64 to_gb(u64 bytes) {
+  return bytes / BYTES_PER_GB;
+}
+
+static void get_formatted_text(char* buffer, size_t buffer_size,
+                               struct disk_instance* instance,
+                               const struct disk_usage* usage,
+                               u64 read_rate, u64 write_rate) {
+  u64 used;
+  char read_text[16], write_text[16];
+
+  used = usage->total - min(usage->free, usage->total);
+  format_rate(read_text, sizeof(read_text), read_rate);
+  format_rate(write_text, sizeof(write_text), write_rate);
+
+  FORMAT(buffer, buffer_size, instance->format,
+         FORMAT_PARAM("mount", STRING, instance->mount->path),
+         FORMAT_PARAM("device", STRING,
+                      instance->device != NULL ? instance->device : ""),
+         FORMAT_PARAM("total", FLOAT, to_gb(usage->total)),
+         FORMAT_PARAM("used", FLOAT, to_gb(used)),
+         FORMAT_PARAM("free", FLOAT, to_gb(usage->available)),
+         FORMAT_PARAM("used_percent", INTEGER,
+                      usage->total > 0 ? used * 100 / usage->total : 0),
+         FORMAT_PARAM("read", STRING, read_text),
+         FORMAT_PARAM("write", STRING, write_text));
+}
+
+/* Sized for a large filesystem and rates that take all of their digits.
+ * The size of the actual filesystem isn't known yet, as the mount is only
+ * ever looked at from its own thread.
+ */
+static size_t compute_width(struct disk_instance* instance) {
+  char buffer[DISK_TEXT_SIZE];
+  struct disk_usage usage = {
+    .total = DISK_WIDTH_TOTAL,
+    .free = 0,
+    .available = DISK_WIDTH_TOTAL
+  };
+
+  get_formatted_text(buffer, sizeof(buffer), instance, &usage,
+                     999 * 1024, 999 * 1024);
+  return font_string_width(buffer) + 8;
+}
+
+static b8 disk_update(void* instance_ptr) {
+  char buffer[DISK_TEXT_SIZE];
+  struct disk_instance* instance = instance_ptr;
+
+  get_formatted_text(buffer, sizeof(buffer), instance, &instance->usage,
+                     instance->io.read_rate, instance->io.write_rate);
+  if (!strcmp(buffer, instance->text))
+    return false;
+
+  memcpy(instance->text, buffer, sizeof(buffer));
+  return true;
+}
+
+static void disk_render(void* instance_ptr) {
+  struct draw* draw;
+  struct disk_instance* instance = instance_ptr;
+
+  draw_on_zone(instance->zone, draw) {
+    draw_rect(draw,
+              0, 0,
+              draw_width(draw), draw_height(draw),
+              instance->bg_color.as_u32);
+    draw_string(draw, 4, 0, instance->text, instance->fg_color.as_u32);
+  }
+}
+
+static void handle_usage(int fd, void* data) {
+  u64 value;
+  int error;
+  struct disk_instance* instance = data;
+  struct disk_mount* mount = instance->mount;
+
+  if (read(fd, &value, sizeof(value)) < 0)
+    return;
+
+  pthread_mutex_lock(&mount->lock);
+  error = mount->error;
+  if (error == 0)
+    instance->usage = mount->result;
+  pthread_mutex_unlock(&mount->lock);
+
+  if (instance->timed_out)
+    module_info("'%s' is responding again", mount->path);
+  instance->timed_out = false;
+
+  if (error != 0) {
+    module_warn_ratelimited("could not stat '%s': %s",
+                            mount->path, strerror(error));
+    return;
+  }
+
+  module_update(instance->handle);
+}
+
+static void poll_mount(struct disk_instance* instance) {
+  struct disk_mount* mount = instance->mount;
+
+  if (!__atomic_load_n(&mount->busy, __ATOMIC_ACQUIRE)) {
+    mount_request(mount);
+    return;
+  }
+
+  /* Keep showing the cached usage, and don't pile up requests behind the
+   * one that is stuck.
+   */
+  if (!instance->timed_out &&
+      stats_now() - mount->requested_ns > instance->timeout_ns) {
+    module_warn("statvfs on '%s' timed out, showing cached usage",
+                mount->path);
+    instance->timed_out = true;
+  }
+}
+
+static void update_info(void) {
+  b8 has_io;
+  struct disk_instance* instance;
+
+  has_io = g_diskstats.fd >= 0 && read_diskstats(&g_diskstats);
+  if (has_io)
+    parse_diskstats(g_diskstats.buffer, &g_instances, stats_now());
+
+  list_for_each(instance, &g_instances, link) {
+    poll_mount(instance);
+    if (has_io && instance->device != NULL)
+      module_update(instance->handle);
+  }
+}
+
+static void* disk_init(struct module_init_data* init_data) {
+  const char* mount_path;
+  const char* device;
+  const char* format;
+  long timeout_ms;
+  struct disk_instance* instance;
+
+  CONFIG_PARSE(init_data->config,
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("mount"),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(mount_path),
+      CONFIG_PARAM_DEFAULT(DISK_DEFAULT_MOUNT)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("device"),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(device),
+      CONFIG_PARAM_DEFAULT(NULL)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("format"),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(format),
+      CONFIG_PARAM_DEFAULT(NULL)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("timeout"),
+      CONFIG_PARAM_TYPE(INTEGER),
+      CONFIG_PARAM_STORE(timeout_ms),
+      CONFIG_PARAM_DEFAULT(DISK_DEFAULT_TIMEOUT_MS)
+    )
+  );
+
+  if (timeout_ms < 1) {
+    module_error("timeout must be positive (got %ld)", timeout_ms);
+    timeout_ms = DISK_DEFAULT_TIMEOUT_MS;
+  }
+
+  if (format == NULL)
+    format = device != NULL ? DISK_DEFAULT_FORMAT_IO : DISK_DEFAULT_FORMAT;
+
+  instance = zalloc(sizeof(*instance));
+  ASSERT(instance != NULL);
+
+  instance->handle = init_data->handle;
+
+  /* The mount keeps its own copy of the path, its thread may outlive the
+   * config
+   */
+  instance->mount = mount_create(mount_path);
+  if (instance->mount == NULL) {
+    free(instance);
+    return NULL;
+  }
+
+  instance->device = device;
+  instance->format = format;
+  instance->timeout_ns = timeout_ms * 1000000ULL;
+  instance->fg_color = init_data->foreground_color;
+  instance->bg_color = init_data->background_color;
+
+  instance->zone = bar_alloc_zone(init_data->position, compute_width(instance));
+
+  if (!list_is_initialized(&g_instances))
+    list_init(&g_instances);
+  list_insert(&g_instances, &instance->link);
+
+  sched_watch_fd(instance->mount->done_fd, handle_usage, instance);
+  mount_request(instance->mount);
+
+  /* Only once the instance is in the list, whose last one closes it */
+  if (device != NULL && g_diskstats.fd < 0)
+    diskstats_open(&g_diskstats);
+
+  if (g_task_id < 0)
+    g_task_id = sched_task_interval(update_info, REFRESH_INTERVAL_MS, false);
+
+  return instance;
+}
+
+static void disk_cleanup(void* instance_ptr) {
+  struct disk_instance* instance = instance_ptr;
+
+  if (list_length(&g_instances) == 1) {
+    if (g_task_id >= 0)
+      sched_task_delete(g_task_id);
+    g_task_id = -1;
+    diskstats_close(&g_diskstats);
+  }
+
+  sched_unwatch_fd(instance->mount->done_fd);
+  mount_destroy(instance->mount);
+
+  if (instance->zone != NULL)
+    bar_destroy_zone(&instance->zone);
+
+  list_remove(&instance->link);
+  free(instance);
+}
+
+MODULE_CALLBACKS(.init = disk_init,
+                 .update = disk_update,
+                 .render = disk_render,
+                 .cleanup = disk_cleanup);
@@ -0,0 +1,352 @@
+#include <gaybar/module.h>
+#include <gaybar/bar.h>
+#include <gaybar/util.h>
+#include <gaybar/draw.h>
+#include <gaybar/sched.h>
+#include <gaybar/font.h>
+#include <gaybar/stats.h>
+#include <gaybar/child.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#define EXEC_DEFAULT_MODE     "stream"
+#define EXEC_DEFAULT_INTERVAL 5000
+#define EXEC_DEFAULT_LENGTH   32
+#define EXEC_MIN_INTERVAL     250
+
+#define EXEC_LINE_SIZE 512
+
+/* Restarts of a streaming command back off exponentially, from the base
+ * delay up to the maximum. A command that ran for a while before exiting
+ * starts again from the base delay.
+ */
+#define EXEC_BACKOFF_BASE_MS 1000
+#define EXEC_BACKOFF_MAX_MS  (5 * 60 * 1000)
+#define EXEC_STABLE_MS       (30 * 1000)
+
+enum exec_mode {
+  EXEC_MODE_STREAM,   /* Started once, every line it prints is shown */
+  EXEC_MODE_INTERVAL  /* Started every interval, shows its last line */
+};
+
+struct exec_instance {
+  struct list link;
+  const char* command;
+  enum exec_mode mode;
+  u64 interval_ns;
+  size_t length; /* In characters */
+  struct child child;
+  u32 failures;
+  /* UINT64_MAX while there is nothing to run */
+  u64 next_run_ns;
+  /* The line being read, until its newline shows up */
+  size_t partial_length;
+  char partial[EXEC_LINE_SIZE];
+  char text[EXEC_LINE_SIZE];
+  struct module_instance* handle;
+  struct zone* zone;
+  struct color bg_color;
+  struct color fg_color;
+};
+
+static i64 g_task_id = -1;
+static struct list g_instances = LIST_UNINITIALIZED;
+
+MODULE("exec", "markx86", "Display the output of a command.");
+
+static void exec_render(void* instance_ptr) {
+  struct draw* draw;
+  struct exec_instance* instance = instance_ptr;
+
+  draw_on_zone(instance->zone, draw) {
+    draw_rect(draw,
+              0, 0,
+              draw_width(draw), draw_height(draw),
+              instance->bg_color.as_u32);
+    draw_string(draw, 4, 0, instance->text, instance->fg_color.as_u32);
+  }
+}
+
+static void show_line(struct exec_instance* instance,
+                      const char* line, size_t line_length) {
+  char text[EXEC_LINE_SIZE];
+
+  font_string_sanitize(text, sizeof(text), line, line_length,
+                       instance->length);
+  if (!strcmp(text, instance->text))
+    return;
+
+  /* Only the last of the lines read before a frame gets drawn */
+  memcpy(instance->text, text, sizeof(text));
+  zone_resize(instance->zone, font_string_width(text) + 8);
+  module_update(instance->handle);
+}
+
+static void handle_output(struct child* child,
+                          const char* buffer, size_t length) {
+  const char *s, *e, *end, *last;
+  size_t last_length, copy;
+  struct exec_instance* instance =
+    CONTAINER_OF(child, struct exec_instance, child);
+
+  /* The child closed its end. Whatever it printed without a newline last
+   * is still a line.
+   */
+  if (length == 0) {
+    if (instance->partial_length > 0)
+      show_line(instance, instance->partial, instance->partial_length);
+    instance->partial_length = 0;
+    return;
+  }
+
+  last = NULL;
+  last_length = 0;
+  end = buffer + length;
+  for (s = buffer; (e = memchr(s, '\n', end - s)) != NULL; s = e + 1) {
+    /* Complete the line that started in an earlier read */
+    if (instance->partial_length > 0) {
+      copy = min((size_t)(e - s),
+                 sizeof(instance->partial) - instance->partial_length);
+      memcpy(&instance->partial[instance->partial_length], s, copy);
+      instance->partial_length += copy;
+      show_line(instance, instance->partial, instance->partial_length);
+      instance->partial_length = 0;
+      last = NULL;
+    } else {
+      last = s;
+      last_length = e - s;
+    }
+  }
+
+  /* Only the latest complete line of this buffer is worth drawing */
+  if (last != NULL)
+    show_line(instance, last, last_length);
+
+  copy = min((size_t)(end - s),
+             sizeof(instance->partial) - instance->partial_length);
+  memcpy(&instance->partial[instance->partial_length], s, copy);
+  instance->partial_length += copy;
+}
+
+static void schedule_restart(struct exec_instance* instance, u64 now_ns) {
+  u64 delay_ms;
+
+  if (now_ns - instance->child.started_ns >= MS_TO_NS(EXEC_STABLE_MS))
+    instance->failures = 0;
+
+  delay_ms = EXEC_BACKOFF_BASE_MS;
+  if (instance->failures < 32)
+    delay_ms <<= instance->failures;
+  delay_ms = min(delay_ms, EXEC_BACKOFF_MAX_MS);
+  ++instance->failures;
+
+  module_warn("'%s' exited, restarting in %lums", instance->command, delay_ms);
+  instance->next_run_ns = now_ns + MS_TO_NS(delay_ms);
+}
+
+static void run_due(void);
+
+/* Arms the task for the earliest run that is due, if any */
+static void schedule_next_run(void) {
+  u64 now_ns, next_ns;
+  struct exec_instance* instance;
+
+  if (g_task_id >= 0)
+    sched_task_delete(g_task_id);
+  g_task_id = -1;
+
+  next_ns = UINT64_MAX;
+  list_for_each(instance, &g_instances, link) {
+    if (instance->next_run_ns < next_ns)
+      next_ns = instance->next_run_ns;
+  }
+  if (next_ns == UINT64_MAX)
+    return;
+
+  /* A delay of 0 would run the task right away, from in here */
+  now_ns = stats_now();
+  g_task_id = sched_task_delayed(run_due, next_ns > now_ns
+                                 ? (next_ns - now_ns + 999999) / 1000000
+                                 : 1);
+}
+
+static void run_instance(struct exec_instance* instance, u64 now_ns) {
+  if (child_is_running(&instance->child)) {
+    /* A run that takes longer than the interval is not started again on
+     * top of itself.
+     */
+    if (instance->mode == EXEC_MODE_INTERVAL) {
+      module_warn_ratelimited("'%s' is still running, skipping a run",
+                              instance->command);
+      instance->next_run_ns = now_ns + instance->interval_ns;
+      return;
+    }
+    /* The command exited, but what it started still holds its output */
+    child_stop(&instance->child);
+  }
+
+  instance->partial_length = 0;
+  if (!child_spawn(&instance->child) && instance->mode == EXEC_MODE_STREAM) {
+    schedule_restart(instance, now_ns);
+    return;
+  }
+
+  if (instance->mode == EXEC_MODE_INTERVAL)
+    instance->next_run_ns = now_ns + instance->interval_ns;
+  else
+    /* Runs again only once it has exited */
+    instance->next_run_ns = UINT64_MAX;
+}
+
+static void run_due(void) {
+  u64 now_ns;
+  struct exec_instance* instance;
+
+  /* This task is done once it returns */
+  g_task_id = -1;
+
+  now_ns = stats_now();
+  list_for_each(instance, &g_instances, link) {
+    if (instance->next_run_ns <= now_ns)
+      run_instance(instance, now_ns);
+  }
+
+  schedule_next_run();
+}
+
+static void handle_exit(struct child* child, int status) {
+  struct exec_instance* instance =
+    CONTAINER_OF(child, struct exec_instance, child);
+
+  if (WIFEXITED(status) && WEXITSTATUS(status) != 0)
+    module_warn("'%s' exited with status %d",
+                instance->command, WEXITSTATUS(status));
+  else if (WIFSIGNALED(status))
+    module_warn("'%s' was killed by signal %d",
+                instance->command, WTERMSIG(status));
+
+  if (instance->mode == EXEC_MODE_STREAM) {
+    schedule_restart(instance, stats_now());
+    schedule_next_run();
+  }
+}
+
+static const struct child_callbacks g_child_callbacks = {
+  .output = handle_output,
+  .exit = handle_exit
+};
+
+static b8 parse_mode(const char* name, enum exec_mode* mode) {
+  if (!strcmp(name, "stream"))
+    *mode = EXEC_MODE_STREAM;
+  else if (!strcmp(name, "interval"))
+    *mode = EXEC_MODE_INTERVAL;
+  else
+    return false;
+  return true;
+}
+
+static void* exec_init(struct module_init_data* init_data) {
+  const char *command, *mode_name;
+  long interval_ms, length;
+  enum exec_mode mode;
+  struct zone_size zone_size;
+  struct exec_instance* instance;
+
+  CONFIG_PARSE(init_data->config,
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("command"),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(command),
+      CONFIG_PARAM_DEFAULT(NULL)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("mode"),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(mode_name),
+      CONFIG_PARAM_DEFAULT(EXEC_DEFAULT_MODE)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("interval"),
+      CONFIG_PARAM_TYPE(INTEGER),
+      CONFIG_PARAM_STORE(interval_ms),
+      CONFIG_PARAM_DEFAULT(EXEC_DEFAULT_INTERVAL)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("length"),
+      CONFIG_PARAM_TYPE(INTEGER),
+      CONFIG_PARAM_STORE(length),
+      CONFIG_PARAM_DEFAULT(EXEC_DEFAULT_LENGTH)
+    )
+  );
+
+  if (command == NULL) {
+    module_error("no command to run");
+    return NULL;
+  }
+
+  if (!parse_mode(mode_name, &mode)) {
+    module_error("invalid mode '%s', must be 'stream' or 'interval'",
+                 mode_name);
+    mode = EXEC_MODE_STREAM;
+  }
+
+  if (interval_ms < EXEC_MIN_INTERVAL) {
+    module_error("interval must be at least %dms (got %ld)",
+                 EXEC_MIN_INTERVAL, interval_ms);
+    interval_ms = EXEC_DEFAULT_INTERVAL;
+  }
+
+  if (length < 1 || length >= EXEC_LINE_SIZE / 4) {
+    module_error("length must be between 1 and %d characters (got %ld)",
+                 EXEC_LINE_SIZE / 4 - 1, length);
+    length = EXEC_DEFAULT_LENGTH;
+  }
+
+  instance = zalloc(sizeof(*instance));
+  ASSERT(instance != NULL);
+
+  instance->handle = init_data->handle;
+
+  instance->command = command;
+  instance->mode = mode;
+  instance->interval_ns = MS_TO_NS(interval_ms);
+  instance->length = length;
+  child_init(&instance->child, command, &g_child_callbacks);
+  /* Grows with the output, up to length characters */
+  zone_size.min = zone_size.preferred = 8;
+  zone_size.max = font_chars_width(length) + 8;
+  instance->zone = bar_alloc_resizable_zone(init_data->position, zone_size,
+                                            init_data->handle);
+  instance->fg_color = init_data->foreground_color;
+  instance->bg_color = init_data->background_color;
+
+  if (!list_is_initialized(&g_instances))
+    list_init(&g_instances);
+  list_insert(&g_instances, &instance->link);
+
+  run_instance(instance, stats_now());
+  schedule_next_run();
+
+  return instance;
+}
+
+static void exec_cleanup(void* instance_ptr) {
+  struct exec_instance* instance = instance_ptr;
+
+  child_stop(&instance->child);
+
+  if (instance->zone != NULL)
+    bar_destroy_zone(&instance->zone);
+
+  list_remove(&instance->link);
+  free(instance);
+
+  schedule_next_run();
+}
+
+MODULE_CALLBACKS(.init = exec_init,
+                 .render = exec_render,
+                 .cleanup = exec_cleanup);
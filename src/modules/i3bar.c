@@ -0,0 +1,529 @@
+#include <gaybar/module.h>
+#include <gaybar/bar.h>
+#include <gaybar/util.h>
+#include <gaybar/draw.h>
+#include <gaybar/sched.h>
+#include <gaybar/font.h>
+#include <gaybar/stats.h>
+#include <gaybar/child.h>
+#include <gaybar/json_stream.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define RESTART_DELAY_MS 5000
+
+#define I3BAR_DEFAULT_WIDTH 600
+
+#define I3BAR_MAX_BLOCKS 32
+#define I3BAR_TEXT_SIZE  256
+
+/* Defaults of the protocol */
+#define I3BAR_SEPARATOR_WIDTH 9
+#define I3BAR_URGENT_BACKGROUND COLOR(0x90, 0x00, 0x00)
+#define I3BAR_URGENT_FOREGROUND COLOR(0xFF, 0xFF, 0xFF)
+
+/* Between the text and the edges of its block */
+#define BLOCK_PADDING 4
+
+/* Depths of the stream: the infinite array, a status line, a block */
+#define DEPTH_LINE  2
+#define DEPTH_BLOCK 3
+
+enum block_align {
+  ALIGN_LEFT,
+  ALIGN_CENTER,
+  ALIGN_RIGHT
+};
+
+struct i3bar_block {
+  char text[I3BAR_TEXT_SIZE];
+  b8 has_color;
+  b8 has_background;
+  b8 urgent;
+  b8 separator;
+  struct color color;
+  struct color background;
+  enum block_align align;
+  u32 min_width;
+  u32 separator_width;
+};
+
+/* A block as laid out in the zone. Each has its own image, that only gets
+ * rendered again when the block changed, and is then copied in the zone.
+ */
+struct i3bar_slot {
+  struct i3bar_block block;
+  u32 x;
+  u32 width;
+  u32* pixels;
+  /* Set when the block changed since its image was rendered */
+  b8 dirty;
+};
+
+struct i3bar_instance {
+  struct list link;
+  struct child child;
+  /* UINT64_MAX unless the command exited and waits to be restarted */
+  u64 restart_ns;
+  struct json_stream stream;
+  /* The status line being parsed */
+  size_t pending_count;
+  struct i3bar_block pending[I3BAR_MAX_BLOCKS];
+  /* Set while in a block past the ones that are shown */
+  b8 dropping;
+  /* The status line being shown */
+  size_t slots_count;
+  struct i3bar_slot slots[I3BAR_MAX_BLOCKS];
+  /* Set when the slots moved, and the whole zone must be drawn again */
+  b8 relayout;
+  struct module_instance* handle;
+  struct zone* zone;
+  /* The zone grows with the slots, up to the configured width */
+  u32 max_width;
+  /* Width of the zone when it was last drawn */
+  u32 drawn_width;
+  struct color bg_color;
+  struct color fg_color;
+};
+
+static i64 g_task_id = -1;
+static struct list g_instances = LIST_UNINITIALIZED;
+
+MODULE("i3bar", "markx86", "Display the blocks of an i3bar protocol program.");
+
+static void block_init(struct i3bar_block* block) {
+  memset(block, 0, sizeof(*block));
+  block->separator = true;
+  block->separator_width = I3BAR_SEPARATOR_WIDTH;
+}
+
+/* Accepts '#RRGGBB' and '#RRGGBBAA', the alpha is ignored */
+static b8 parse_block_color(const char* s, size_t length, struct color* color) {
+  char rgb[8];
+
+  if (length != 7 && length != 9)
+    return false;
+
+  memcpy(rgb, s, 7);
+  rgb[7] = '\0';
+  return color_from_hex(rgb, color);
+}
+
+static u32 text_width(const char* text) {
+  return font_string_width(text) + 2 * BLOCK_PADDING;
+}
+
+/* Widths come from the status command, they are cut to the widest the
+ * zone gets so that they can't size the slot images past it.
+ */
+static u32 parse_width(const char* token, u32 max_width) {
+  return clamp(strtol(token, NULL, 10), 0, max_width);
+}
+
+static void set_block_field(struct i3bar_block* block, const char* key,
+                            enum json_value_type type,
+                            const char* token, size_t length, u32 max_width) {
+  char text[I3BAR_TEXT_SIZE];
+
+  if (!strcmp(key, "full_text")) {
+    if (type == JSON_VALUE_STRING)
+      font_string_sanitize(block->text, sizeof(block->text), token, length,
+                           sizeof(block->text));
+  } else if (!strcmp(key, "color")) {
+    if (type == JSON_VALUE_STRING)
+      block->has_color = parse_block_color(token, length, &block->color);
+  } else if (!strcmp(key, "background")) {
+    if (type == JSON_VALUE_STRING)
+      block->has_background =
+        parse_block_color(token, length, &block->background);
+  } else if (!strcmp(key, "min_width")) {
+    /* Either pixels, or a string that is as wide as the block should be */
+    if (type == JSON_VALUE_NUMBER)
+      block->min_width = parse_width(token, max_width);
+    else if (type == JSON_VALUE_STRING) {
+      font_string_sanitize(text, sizeof(text), token, length, sizeof(text));
+      block->min_width = min(text_width(text), max_width);
+    }
+  } else if (!strcmp(key, "align")) {
+    if (type == JSON_VALUE_STRING)
+      block->align = !strcmp(token, "center") ? ALIGN_CENTER
+                   : !strcmp(token, "right") ? ALIGN_RIGHT
+                   : ALIGN_LEFT;
+  } else if (!strcmp(key, "urgent"))
+    block->urgent = type == JSON_VALUE_TRUE;
+  else if (!strcmp(key, "separator"))
+    block->separator = type != JSON_VALUE_FALSE;
+  else if (!strcmp(key, "separator_block_width")) {
+    if (type == JSON_VALUE_NUMBER)
+      block->separator_width = parse_width(token, max_width);
+  }
+}
+
+static struct color block_foreground(struct i3bar_instance* instance,
+                                     const struct i3bar_block* block) {
+  if (block->urgent)
+    return I3BAR_URGENT_FOREGROUND;
+  return block->has_color ? block->color : instance->fg_color;
+}
+
+static struct color block_background(struct i3bar_instance* instance,
+                                     const struct i3bar_block* block) {
+  if (block->urgent)
+    return I3BAR_URGENT_BACKGROUND;
+  return block->has_background ? block->background : instance->bg_color;
+}
+
+static void render_slot(struct i3bar_instance* instance,
+                        struct i3bar_slot* slot) {
+  size_t i;
+  u32 height, width, x;
+  struct i3bar_block* block = &slot->block;
+
+  height = instance->zone->height;
+  for (i = 0; i < (size_t)slot->width * height; ++i)
+    slot->pixels[i] = block_background(instance, block).as_u32;
+
+  width = font_string_width(block->text);
+  switch (block->align) {
+    case ALIGN_CENTER:
+      x = slot->width > width ? (slot->width - width) / 2 : 0;
+      break;
+    case ALIGN_RIGHT:
+      x = slot->width > width + BLOCK_PADDING
+            ? slot->width - width - BLOCK_PADDING : 0;
+      break;
+    default:
+      x = BLOCK_PADDING;
+      break;
+  }
+  if (x >= slot->width)
+    return;
+
+  font_string_render(block->text, false,
+                     block_foreground(instance, block).as_u32,
+                     &slot->pixels[x], slot->width - x, height, slot->width);
+}
+
+static void draw_slot(struct i3bar_instance* instance, struct draw* draw,
+                      struct i3bar_slot* slot) {
+  u32 height, gap;
+
+  height = draw_height(draw);
+  draw_icon(draw, slot->x, 0, slot->width, height, slot->pixels);
+
+  gap = slot->block.separator_width;
+  draw_rect(draw, slot->x + slot->width, 0, gap, height,
+            instance->bg_color.as_u32);
+  if (slot->block.separator && gap > 0)
+    draw_rect(draw, slot->x + slot->width + gap / 2, 2, 1, height - 4,
+              instance->fg_color.as_u32);
+}
+
+/* Returns false if the block doesn't fit in its slot any more */
+static b8 block_fits(const struct i3bar_slot* slot,
+                     const struct i3bar_block* block) {
+  if (block->separator_width != slot->block.separator_width)
+    return false;
+  if (block->min_width == slot->block.min_width &&
+      !strcmp(block->text, slot->block.text))
+    return true;
+  return max(block->min_width, text_width(block->text)) == slot->width;
+}
+
+static void layout_slots(struct i3bar_instance* instance) {
+  size_t i;
+  u32 x;
+  struct i3bar_slot* slot;
+
+  x = 0;
+  for (i = 0; i < instance->pending_count; ++i) {
+    slot = &instance->slots[i];
+    slot->block = instance->pending[i];
+    slot->x = x;
+    slot->width = max(slot->block.min_width, text_width(slot->block.text));
+    slot->pixels = realloc(slot->pixels, (size_t)slot->width *
+                           instance->zone->height * sizeof(*slot->pixels));
+    ASSERT(slot->pixels != NULL);
+    slot->dirty = true;
+    x += slot->width + slot->block.separator_width;
+  }
+  instance->slots_count = instance->pending_count;
+  instance->relayout = true;
+  zone_resize(instance->zone, x);
+}
+
+/* Takes in the status line that was just parsed. Only the blocks that
+ * changed are rendered again, and if none moved only those are copied in
+ * the zone.
+ */
+static void commit_line(struct i3bar_instance* instance) {
+  size_t i;
+  b8 relayout, changed;
+  struct i3bar_slot* slot;
+
+  relayout = instance->pending_count != instance->slots_count;
+  for (i = 0; i < instance->pending_count && !relayout; ++i)
+    relayout = !block_fits(&instance->slots[i], &instance->pending[i]);
+
+  if (relayout) {
+    layout_slots(instance);
+    module_update(instance->handle);
+    return;
+  }
+
+  changed = false;
+  for (i = 0; i < instance->slots_count; ++i) {
+    slot = &instance->slots[i];
+    if (memcmp(&slot->block, &instance->pending[i], sizeof(slot->block))) {
+      slot->block = instance->pending[i];
+      slot->dirty = true;
+      changed = true;
+    }
+  }
+
+  if (changed)
+    module_update(instance->handle);
+}
+
+static void on_open(struct json_stream* stream, char type) {
+  struct i3bar_instance* instance = stream->data;
+
+  if (type == '[' && stream->depth == DEPTH_LINE)
+    instance->pending_count = 0;
+  else if (type == '{' && stream->depth == DEPTH_BLOCK &&
+           stream->containers[DEPTH_LINE - 1] == '[') {
+    instance->dropping = instance->pending_count >= I3BAR_MAX_BLOCKS;
+    if (instance->dropping)
+      module_warn_ratelimited("only %d blocks are shown", I3BAR_MAX_BLOCKS);
+    else
+      block_init(&instance->pending[instance->pending_count++]);
+  }
+}
+
+static void on_close(struct json_stream* stream, char type) {
+  struct i3bar_instance* instance = stream->data;
+
+  if (type == '{' && stream->depth == DEPTH_BLOCK - 1)
+    instance->dropping = false;
+  /* The stream starts with the header object, the lines are in an array */
+  else if (type == '[' && stream->depth == DEPTH_LINE - 1 &&
+      stream->containers[0] == '[')
+    commit_line(instance);
+}
+
+static void on_value(struct json_stream* stream, enum json_value_type type,
+                     const char* token, size_t length) {
+  struct i3bar_instance* instance = stream->data;
+
+  if (stream->depth != DEPTH_BLOCK ||
+      stream->containers[DEPTH_BLOCK - 1] != '{' ||
+      instance->pending_count == 0 || instance->dropping)
+    return;
+
+  set_block_field(&instance->pending[instance->pending_count - 1],
+                  stream->key, type, token, length, instance->max_width);
+}
+
+static const struct json_stream_callbacks g_stream_callbacks = {
+  .open = on_open,
+  .close = on_close,
+  .value = on_value
+};
+
+static void handle_output(struct child* child,
+                          const char* buffer, size_t length) {
+  struct i3bar_instance* instance =
+    CONTAINER_OF(child, struct i3bar_instance, child);
+
+  if (length == 0)
+    module_warn("'%s' closed its output", child->command);
+  else if (!json_stream_feed(&instance->stream, buffer, length))
+    module_warn_ratelimited("'%s' sent invalid JSON", child->command);
+}
+
+static void restart_due(void);
+
+/* Arms the task for the earliest restart, if any */
+static void schedule_restart(void) {
+  u64 now_ns, restart_ns;
+  struct i3bar_instance* instance;
+
+  if (g_task_id >= 0)
+    sched_task_delete(g_task_id);
+  g_task_id = -1;
+
+  restart_ns = UINT64_MAX;
+  list_for_each(instance, &g_instances, link) {
+    if (instance->restart_ns < restart_ns)
+      restart_ns = instance->restart_ns;
+  }
+  if (restart_ns == UINT64_MAX)
+    return;
+
+  /* A delay of 0 would run the task right away, from in here */
+  now_ns = stats_now();
+  g_task_id = sched_task_delayed(restart_due, restart_ns > now_ns
+                                 ? (restart_ns - now_ns + 999999) / 1000000
+                                 : 1);
+}
+
+static void start_child(struct i3bar_instance* instance) {
+  /* What the command started may still hold its output */
+  child_stop(&instance->child);
+
+  json_stream_init(&instance->stream, &g_stream_callbacks, instance);
+  instance->pending_count = 0;
+  instance->dropping = false;
+  instance->restart_ns = UINT64_MAX;
+  if (!child_spawn(&instance->child))
+    instance->restart_ns = stats_now() + MS_TO_NS(RESTART_DELAY_MS);
+}
+
+static void restart_due(void) {
+  u64 now_ns;
+  struct i3bar_instance* instance;
+
+  /* This task is done once it returns */
+  g_task_id = -1;
+
+  now_ns = stats_now();
+  list_for_each(instance, &g_instances, link) {
+    if (instance->restart_ns <= now_ns)
+      start_child(instance);
+  }
+
+  schedule_restart();
+}
+
+static void handle_exit(struct child* child, int status) {
+  struct i3bar_instance* instance =
+    CONTAINER_OF(child, struct i3bar_instance, child);
+
+  UNUSED(status);
+
+  module_warn("'%s' exited, restarting in %dms",
+              child->command, RESTART_DELAY_MS);
+  instance->restart_ns = stats_now() + MS_TO_NS(RESTART_DELAY_MS);
+  schedule_restart();
+}
+
+static const struct child_callbacks g_child_callbacks = {
+  .output = handle_output,
+  .exit = handle_exit
+};
+
+static void i3bar_render(void* instance_ptr) {
+  size_t i;
+  struct draw* draw;
+  struct i3bar_slot* slot;
+  struct i3bar_instance* instance = instance_ptr;
+
+  /* The whole zone is drawn again once the bar changed its width */
+  if (instance->zone->width != instance->drawn_width) {
+    instance->drawn_width = instance->zone->width;
+    instance->relayout = true;
+  }
+
+  /* The zone is taken while drawing on it, render the slots first */
+  for (i = 0; i < instance->slots_count; ++i) {
+    if (instance->slots[i].dirty)
+      render_slot(instance, &instance->slots[i]);
+  }
+
+  draw_on_zone(instance->zone, draw) {
+    if (instance->relayout)
+      draw_rect(draw,
+                0, 0,
+                draw_width(draw), draw_height(draw),
+                instance->bg_color.as_u32);
+
+    for (i = 0; i < instance->slots_count; ++i) {
+      slot = &instance->slots[i];
+      if (slot->dirty || instance->relayout)
+        draw_slot(instance, draw, slot);
+      slot->dirty = false;
+    }
+
+    instance->relayout = false;
+  }
+}
+
+static void* i3bar_init(struct module_init_data* init_data) {
+  const char* command;
+  long width;
+  struct zone_size zone_size;
+  struct i3bar_instance* instance;
+
+  CONFIG_PARSE(init_data->config,
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("command"),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(command),
+      CONFIG_PARAM_DEFAULT(NULL)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("width"),
+      CONFIG_PARAM_TYPE(INTEGER),
+      CONFIG_PARAM_STORE(width),
+      CONFIG_PARAM_DEFAULT(I3BAR_DEFAULT_WIDTH)
+    )
+  );
+
+  if (command == NULL) {
+    module_error("no command to run");
+    return NULL;
+  }
+
+  if (width < 1) {
+    module_error("width must be positive (got %ld)", width);
+    width = I3BAR_DEFAULT_WIDTH;
+  }
+
+  instance = zalloc(sizeof(*instance));
+  ASSERT(instance != NULL);
+
+  instance->handle = init_data->handle;
+
+  child_init(&instance->child, command, &g_child_callbacks);
+  /* As wide as an empty block until the first status line */
+  zone_size.min = zone_size.preferred = min(2 * BLOCK_PADDING, width);
+  zone_size.max = width;
+  instance->max_width = width;
+  instance->zone = bar_alloc_resizable_zone(init_data->position, zone_size,
+                                            init_data->handle);
+  instance->fg_color = init_data->foreground_color;
+  instance->bg_color = init_data->background_color;
+
+  if (!list_is_initialized(&g_instances))
+    list_init(&g_instances);
+  list_insert(&g_instances, &instance->link);
+
+  instance->relayout = true;
+  start_child(instance);
+  schedule_restart();
+
+  return instance;
+}
+
+static void i3bar_cleanup(void* instance_ptr) {
+  size_t i;
+  struct i3bar_instance* instance = instance_ptr;
+
+  child_stop(&instance->child);
+
+  if (instance->zone != NULL)
+    bar_destroy_zone(&instance->zone);
+
+  for (i = 0; i < I3BAR_MAX_BLOCKS; ++i)
+    free(instance->slots[i].pixels);
+
+  list_remove(&instance->link);
+  free(instance);
+
+  schedule_restart();
+}
+
+MODULE_CALLBACKS(.init = i3bar_init,
+                 .render = i3bar_render,
+                 .cleanup = i3bar_cleanup);
@@ -0,0 +1,132 @@
+#include <gaybar/module.h>
+#include <gaybar/bar.h>
+#include <gaybar/util.h>
+#include <gaybar/draw.h>
+#include <gaybar/font.h>
+#include <gaybar/ipc.h>
+#include <gaybar/compiler.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#define IPC_DEFAULT_LENGTH 32
+
+#define IPC_TEXT_SIZE 512
+
+struct ipc_instance {
+  struct ipc_target target;
+  const char* name;
+  size_t length; /* In characters */
+  char text[IPC_TEXT_SIZE];
+  struct module_instance* handle;
+  struct zone* zone;
+  struct color bg_color;
+  struct color fg_color;
+};
+
+MODULE("ipc", "markx86", "Display text sent over the ipc socket.");
+
+static void ipc_widget_render(void* instance_ptr) {
+  struct draw* draw;
+  struct ipc_instance* instance = instance_ptr;
+
+  draw_on_zone(instance->zone, draw) {
+    draw_rect(draw,
+              0, 0,
+              draw_width(draw), draw_height(draw),
+              instance->bg_color.as_u32);
+    draw_string(draw, 4, 0, instance->text, instance->fg_color.as_u32);
+  }
+}
+
+static void set_text(struct ipc_target* target,
+                     const char* text, size_t length) {
+  char buffer[IPC_TEXT_SIZE];
+  struct ipc_instance* instance =
+    CONTAINER_OF(target, struct ipc_instance, target);
+
+  font_string_sanitize(buffer, sizeof(buffer), text, length,
+                       instance->length);
+  if (!strcmp(buffer, instance->text))
+    return;
+
+  /* Any number of updates may come in before the next frame, only the
+   * last one gets drawn.
+   */
+  memcpy(instance->text, buffer, sizeof(buffer));
+  zone_resize(instance->zone, font_string_width(buffer) + 8);
+  module_update(instance->handle);
+}
+
+static void redraw(struct ipc_target* target) {
+  module_update(CONTAINER_OF(target, struct ipc_instance, target)->handle);
+}
+
+static void* ipc_widget_init(struct module_init_data* init_data) {
+  const char* name;
+  long length;
+  struct zone_size zone_size;
+  struct ipc_instance* instance;
+
+  CONFIG_PARSE(init_data->config,
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("name"),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(name),
+      CONFIG_PARAM_DEFAULT(NULL)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("length"),
+      CONFIG_PARAM_TYPE(INTEGER),
+      CONFIG_PARAM_STORE(length),
+      CONFIG_PARAM_DEFAULT(IPC_DEFAULT_LENGTH)
+    )
+  );
+
+  if (name == NULL) {
+    module_error("a name is required");
+    return NULL;
+  }
+
+  if (length < 1 || length >= IPC_TEXT_SIZE / 4) {
+    module_error("length must be between 1 and %d characters (got %ld)",
+                 IPC_TEXT_SIZE / 4 - 1, length);
+    length = IPC_DEFAULT_LENGTH;
+  }
+
+  instance = zalloc(sizeof(*instance));
+  ASSERT(instance != NULL);
+
+  instance->handle = init_data->handle;
+
+  instance->name = name;
+  instance->length = length;
+  instance->fg_color = init_data->foreground_color;
+  instance->bg_color = init_data->background_color;
+  zone_size.min = zone_size.preferred = 8;
+  zone_size.max = font_chars_width(length) + 8;
+  instance->zone = bar_alloc_resizable_zone(init_data->position, zone_size,
+                                            init_data->handle);
+
+  instance->target.name = name;
+  instance->target.callbacks.set_text = set_text;
+  instance->target.callbacks.redraw = redraw;
+  ipc_add_target(&instance->target);
+
+  return instance;
+}
+
+static void ipc_widget_cleanup(void* instance_ptr) {
+  struct ipc_instance* instance = instance_ptr;
+
+  ipc_remove_target(&instance->target);
+
+  if (instance->zone != NULL)
+    bar_destroy_zone(&instance->zone);
+
+  free(instance);
+}
+
+MODULE_CALLBACKS(.init = ipc_widget_init,
+                 .render = ipc_widget_render,
+                 .cleanup = ipc_widget_cleanup);
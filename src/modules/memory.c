@@ -0,0 +1,323 @@
+#include <gaybar/module.h>
+#include <gaybar/bar.h>
+#include <gaybar/util.h>
+#include <gaybar/draw.h>
+#include <gaybar/sched.h>
+#include <gaybar/font.h>
+#include <gaybar/format.h>
+#include <gaybar/parse.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define MEMINFO_PATH "/proc/meminfo"
+
+#define REFRESH_INTERVAL_MS 2000
+
+#define MEMORY_DEFAULT_FORMAT \
+  "MEM: {used}/{total}G\nSWP: {swap_used}/{swap_total}G"
+
+#define KB_PER_GB (1024.0 * 1024.0)
+
+#define MEMORY_TEXT_SIZE 256
+
+enum meminfo_field {
+  FIELD_MEM_TOTAL,
+  FIELD_MEM_AVAILABLE,
+  FIELD_BUFFERS,
+  FIELD_CACHED,
+  FIELD_SWAP_TOTAL,
+  FIELD_SWAP_FREE,
+  FIELDS_COUNT
+};
+
+struct meminfo_key {
+  const char* name;
+  size_t length;
+};
+
+#define MEMINFO_KEY(_field, _name) \
+  [_field] = { .name = _name, .length = STATIC_STRLEN(_name) }
+
+static const struct meminfo_key g_keys[FIELDS_COUNT] = {
+  MEMINFO_KEY(FIELD_MEM_TOTAL,     "MemTotal:"),
+  MEMINFO_KEY(FIELD_MEM_AVAILABLE, "MemAvailable:"),
+  MEMINFO_KEY(FIELD_BUFFERS,       "Buffers:"),
+  MEMINFO_KEY(FIELD_CACHED,        "Cached:"),
+  MEMINFO_KEY(FIELD_SWAP_TOTAL,    "SwapTotal:"),
+  MEMINFO_KEY(FIELD_SWAP_FREE,     "SwapFree:"),
+};
+
+/* Where each field was found by the last full parse. The layout of
+ * /proc/meminfo only changes when a value grows past its column width, so
+ * later reads can jump straight to the fields.
+ */
+struct meminfo_offsets {
+  b8 valid;
+  u32 offsets[FIELDS_COUNT];
+};
+
+struct meminfo {
+  int fd;
+  struct meminfo_offsets cache;
+  u64 values[FIELDS_COUNT]; /* In kB */
+  char buffer[4096];
+};
+
+struct memory_instance {
+  struct list link;
+  const char* format;
+  char text[MEMORY_TEXT_SIZE];
+  struct module_instance* handle;
+  struct zone* zone;
+  struct color bg_color;
+  struct color fg_color;
+};
+
+static i64 g_task_id = -1;
+static struct meminfo g_meminfo = { .fd = -1 };
+static struct list g_instances = LIST_UNINITIALIZED;
+
+MODULE("memory", "markx86", "Display memory and swap usage.");
+
+/* Reads the fields at the cached offsets. Returns false if any of them
+ * moved, in which case a full parse is needed.
+ */
+static b8 parse_cached(struct meminfo* meminfo, size_t length) {
+  size_t i;
+  u32 offset;
+  const struct meminfo_key* key;
+
+  for (i = 0; i < FIELDS_COUNT; ++i) {
+    key = &g_keys[i];
+    offset = meminfo->cache.offsets[i];
+    if (offset + key->length > length ||
+        memcmp(&meminfo->buffer[offset], key->name, key->length) ||
+        parse_u64(&meminfo->buffer[offset + key->length],
+                  &meminfo->values[i]) == NULL)
+      return false;
+  }
+
+  return true;
+}
+
+static b8 parse_full(struct meminfo* meminfo, size_t length) {
+  size_t i, found;
+  const char *s, *e, *end;
+  const struct meminfo_key* key;
+
+  found = 0;
+  meminfo->cache.valid = false;
+
+  end = meminfo->buffer + length;
+  for (s = meminfo->buffer; s < end && found < FIELDS_COUNT; s = e + 1) {
+    e = memchr(s, '\n', end - s);
+    if (e == NULL)
+      e = end;
+
+    for (i = 0; i < FIELDS_COUNT; ++i) {
+      key = &g_keys[i];
+      if ((size_t)(e - s) <= key->length ||
+          memcmp(s, key->name, key->length))
+        continue;
+
+      if (parse_u64(s + key->length, &meminfo->values[i]) != NULL) {
+        meminfo->cache.offsets[i] = s - meminfo->buffer;
+        ++found;
+      }
+      break;
+    }
+  }
+
+  if (found < FIELDS_COUNT) {
+    module_error("could not find every field in '" MEMINFO_PATH "'");
+    return false;
+  }
+
+  meminfo->cache.valid = true;
+  return true;
+}
+
+static b8 parse_meminfo(struct meminfo* meminfo, size_t length) {
+  if (meminfo->cache.valid) {
+    if (parse_cached(meminfo, length))
+      return true;
+    module_trace("the layout of '" MEMINFO_PATH "' changed");
+  }
+
+  return parse_full(meminfo, length);
+}
+
+static b8 read_meminfo(struct meminfo* meminfo) {
+  ssize_t length;
+
+  length = pread(meminfo->fd, meminfo->buffer, sizeof(meminfo->buffer) - 1, 0);
+  if (length < 0) {
+    module_error("could not read from '" MEMINFO_PATH "': %m");
+    return false;
+  }
+  meminfo->buffer[length] = '\0';
+
+  return parse_meminfo(meminfo, length);
+}
+
+static inline f64 to_gb(u64 kb) {
+  return kb / KB_PER_GB;
+}
+
+static void get_formatted_text(char* buffer, size_t buffer_size,
+                               const char* format, const u64* values) {
+  u64 total, used, swap_total, swap_used;
+
+  total = values[FIELD_MEM_TOTAL];
+  used = total - min(values[FIELD_MEM_AVAILABLE], total);
+  swap_total = values[FIELD_SWAP_TOTAL];
+  swap_used = swap_total - min(values[FIELD_SWAP_FREE], swap_total);
+
+  FORMAT(buffer, buffer_size, format,
+         FORMAT_PARAM("total", FLOAT, to_gb(total)),
+         FORMAT_PARAM("used", FLOAT, to_gb(used)),
+         FORMAT_PARAM("available", FLOAT, to_gb(total - used)),
+         FORMAT_PARAM("cached", FLOAT,
+                      to_gb(values[FIELD_CACHED] + values[FIELD_BUFFERS])),
+         FORMAT_PARAM("used_percent", INTEGER,
+                      total > 0 ? used * 100 / total : 0),
+         FORMAT_PARAM("swap_total", FLOAT, to_gb(swap_total)),
+         FORMAT_PARAM("swap_used", FLOAT, to_gb(swap_used)));
+}
+
+/* Sized for all of the memory used as cache, the widest the values get */
+static size_t compute_width(const char* format) {
+  char buffer[MEMORY_TEXT_SIZE];
+  u64 values[FIELDS_COUNT];
+
+  values[FIELD_MEM_TOTAL] = g_meminfo.values[FIELD_MEM_TOTAL];
+  values[FIELD_MEM_AVAILABLE] = 0;
+  values[FIELD_BUFFERS] = 0;
+  values[FIELD_CACHED] = values[FIELD_MEM_TOTAL];
+  values[FIELD_SWAP_TOTAL] = g_meminfo.values[FIELD_SWAP_TOTAL];
+  values[FIELD_SWAP_FREE] = 0;
+
+  get_formatted_text(buffer, sizeof(buffer), format, values);
+  return font_string_width(buffer) + 8;
+}
+
+static b8 memory_update(void* instance_ptr) {
+  char buffer[MEMORY_TEXT_SIZE];
+  struct memory_instance* instance = instance_ptr;
+
+  get_formatted_text(buffer, sizeof(buffer), instance->format,
+                     g_meminfo.values);
+  if (!strcmp(buffer, instance->text))
+    return false;
+
+  memcpy(instance->text, buffer, sizeof(buffer));
+  return true;
+}
+
+static void memory_render(void* instance_ptr) {
+  struct draw* draw;
+  struct memory_instance* instance = instance_ptr;
+
+  draw_on_zone(instance->zone, draw) {
+    draw_rect(draw,
+              0, 0,
+              draw_width(draw), draw_height(draw),
+              instance->bg_color.as_u32);
+    draw_string(draw, 4, 0, instance->text, instance->fg_color.as_u32);
+  }
+}
+
+static void update_info(void) {
+  struct memory_instance* instance;
+
+  if (!read_meminfo(&g_meminfo))
+    return;
+
+  list_for_each(instance, &g_instances, link)
+    module_update(instance->handle);
+}
+
+static b8 meminfo_open(struct meminfo* meminfo) {
+  meminfo->fd = open(MEMINFO_PATH, O_RDONLY | O_CLOEXEC);
+  if (meminfo->fd < 0) {
+    module_error("could not open '" MEMINFO_PATH "': %m");
+    return false;
+  }
+
+  if (!read_meminfo(meminfo)) {
+    close(meminfo->fd);
+    meminfo->fd = -1;
+    return false;
+  }
+
+  return true;
+}
+
+static void meminfo_close(struct meminfo* meminfo) {
+  if (meminfo->fd >= 0)
+    close(meminfo->fd);
+  meminfo->fd = -1;
+  meminfo->cache.valid = false;
+}
+
+static void* memory_init(struct module_init_data* init_data) {
+  const char* format;
+  struct memory_instance* instance;
+
+  CONFIG_PARSE(init_data->config,
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("format"),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(format),
+      CONFIG_PARAM_DEFAULT(MEMORY_DEFAULT_FORMAT)
+    )
+  );
+
+  if (g_meminfo.fd < 0 && !meminfo_open(&g_meminfo))
+    return NULL;
+
+  instance = zalloc(sizeof(*instance));
+  ASSERT(instance != NULL);
+
+  instance->handle = init_data->handle;
+
+  instance->format = format;
+  instance->zone = bar_alloc_zone(init_data->position, compute_width(format));
+  instance->fg_color = init_data->foreground_color;
+  instance->bg_color = init_data->background_color;
+
+  if (!list_is_initialized(&g_instances))
+    list_init(&g_instances);
+  list_insert(&g_instances, &instance->link);
+
+  if (g_task_id < 0)
+    g_task_id = sched_task_interval(update_info, REFRESH_INTERVAL_MS, false);
+
+  return instance;
+}
+
+static void memory_cleanup(void* instance_ptr) {
+  struct memory_instance* instance = instance_ptr;
+
+  if (list_length(&g_instances) == 1) {
+    if (g_task_id >= 0)
+      sched_task_delete(g_task_id);
+    g_task_id = -1;
+    meminfo_close(&g_meminfo);
+  }
+
+  if (instance->zone != NULL)
+    bar_destroy_zone(&instance->zone);
+
+  list_remove(&instance->link);
+  free(instance);
+}
+
+MODULE_CALLBACKS(.init = memory_init,
+                 .update = memory_update,
+                 .render = memory_render,
+                 .cleanup = memory_cleanup);
@@ -0,0 +1,584 @@
+#include <gaybar/module.h>
+#include <gaybar/bar.h>
+#include <gaybar/util.h>
+#include <gaybar/draw.h>
+#include <gaybar/sched.h>
+#include <gaybar/font.h>
+#include <gaybar/format.h>
+#include <gaybar/stats.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#define REFRESH_INTERVAL_MS 1000
+
+/* A dump that got no answer for this many ticks is given up on */
+#define DUMP_TIMEOUT_TICKS 5
+
+#define NETWORK_MAX_LINKS 64
+
+#define NETWORK_DEFAULT_FORMAT "{name}: {state} RX {rx} TX {tx}"
+
+#define NETWORK_TEXT_SIZE 256
+
+/* Link changes, plus address changes so that {address} stays current */
+#define NETWORK_GROUPS \
+  (RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR)
+
+enum network_dump {
+  DUMP_NONE,
+  DUMP_LINKS,
+  DUMP_ADDRESSES
+};
+
+struct net_link {
+  i32 index; /* 0 if the slot is free */
+  b8 up;
+  b8 loopback;
+  b8 has_stats;
+  char name[IFNAMSIZ];
+  char address[INET6_ADDRSTRLEN];
+  u8 address_family;
+  u64 rx_bytes;
+  u64 tx_bytes;
+  u64 rx_rate; /* In bytes per second */
+  u64 tx_rate;
+  u64 sampled_ns;
+};
+
+/* Shared by every instance: the socket gets both the replies to our dumps
+ * and the multicast notifications, which carry the same messages.
+ */
+struct network {
+  int fd;
+  u32 seq;
+  enum network_dump pending;
+  u32 pending_seq;
+  size_t pending_ticks;
+  /* Set when a message was lost, the links are dumped again once the dump
+   * in progress is done.
+   */
+  b8 need_links;
+  b8 need_addresses;
+  u64 dump_ns;
+  struct net_link links[NETWORK_MAX_LINKS];
+};
+
+struct network_instance {
+  struct list link;
+  const char* interface; /* NULL picks the first link that is up */
+  const char* format;
+  char text[NETWORK_TEXT_SIZE];
+  struct module_instance* handle;
+  struct zone* zone;
+  struct color bg_color;
+  struct color fg_color;
+};
+
+static i64 g_task_id = -1;
+static struct network g_network = { .fd = -1 };
+static struct list g_instances = LIST_UNINITIALIZED;
+
+MODULE("network", "markx86", "Display network throughput and link state.");
+
+static struct net_link* find_link(struct network* network, i32 index,
+                                  b8 create) {
+  size_t i;
+  struct net_link* free_slot = NULL;
+
+  for (i = 0; i < ARRAY_LENGTH(network->links); ++i) {
+    if (network->links[i].index == index)
+      return &network->links[i];
+    if (free_slot == NULL && network->links[i].index == 0)
+      free_slot = &network->links[i];
+  }
+
+  if (!create || free_slot == NULL)
+    return NULL;
+
+  memset(free_slot, 0, sizeof(*free_slot));
+  free_slot->index = index;
+  return free_slot;
+}
+
+static void update_stats(struct net_link* link,
+                         const struct rtnl_link_stats64* stats, u64 now_ns) {
+  if (link->has_stats) {
+    link->rx_rate = rate_per_second(link->rx_bytes, stats->rx_bytes,
+                                    now_ns - link->sampled_ns);
+    link->tx_rate = rate_per_second(link->tx_bytes, stats->tx_bytes,
+                                    now_ns - link->sampled_ns);
+  }
+
+  link->rx_bytes = stats->rx_bytes;
+  link->tx_bytes = stats->tx_bytes;
+  link->sampled_ns = now_ns;
+  link->has_stats = true;
+}
+
+/* Returns true if something that is displayed changed */
+static b8 parse_link(struct network* network, const struct nlmsghdr* header,
+                     b8 from_dump) {
+  size_t length;
+  struct rtattr* attr;
+  struct net_link* link;
+  struct ifinfomsg* info;
+  const struct rtnl_link_stats64* stats = NULL;
+
+  info = NLMSG_DATA(header);
+  if (header->nlmsg_len < NLMSG_LENGTH(sizeof(*info)))
+    return false;
+
+  if (header->nlmsg_type == RTM_DELLINK) {
+    link = find_link(network, info->ifi_index, false);
+    if (link == NULL)
+      return false;
+    link->index = 0;
+    return true;
+  }
+
+  link = find_link(network, info->ifi_index, true);
+  if (link == NULL) {
+    module_warn_ratelimited("too many links, ignoring link %d",
+                            info->ifi_index);
+    return false;
+  }
+
+  link->loopback = (info->ifi_flags & IFF_LOOPBACK) != 0;
+  /* IFF_RUNNING follows the operational state, which is up once the
+   * carrier is, or unknown for drivers that don't track it.
+   */
+  link->up = (info->ifi_flags & IFF_UP) != 0 &&
+             (info->ifi_flags & IFF_RUNNING) != 0;
+
+  length = IFLA_PAYLOAD(header);
+  for (attr = IFLA_RTA(info); RTA_OK(attr, length);
+       attr = RTA_NEXT(attr, length)) {
+    switch (attr->rta_type) {
+      case IFLA_IFNAME:
+        snprintf(link->name, sizeof(link->name), "%.*s",
+                 (int)RTA_PAYLOAD(attr), (char*)RTA_DATA(attr));
+        break;
+      case IFLA_STATS64:
+        if (RTA_PAYLOAD(attr) >= sizeof(*stats))
+          stats = RTA_DATA(attr);
+        break;
+    }
+  }
+
+  /* Notifications carry stats too, but at random times: only the periodic
+   * dumps are used for the rates, so that they're averaged over a tick.
+   */
+  if (from_dump && stats != NULL)
+    update_stats(link, stats, network->dump_ns);
+
+  return true;
+}
+
+static b8 parse_address(struct network* network, const struct nlmsghdr* header) {
+  size_t length;
+  struct rtattr* attr;
+  struct net_link* link;
+  struct ifaddrmsg* info;
+  const void *local = NULL, *address = NULL;
+
+  info = NLMSG_DATA(header);
+  if (header->nlmsg_len < NLMSG_LENGTH(sizeof(*info)))
+    return false;
+
+  link = find_link(network, info->ifa_index, false);
+  if (link == NULL)
+    return false;
+
+  /* An IPv4 address is preferred over an IPv6 one */
+  if (link->address_family == AF_INET && info->ifa_family != AF_INET)
+    return false;
+  /* Link local IPv6 addresses are not interesting */
+  if (info->ifa_family == AF_INET6 && info->ifa_scope != RT_SCOPE_UNIVERSE)
+    return false;
+
+  length = IFA_PAYLOAD(header);
+  for (attr = IFA_RTA(info); RTA_OK(attr, length);
+       attr = RTA_NEXT(attr, length)) {
+    if (attr->rta_type == IFA_LOCAL)
+      local = RTA_DATA(attr);
+    else if (attr->rta_type == IFA_ADDRESS)
+      address = RTA_DATA(attr);
+  }
+
+  /* On point to point links IFA_ADDRESS is the other end */
+  if (local != NULL)
+    address = local;
+  if (address == NULL)
+    return false;
+
+  if (header->nlmsg_type == RTM_DELADDR) {
+    if (link->address_family != info->ifa_family)
+      return false;
+    link->address[0] = '\0';
+    link->address_family = 0;
+    /* Whatever address is left shows up with the next address dump */
+    network->need_addresses = true;
+    return true;
+  }
+
+  if (inet_ntop(info->ifa_family, address,
+                link->address, sizeof(link->address)) == NULL)
+    return false;
+  link->address_family = info->ifa_family;
+
+  return true;
+}
+
+/* Parses a datagram from the netlink socket. Returns true if something
+ * that is displayed changed.
+ */
+static b8 parse_messages(struct network* network, const void* buffer,
+                         size_t length) {
+  b8 changed, from_dump;
+  const struct nlmsghdr* header;
+
+  changed = false;
+  for (header = buffer; NLMSG_OK(header, length);
+       header = NLMSG_NEXT(header, length)) {
+    from_dump = network->pending != DUMP_NONE &&
+                header->nlmsg_seq == network->pending_seq;
+
+    switch (header->nlmsg_type) {
+      case NLMSG_DONE:
+        if (from_dump)
+          network->pending = DUMP_NONE;
+        break;
+      case NLMSG_ERROR:
+        if (from_dump) {
+          module_warn("netlink dump failed: %s",
+                      strerror(-((struct nlmsgerr*)NLMSG_DATA(header))->error));
+          network->pending = DUMP_NONE;
+        }
+        break;
+      case RTM_NEWLINK:
+      case RTM_DELLINK:
+        changed |= parse_link(network, header, from_dump);
+        break;
+      case RTM_NEWADDR:
+      case RTM_DELADDR:
+        changed |= parse_address(network, header);
+        break;
+    }
+  }
+
+  return changed;
+}
+
+static b8 request_dump(struct network* network, enum network_dump dump) {
+  struct {
+    struct nlmsghdr header;
+    struct rtgenmsg message;
+  } request = {
+    .header = {
+      .nlmsg_len = NLMSG_LENGTH(sizeof(struct rtgenmsg)),
+      .nlmsg_type = dump == DUMP_LINKS ? RTM_GETLINK : RTM_GETADDR,
+      .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+      .nlmsg_seq = ++network->seq
+    },
+    .message = {
+      .rtgen_family = AF_UNSPEC
+    }
+  };
+
+  if (send(network->fd, &request, request.header.nlmsg_len, 0) < 0) {
+    module_error("could not request netlink dump: %m");
+    return false;
+  }
+
+  network->pending = dump;
+  network->pending_seq = request.header.nlmsg_seq;
+  network->pending_ticks = 0;
+  if (dump == DUMP_LINKS) {
+    network->dump_ns = stats_now();
+    network->need_links = false;
+  } else
+    network->need_addresses = false;
+
+  return true;
+}
+
+static struct net_link* instance_link(struct network_instance* instance) {
+  size_t i;
+  struct net_link *link, *best = NULL;
+
+  for (i = 0; i < ARRAY_LENGTH(g_network.links); ++i) {
+    link = &g_network.links[i];
+    if (link->index == 0)
+      continue;
+
+    if (instance->interface != NULL) {
+      if (!strcmp(link->name, instance->interface))
+        return link;
+    } else if (link->up && !link->loopback &&
+               (best == NULL || link->index < best->index))
+      best = link;
+  }
+
+  return best;
+}
+
+static void get_formatted_text(char* buffer, size_t buffer_size,
+                               const char* format, const char* name,
+                               const char* state, const char* address,
+                               u64 rx_rate, u64 tx_rate) {
+  char rx[16], tx[16];
+
+  format_rate(rx, sizeof(rx), rx_rate);
+  format_rate(tx, sizeof(tx), tx_rate);
+
+  FORMAT(buffer, buffer_size, format,
+         FORMAT_PARAM("name", STRING, name),
+         FORMAT_PARAM("state", STRING, state),
+         FORMAT_PARAM("address", STRING, address),
+         FORMAT_PARAM("rx", STRING, rx),
+         FORMAT_PARAM("tx", STRING, tx));
+}
+
+/* Sized for a long interface name, a full IPv6 address and rates that
+ * take all of their digits.
+ */
+static size_t compute_width(struct network_instance* instance) {
+  char buffer[NETWORK_TEXT_SIZE];
+
+  get_formatted_text(buffer, sizeof(buffer), instance->format,
+                     instance->interface != NULL
+                       ? instance->interface : "wwwwwwwwwwwwwww",
+                     "down", "0000:0000:0000:0000:0000:0000:0000:0000",
+                     999 * 1024, 999 * 1024);
+  return font_string_width(buffer) + 8;
+}
+
+static b8 network_update(void* instance_ptr) {
+  char buffer[NETWORK_TEXT_SIZE];
+  struct net_link* link;
+  struct network_instance* instance = instance_ptr;
+
+  link = instance_link(instance);
+  if (link != NULL)
+    get_formatted_text(buffer, sizeof(buffer), instance->format,
+                       link->name, link->up ? "up" : "down", link->address,
+                       link->up ? link->rx_rate : 0,
+                       link->up ? link->tx_rate : 0);
+  else
+    get_formatted_text(buffer, sizeof(buffer), instance->format,
+                       instance->interface != NULL ? instance->interface : "-",
+                       "down", "", 0, 0);
+
+  if (!strcmp(buffer, instance->text))
+    return false;
+
+  memcpy(instance->text, buffer, sizeof(buffer));
+  return true;
+}
+
+static void network_render(void* instance_ptr) {
+  struct draw* draw;
+  struct network_instance* instance = instance_ptr;
+
+  draw_on_zone(instance->zone, draw) {
+    draw_rect(draw,
+              0, 0,
+              draw_width(draw), draw_height(draw),
+              instance->bg_color.as_u32);
+    draw_string(draw, 4, 0, instance->text, instance->fg_color.as_u32);
+  }
+}
+
+static void update_all(void) {
+  struct network_instance* instance;
+
+  list_for_each(instance, &g_instances, link)
+    module_update(instance->handle);
+}
+
+static void handle_messages(int fd, void* data) {
+  b8 changed;
+  ssize_t length;
+  socklen_t addr_length;
+  struct sockaddr_nl addr;
+  enum network_dump pending;
+  /* Dumps are sent in datagrams of up to a page, or 8K on big page systems */
+  u32 buffer[8192 / sizeof(u32)];
+
+  UNUSED(data);
+
+  changed = false;
+  for (;;) {
+    addr_length = sizeof(addr);
+    length = recvfrom(fd, buffer, sizeof(buffer), MSG_DONTWAIT | MSG_TRUNC,
+                      (struct sockaddr*)&addr, &addr_length);
+    if (length < 0)
+      break;
+    /* Only trust messages coming from the kernel */
+    if (addr.nl_pid != 0)
+      continue;
+
+    /* The rest of the datagram is gone, and with it whatever it said */
+    if ((size_t)length > sizeof(buffer)) {
+      module_warn_ratelimited("dropped a truncated netlink message");
+      g_network.need_links = true;
+      g_network.need_addresses = true;
+      continue;
+    }
+
+    pending = g_network.pending;
+    changed |= parse_messages(&g_network, buffer, length);
+
+    /* Addresses are only dumped after the links they belong to are known */
+    if (pending == DUMP_LINKS && g_network.pending == DUMP_NONE &&
+        g_network.need_addresses && !g_network.need_links)
+      request_dump(&g_network, DUMP_ADDRESSES);
+  }
+
+  /* The socket buffer overflowed and we lost some notifications, the next
+   * dump brings everything up to date.
+   */
+  if (errno == ENOBUFS) {
+    module_warn("netlink socket overrun, refreshing all links");
+    g_network.need_addresses = true;
+  }
+
+  if (g_network.need_links && g_network.pending == DUMP_NONE)
+    request_dump(&g_network, DUMP_LINKS);
+
+  if (changed)
+    update_all();
+}
+
+static void update_info(void) {
+  if (g_network.pending != DUMP_NONE &&
+      ++g_network.pending_ticks < DUMP_TIMEOUT_TICKS)
+    return;
+
+  if (g_network.pending != DUMP_NONE)
+    module_warn("netlink dump timed out");
+
+  request_dump(&g_network, DUMP_LINKS);
+}
+
+static b8 network_open(struct network* network) {
+  int buffer_size;
+  struct sockaddr_nl addr = {
+    .nl_family = AF_NETLINK,
+    .nl_pid = 0,
+    .nl_groups = NETWORK_GROUPS
+  };
+
+  network->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                       NETLINK_ROUTE);
+  if (network->fd < 0)
+    goto fail;
+
+  /* Bursts of notifications happen when a link goes up, with every address
+   * and route being announced at once.
+   */
+  buffer_size = 256 * 1024;
+  setsockopt(network->fd, SOL_SOCKET, SO_RCVBUF,
+             &buffer_size, sizeof(buffer_size));
+
+  if (bind(network->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+    goto fail;
+
+  network->pending = DUMP_NONE;
+  network->need_addresses = true;
+  memset(network->links, 0, sizeof(network->links));
+
+  sched_watch_fd(network->fd, handle_messages, NULL);
+  return true;
+
+fail:
+  module_error("could not open netlink socket: %m");
+  if (network->fd >= 0)
+    close(network->fd);
+  network->fd = -1;
+  return false;
+}
+
+static void network_close(struct network* network) {
+  if (network->fd >= 0) {
+    sched_unwatch_fd(network->fd);
+    close(network->fd);
+  }
+  network->fd = -1;
+}
+
+static void* network_init(struct module_init_data* init_data) {
+  const char* format;
+  const char* interface;
+  struct network_instance* instance;
+
+  CONFIG_PARSE(init_data->config,
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("interface"),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(interface),
+      CONFIG_PARAM_DEFAULT(NULL)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("format"),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(format),
+      CONFIG_PARAM_DEFAULT(NETWORK_DEFAULT_FORMAT)
+    )
+  );
+
+  if (g_network.fd < 0 && !network_open(&g_network))
+    return NULL;
+
+  instance = zalloc(sizeof(*instance));
+  ASSERT(instance != NULL);
+
+  instance->handle = init_data->handle;
+
+  instance->interface = interface;
+  instance->format = format;
+  instance->zone = bar_alloc_zone(init_data->position, compute_width(instance));
+  instance->fg_color = init_data->foreground_color;
+  instance->bg_color = init_data->background_color;
+
+  if (!list_is_initialized(&g_instances))
+    list_init(&g_instances);
+  list_insert(&g_instances, &instance->link);
+
+  if (g_task_id < 0)
+    g_task_id = sched_task_interval(update_info, REFRESH_INTERVAL_MS, true);
+
+  return instance;
+}
+
+static void network_cleanup(void* instance_ptr) {
+  struct network_instance* instance = instance_ptr;
+
+  if (list_length(&g_instances) == 1) {
+    if (g_task_id >= 0)
+      sched_task_delete(g_task_id);
+    g_task_id = -1;
+    network_close(&g_network);
+  }
+
+  if (instance->zone != NULL)
+    bar_destroy_zone(&instance->zone);
+
+  list_remove(&instance->link);
+  free(instance);
+}
+
+MODULE_CALLBACKS(.init = network_init,
+                 .update = network_update,
+                 .render = network_render,
+                 .cleanup = network_cleanup);
@@ -0,0 +1,482 @@
+#include <gaybar/module.h>
+#include <gaybar/bar.h>
+#include <gaybar/util.h>
+#include <gaybar/draw.h>
+#include <gaybar/sched.h>
+#include <gaybar/font.h>
+#include <gaybar/format.h>
+#include <gaybar/parse.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define HWMON_PATH "/sys/class/hwmon"
+
+#define REFRESH_INTERVAL_MS 2000
+
+#define THERMAL_MAX_SENSORS 64
+#define THERMAL_MAX_SELECTED 16
+
+#define THERMAL_DEFAULT_FORMAT         "TEMP: {temp}C"
+#define THERMAL_DEFAULT_WARNING        70
+#define THERMAL_DEFAULT_CRITICAL       90
+#define THERMAL_DEFAULT_WARNING_COLOR  "#FFA500"
+#define THERMAL_DEFAULT_CRITICAL_COLOR "#FF0000"
+
+#define THERMAL_TEXT_SIZE 128
+
+enum sensor_kind {
+  SENSOR_TEMP,
+  SENSOR_FAN
+};
+
+struct thermal_sensor {
+  int fd;
+  enum sensor_kind kind;
+  /* 'chip/label', or 'chip/temp1' for sensors without a label */
+  char name[64];
+  i64 value; /* In millidegrees Celsius or RPM */
+  b8 valid;
+};
+
+/* Discovered once, when the first instance is created. The inputs are kept
+ * open, so a tick is nothing but a pread(..) per sensor.
+ */
+struct thermal_sensors {
+  b8 discovered;
+  size_t count;
+  struct thermal_sensor sensors[THERMAL_MAX_SENSORS];
+};
+
+struct thermal_instance {
+  struct list link;
+  const char* format;
+  /* Indices in g_sensors, every sensor if there are none */
+  size_t selected_count;
+  u8 selected[THERMAL_MAX_SELECTED];
+  i64 warning;  /* In degrees Celsius */
+  i64 critical;
+  /* What is shown, and in which color */
+  char text[THERMAL_TEXT_SIZE];
+  struct color color;
+  struct module_instance* handle;
+  struct zone* zone;
+  struct color bg_color;
+  struct color fg_color;
+  struct color warning_color;
+  struct color critical_color;
+};
+
+static i64 g_task_id = -1;
+static struct thermal_sensors g_sensors;
+static struct list g_instances = LIST_UNINITIALIZED;
+
+MODULE("thermal", "markx86", "Display temperatures and fan speeds.");
+
+static b8 read_sensor(struct thermal_sensor* sensor) {
+  ssize_t length;
+  char buffer[32];
+
+  length = pread(sensor->fd, buffer, sizeof(buffer) - 1, 0);
+  if (length <= 0)
+    return false;
+  buffer[length] = '\0';
+
+  return parse_i64(buffer, &sensor->value) != NULL;
+}
+
+static void read_sensors(struct thermal_sensors* sensors) {
+  size_t i;
+  struct thermal_sensor* sensor;
+
+  for (i = 0; i < sensors->count; ++i) {
+    sensor = &sensors->sensors[i];
+    /* Some sensors fail while the device they're on is powered down */
+    sensor->valid = read_sensor(sensor);
+  }
+}
+
+/* Reads a short sysfs attribute, without the trailing newline */
+static b8 read_attribute(int dir_fd, const char* name,
+                         char* buffer, size_t buffer_size) {
+  int fd;
+  ssize_t length;
+
+  fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  length = read(fd, buffer, buffer_size - 1);
+  close(fd);
+  if (length <= 0)
+    return false;
+
+  buffer[length] = '\0';
+  buffer[strcspn(buffer, "\n")] = '\0';
+  return true;
+}
+
+static void add_sensor(struct thermal_sensors* sensors, int dir_fd,
+                       const char* chip, const char* input) {
+  int fd;
+  size_t prefix_length;
+  char label[32], attribute[64];
+  struct thermal_sensor* sensor;
+
+  if (sensors->count >= THERMAL_MAX_SENSORS) {
+    module_warn("only %d sensors are supported, ignoring %s/%s",
+                THERMAL_MAX_SENSORS, chip, input);
+    return;
+  }
+
+  fd = openat(dir_fd, input, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    module_warn("could not open '%s/%s': %m", chip, input);
+    return;
+  }
+
+  /* 'temp1_input' is labeled by 'temp1_label' */
+  prefix_length = strchr(input, '_') - input;
+  snprintf(attribute, sizeof(attribute), "%.*s_label",
+           (int)prefix_length, input);
+  if (!read_attribute(dir_fd, attribute, label, sizeof(label)))
+    snprintf(label, sizeof(label), "%.*s", (int)prefix_length, input);
+
+  sensor = &sensors->sensors[sensors->count++];
+  sensor->fd = fd;
+  sensor->kind = input[0] == 't' ? SENSOR_TEMP : SENSOR_FAN;
+  snprintf(sensor->name, sizeof(sensor->name), "%s/%s", chip, label);
+
+  module_trace("found sensor %s", sensor->name);
+}
+
+static b8 is_sensor_input(const char* name) {
+  size_t length;
+
+  if (!strncmp(name, "temp", 4))
+    name += 4;
+  else if (!strncmp(name, "fan", 3))
+    name += 3;
+  else
+    return false;
+
+  length = strspn(name, "0123456789");
+  return length > 0 && !strcmp(&name[length], "_input");
+}
+
+static void discover_chip(struct thermal_sensors* sensors, int hwmon_fd,
+                          const char* entry) {
+  int dir_fd;
+  DIR* dir;
+  struct dirent* dirent;
+  char chip[32];
+
+  dir_fd = openat(hwmon_fd, entry, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd < 0)
+    return;
+
+  if (!read_attribute(dir_fd, "name", chip, sizeof(chip)))
+    snprintf(chip, sizeof(chip), "%.*s", (int)sizeof(chip) - 1, entry);
+
+  dir = fdopendir(dir_fd);
+  if (dir == NULL) {
+    close(dir_fd);
+    return;
+  }
+
+  while ((dirent = readdir(dir)) != NULL) {
+    if (is_sensor_input(dirent->d_name))
+      add_sensor(sensors, dir_fd, chip, dirent->d_name);
+  }
+
+  closedir(dir);
+}
+
+static void discover_sensors(struct thermal_sensors* sensors) {
+  DIR* dir;
+  struct dirent* dirent;
+
+  sensors->discovered = true;
+  sensors->count = 0;
+
+  dir = opendir(HWMON_PATH);
+  if (dir == NULL) {
+    module_error("could not open '" HWMON_PATH "': %m");
+    return;
+  }
+
+  while ((dirent = readdir(dir)) != NULL) {
+    if (dirent->d_name[0] != '.')
+      discover_chip(sensors, dirfd(dir), dirent->d_name);
+  }
+
+  closedir(dir);
+
+  module_info("found %zu sensors", sensors->count);
+  read_sensors(sensors);
+}
+
+static void close_sensors(struct thermal_sensors* sensors) {
+  size_t i;
+
+  for (i = 0; i < sensors->count; ++i)
+    close(sensors->sensors[i].fd);
+  sensors->count = 0;
+  sensors->discovered = false;
+}
+
+static i64 find_sensor(const char* name) {
+  size_t i;
+
+  for (i = 0; i < g_sensors.count; ++i) {
+    if (!strcmp(g_sensors.sensors[i].name, name))
+      return i;
+  }
+
+  return -1;
+}
+
+/* The highest reading among the sensors of an instance, of the given kind.
+ * Returns false if there is none.
+ */
+static b8 max_reading(struct thermal_instance* instance,
+                      enum sensor_kind kind, i64* out) {
+  size_t i, count;
+  b8 found;
+  struct thermal_sensor* sensor;
+
+  found = false;
+  count = instance->selected_count > 0 ? instance->selected_count
+                                       : g_sensors.count;
+  for (i = 0; i < count; ++i) {
+    sensor = &g_sensors.sensors[instance->selected_count > 0
+                                  ? instance->selected[i] : i];
+    if (sensor->kind != kind || !sensor->valid)
+      continue;
+    if (!found || sensor->value > *out)
+      *out = sensor->value;
+    found = true;
+  }
+
+  return found;
+}
+
+static void get_formatted_text(char* buffer, size_t buffer_size,
+                               const char* format, i64 temp, i64 fan) {
+  FORMAT(buffer, buffer_size, format,
+         FORMAT_PARAM("temp", INTEGER, temp),
+         FORMAT_PARAM("fan", INTEGER, fan));
+}
+
+/* Sized for the most digits a temperature and a fan speed can have */
+static size_t compute_width(const char* format) {
+  char buffer[THERMAL_TEXT_SIZE];
+  get_formatted_text(buffer, sizeof(buffer), format, -100, 99999);
+  return font_string_width(buffer) + 8;
+}
+
+static b8 thermal_update(void* instance_ptr) {
+  i64 temp, fan;
+  char buffer[THERMAL_TEXT_SIZE];
+  struct color color;
+  struct thermal_instance* instance = instance_ptr;
+
+  if (!max_reading(instance, SENSOR_TEMP, &temp))
+    temp = 0;
+  if (!max_reading(instance, SENSOR_FAN, &fan))
+    fan = 0;
+  temp /= 1000;
+
+  get_formatted_text(buffer, sizeof(buffer), instance->format, temp, fan);
+
+  if (temp >= instance->critical)
+    color = instance->critical_color;
+  else if (temp >= instance->warning)
+    color = instance->warning_color;
+  else
+    color = instance->fg_color;
+
+  if (!strcmp(buffer, instance->text) &&
+      color.as_u32 == instance->color.as_u32)
+    return false;
+
+  memcpy(instance->text, buffer, sizeof(buffer));
+  instance->color = color;
+  return true;
+}
+
+static void thermal_render(void* instance_ptr) {
+  struct draw* draw;
+  struct thermal_instance* instance = instance_ptr;
+
+  draw_on_zone(instance->zone, draw) {
+    draw_rect(draw,
+              0, 0,
+              draw_width(draw), draw_height(draw),
+              instance->bg_color.as_u32);
+    draw_string(draw, 4, 0, instance->text, instance->color.as_u32);
+  }
+}
+
+static void update_info(void) {
+  struct thermal_instance* instance;
+
+  read_sensors(&g_sensors);
+
+  list_for_each(instance, &g_instances, link)
+    module_update(instance->handle);
+}
+
+/* The names of the sensors given in the config */
+struct sensor_names {
+  size_t count;
+  const char* names[THERMAL_MAX_SELECTED];
+};
+
+static void parse_sensor_name(size_t index, struct config_node* node,
+                              void* data) {
+  struct sensor_names* parsed = data;
+
+  if (index >= THERMAL_MAX_SELECTED) {
+    module_warn("only %d sensors can be shown by one widget",
+                THERMAL_MAX_SELECTED);
+    return;
+  }
+
+  CONFIG_PARSE(node,
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME(CONFIG_PARAM_SELF),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(parsed->names[index])
+    )
+  );
+  ASSERT(parsed->names[index] != NULL);
+
+  parsed->count = index + 1;
+}
+
+static void parse_threshold_color(const char* hex, struct color* color,
+                                  const char* fallback) {
+  if (!color_from_hex(hex, color))
+    color_from_hex(fallback, color);
+}
+
+static void select_sensors(struct thermal_instance* instance,
+                           const struct sensor_names* parsed) {
+  size_t i;
+  i64 index;
+
+  for (i = 0; i < parsed->count; ++i) {
+    index = find_sensor(parsed->names[i]);
+    if (index < 0)
+      module_warn("no sensor named '%s'", parsed->names[i]);
+    else
+      instance->selected[instance->selected_count++] = index;
+  }
+}
+
+static void* thermal_init(struct module_init_data* init_data) {
+  long warning, critical;
+  const char *format, *warning_color, *critical_color;
+  struct sensor_names parsed;
+  struct thermal_instance* instance;
+
+  parsed.count = 0;
+
+  CONFIG_PARSE(init_data->config,
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("sensors"),
+      CONFIG_PARAM_TYPE(ARRAY),
+      CONFIG_PARAM_STORE(parse_sensor_name),
+      CONFIG_PARAM_DATA(&parsed)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("format"),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(format),
+      CONFIG_PARAM_DEFAULT(THERMAL_DEFAULT_FORMAT)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("warning"),
+      CONFIG_PARAM_TYPE(INTEGER),
+      CONFIG_PARAM_STORE(warning),
+      CONFIG_PARAM_DEFAULT(THERMAL_DEFAULT_WARNING)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("critical"),
+      CONFIG_PARAM_TYPE(INTEGER),
+      CONFIG_PARAM_STORE(critical),
+      CONFIG_PARAM_DEFAULT(THERMAL_DEFAULT_CRITICAL)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("warning_color"),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(warning_color),
+      CONFIG_PARAM_DEFAULT(THERMAL_DEFAULT_WARNING_COLOR)
+    ),
+    CONFIG_PARAM(
+      CONFIG_PARAM_NAME("critical_color"),
+      CONFIG_PARAM_TYPE(STRING),
+      CONFIG_PARAM_STORE(critical_color),
+      CONFIG_PARAM_DEFAULT(THERMAL_DEFAULT_CRITICAL_COLOR)
+    )
+  );
+
+  if (!g_sensors.discovered)
+    discover_sensors(&g_sensors);
+
+  instance = zalloc(sizeof(*instance));
+  ASSERT(instance != NULL);
+
+  instance->handle = init_data->handle;
+
+  select_sensors(instance, &parsed);
+  if (parsed.count > 0 && instance->selected_count == 0)
+    module_warn("none of the configured sensors exist, showing all of them");
+
+  instance->format = format;
+  instance->warning = warning;
+  instance->critical = critical;
+  parse_threshold_color(warning_color, &instance->warning_color,
+                        THERMAL_DEFAULT_WARNING_COLOR);
+  parse_threshold_color(critical_color, &instance->critical_color,
+                        THERMAL_DEFAULT_CRITICAL_COLOR);
+
+  instance->zone = bar_alloc_zone(init_data->position, compute_width(format));
+  instance->fg_color = init_data->foreground_color;
+  instance->bg_color = init_data->background_color;
+
+  if (!list_is_initialized(&g_instances))
+    list_init(&g_instances);
+  list_insert(&g_instances, &instance->link);
+
+  if (g_task_id < 0)
+    g_task_id = sched_task_interval(update_info, REFRESH_INTERVAL_MS, false);
+
+  return instance;
+}
+
+static void thermal_cleanup(void* instance_ptr) {
+  struct thermal_instance* instance = instance_ptr;
+
+  if (list_length(&g_instances) == 1) {
+    if (g_task_id >= 0)
+      sched_task_delete(g_task_id);
+    g_task_id = -1;
+    close_sensors(&g_sensors);
+  }
+
+  if (instance->zone != NULL)
+    bar_destroy_zone(&instance->zone);
+
+  list_remove(&instance->link);
+  free(instance);
+}
+
+MODULE_CALLBACKS(.init = thermal_init,
+                 .update = thermal_update,
+                 .render = thermal_render,
+                 .cleanup = thermal_cleanup);
@@ -2,7 +2,11 @@
 #include <gaybar/assert.h>
 #include <gaybar/list.h>
 #include <gaybar/util.h>
+#include <gaybar/stats.h>
+#include <gaybar/trace.h>
+#include <gaybar/slab.h>
 
+#include <poll.h>
 #include <signal.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -14,13 +18,23 @@ struct task {
   struct timespec execute_time;
   size_t interval;
   task_t execute;
+  struct stats_histogram* stats;
 };
 
+struct watch {
+  int fd;
+  watch_t callback;
+  void* data;
+};
+
+static struct slab g_tasks = SLAB_INITIALIZER(struct task);
 static struct list g_task_list;
 static struct list g_task_queue;
 static timer_t g_timer;
 static b8 g_timer_expired;
 static u64 g_next_id;
+static struct watch g_watches[SCHED_MAX_WATCHES];
+static size_t g_watches_count;
 
 static void alrm_handler(int signo) {
   ASSERT(signo == SIGALRM);
@@ -54,7 +68,7 @@ static void set_alarm_for(struct timespec* timestamp) {
 
 static void task_destroy(struct task* task) {
   list_remove(&task->link);
-  free(task);
+  slab_free(&g_tasks, task);
 }
 
 static void task_enqueue(struct task* task) {
@@ -69,6 +83,7 @@ void sched_init(void) {
   set_alrm_handler();
   g_timer_expired = true;
   g_next_id = 0;
+  g_watches_count = 0;
 }
 
 void sched_cleanup(void) {
@@ -80,6 +95,9 @@ void sched_cleanup(void) {
   list_for_each_safe(task, task_next, &g_task_queue, link)
     task_destroy(task);
 
+  slab_destroy(&g_tasks);
+  g_watches_count = 0;
+
   restore_alrm_handler();
 }
 
@@ -141,21 +159,33 @@ static void get_execute_time(struct timespec* timespec, size_t delay_ms) {
 }
 
 void sched_queue_run(void) {
+  u64 queue_start, queue_end, task_start, task_end;
   struct task *task, *task_next;
 
   if (!g_timer_expired || list_empty(&g_task_queue))
     return;
 
+  queue_start = stats_now();
+
   list_for_each_safe(task, task_next, &g_task_queue, link) {
     list_remove(&task->link);
+    task_start = stats_now();
     task->execute();
+    task_end = stats_now();
+    if (task->stats != NULL)
+      stats_record(task->stats, task_start, task_end);
+    trace_span("sched", "task", task->id, task_start, task_end);
     if (task->interval == 0)
-      free(task);
+      slab_free(&g_tasks, task);
     else {
       get_execute_time(&task->execute_time, task->interval);
       list_insert(&g_task_list, &task->link);
     }
   }
+
+  queue_end = stats_now();
+  stats_record_timer(STATS_TIMER_TASKS, queue_start, queue_end);
+  trace_span("sched", "sched_queue_run", TRACE_NO_ID, queue_start, queue_end);
 }
 
 static u64 create_task(task_t task, size_t interval_ms, size_t delay_ms) {
@@ -167,12 +197,12 @@ static u64 create_task(task_t task, size_t interval_ms, size_t delay_ms) {
     return g_next_id++;
   }
 
-  task_struct = malloc(sizeof(*task_struct));
-  ASSERT(task_struct != NULL);
+  task_struct = slab_alloc(&g_tasks);
 
   task_struct->id = g_next_id++;
   task_struct->execute = task;
   task_struct->interval = interval_ms;
+  task_struct->stats = stats_get_current();
 
   /* If a task has a 0ms delay, execute it immediately. */
   if (delay_ms == 0) {
@@ -213,3 +243,66 @@ void sched_task_delete(u64 id) {
 task_found:
   task_destroy(task);
 }
+
+static struct watch* find_watch(int fd) {
+  size_t i;
+  for (i = 0; i < g_watches_count; ++i) {
+    if (g_watches[i].fd == fd)
+      return &g_watches[i];
+  }
+  return NULL;
+}
+
+void sched_watch_fd(int fd, watch_t callback, void* data) {
+  struct watch* watch;
+
+  ASSERT(fd >= 0);
+  ASSERT(callback != NULL);
+
+  watch = find_watch(fd);
+  if (watch == NULL) {
+    if (g_watches_count >= ARRAY_LENGTH(g_watches))
+      log_fatal("too many watched file descriptors (max %d)",
+                SCHED_MAX_WATCHES);
+    watch = &g_watches[g_watches_count++];
+  }
+
+  watch->fd = fd;
+  watch->callback = callback;
+  watch->data = data;
+}
+
+void sched_unwatch_fd(int fd) {
+  struct watch* watch = find_watch(fd);
+  if (watch != NULL)
+    /* Keep the array packed by moving the last watch in the hole */
+    *watch = g_watches[--g_watches_count];
+}
+
+size_t sched_watch_pollfds(struct pollfd* pfds, size_t max) {
+  size_t i;
+
+  ASSERT(g_watches_count <= max);
+
+  for (i = 0; i < g_watches_count; ++i) {
+    pfds[i].fd = g_watches[i].fd;
+    pfds[i].events = POLLIN;
+    pfds[i].revents = 0;
+  }
+
+  return g_watches_count;
+}
+
+void sched_watch_dispatch(struct pollfd* pfds, size_t n) {
+  size_t i;
+  struct watch* watch;
+
+  for (i = 0; i < n; ++i) {
+    if (pfds[i].revents == 0)
+      continue;
+    /* Callbacks may (un)watch descriptors, so look the watch up every time */
+    watch = find_watch(pfds[i].fd);
+    if (watch != NULL)
+      watch->callback(watch->fd, watch->data);
+  }
+}
@@ -0,0 +1,94 @@
+#include <gaybar/slab.h>
+#include <gaybar/util.h>
+#include <gaybar/assert.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Enough for any type the bar puts in a slab */
+#define SLAB_ALIGN 16
+
+struct slab_page {
+  struct slab_page* next;
+};
+
+/* The objects of a page start after its header */
+#define PAGE_HEADER_SIZE \
+  ((sizeof(struct slab_page) + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1))
+
+static size_t stride(struct slab* slab) {
+  size_t size;
+
+  size = max(slab->object_size, sizeof(void*));
+  return (size + SLAB_ALIGN - 1) & ~(size_t)(SLAB_ALIGN - 1);
+}
+
+static void add_page(struct slab* slab) {
+  u8* objects;
+  size_t i, count, object_stride;
+  struct slab_page* page;
+
+  object_stride = stride(slab);
+  count = max((SLAB_PAGE_SIZE - PAGE_HEADER_SIZE) / object_stride, 1);
+
+  page = malloc(PAGE_HEADER_SIZE + count * object_stride);
+  ASSERT(page != NULL);
+  page->next = slab->pages;
+  slab->pages = page;
+
+  /* Link the objects so they come out in address order */
+  objects = (u8*)page + PAGE_HEADER_SIZE;
+  for (i = count; i-- > 0;) {
+    *(void**)&objects[i * object_stride] = slab->free_objects;
+    slab->free_objects = &objects[i * object_stride];
+  }
+}
+
+void slab_init(struct slab* slab, size_t object_size) {
+  ASSERT(slab != NULL);
+  ASSERT(object_size > 0);
+
+  slab->object_size = object_size;
+  slab->free_objects = NULL;
+  slab->pages = NULL;
+}
+
+void slab_destroy(struct slab* slab) {
+  struct slab_page *page, *next_page;
+
+  ASSERT(slab != NULL);
+
+  for (page = slab->pages; page != NULL; page = next_page) {
+    next_page = page->next;
+    free(page);
+  }
+
+  slab->free_objects = NULL;
+  slab->pages = NULL;
+}
+
+void* slab_alloc(struct slab* slab) {
+  void* object;
+
+  ASSERT(slab != NULL);
+  ASSERT(slab->object_size > 0);
+
+  if (slab->free_objects == NULL)
+    add_page(slab);
+
+  object = slab->free_objects;
+  slab->free_objects = *(void**)object;
+
+  memset(object, 0, slab->object_size);
+  return object;
+}
+
+void slab_free(struct slab* slab, void* object) {
+  ASSERT(slab != NULL);
+
+  if (object == NULL)
+    return;
+
+  *(void**)object = slab->free_objects;
+  slab->free_objects = object;
+}
@@ -0,0 +1,255 @@
+#include <gaybar/stats.h>
+#include <gaybar/module.h>
+#include <gaybar/list.h>
+#include <gaybar/log.h>
+#include <gaybar/util.h>
+#include <gaybar/assert.h>
+#include <gaybar/compiler.h>
+
+#include <cJSON/cJSON.h>
+
+#include <signal.h>
+#include <stdio.h>
+
+#define RATE_WINDOW_NS 1000000000ULL
+
+struct stats_rate {
+  u64 total;
+  u64 window_total;
+  f64 per_second;
+};
+
+struct stats {
+  u64 start_ns;
+  u64 window_start_ns;
+  struct stats_histogram timers[STATS_TIMER_MAX];
+  struct stats_rate counters[STATS_COUNTER_MAX];
+  struct stats_histogram* current;
+};
+
+static struct stats g_stats;
+static b8 g_dump_requested;
+
+static const char* g_timer_names[] = {
+  [STATS_TIMER_FRAME]  = "frame",
+  [STATS_TIMER_RENDER] = "render",
+  [STATS_TIMER_COMMIT] = "commit",
+  [STATS_TIMER_TASKS]  = "tasks"
+};
+STATIC_ASSERT(ARRAY_LENGTH(g_timer_names) == STATS_TIMER_MAX);
+
+static const char* g_counter_names[] = {
+  [STATS_COUNTER_WAKEUPS] = "wakeups",
+  [STATS_COUNTER_COMMITS] = "commits"
+};
+STATIC_ASSERT(ARRAY_LENGTH(g_counter_names) == STATS_COUNTER_MAX);
+
+static void usr1_handler(int signo) {
+  ASSERT(signo == SIGUSR1);
+  g_dump_requested = true;
+}
+
+static void set_usr1_handler(void) {
+  struct sigaction sigact;
+  sigact.sa_flags = 0;
+  sigact.sa_handler = &usr1_handler;
+  sigemptyset(&sigact.sa_mask);
+  ASSERT(sigaction(SIGUSR1, &sigact, NULL) == 0);
+}
+
+static void restore_usr1_handler(void) {
+  struct sigaction sigact;
+  sigact.sa_flags = 0;
+  sigact.sa_handler = SIG_DFL;
+  sigemptyset(&sigact.sa_mask);
+  ASSERT(sigaction(SIGUSR1, &sigact, NULL) == 0);
+}
+
+static inline size_t bucket_index(u64 ns) {
+  if (ns == 0)
+    return 0;
+  return min(63 - __builtin_clzll(ns), STATS_HISTOGRAM_BUCKETS - 1);
+}
+
+void stats_record(struct stats_histogram* histogram, u64 start_ns, u64 end_ns) {
+  u64 ns = end_ns - start_ns;
+
+  ASSERT(histogram != NULL);
+
+  ++histogram->count;
+  ++histogram->buckets[bucket_index(ns)];
+  histogram->total_ns += ns;
+  if (ns > histogram->max_ns)
+    histogram->max_ns = ns;
+}
+
+void stats_record_timer(enum stats_timer timer, u64 start_ns, u64 end_ns) {
+  ASSERT(timer < STATS_TIMER_MAX);
+  stats_record(&g_stats.timers[timer], start_ns, end_ns);
+}
+
+void stats_count(enum stats_counter counter) {
+  ASSERT(counter < STATS_COUNTER_MAX);
+  ++g_stats.counters[counter].total;
+}
+
+void stats_set_current(struct stats_histogram* histogram) {
+  g_stats.current = histogram;
+}
+
+struct stats_histogram* stats_get_current(void) {
+  return g_stats.current;
+}
+
+/* Returns an upper bound for the given percentile */
+static u64 histogram_percentile(struct stats_histogram* histogram,
+                                u64 percent) {
+  size_t i;
+  u64 seen, target;
+
+  if (histogram->count == 0)
+    return 0;
+
+  seen = 0;
+  target = (histogram->count * percent + 99) / 100;
+  for (i = 0; i < STATS_HISTOGRAM_BUCKETS - 1; ++i) {
+    seen += histogram->buckets[i];
+    if (seen >= target)
+      return min(2ULL << i, histogram->max_ns);
+  }
+
+  return histogram->max_ns;
+}
+
+static inline u64 histogram_average(struct stats_histogram* histogram) {
+  return histogram->count == 0 ? 0 : histogram->total_ns / histogram->count;
+}
+
+static void log_histogram(const char* name,
+                          struct stats_histogram* histogram) {
+  log_info("stats: %-24s n=%lu avg=%luns p50<=%luns p99<=%luns max=%luns",
+           name, histogram->count, histogram_average(histogram),
+           histogram_percentile(histogram, 50),
+           histogram_percentile(histogram, 99),
+           histogram->max_ns);
+}
+
+static void dump_to_log(void) {
+  size_t i;
+  char name[64];
+  struct module* module;
+
+  log_info("stats: uptime %.1fs",
+           (f64)(stats_now() - g_stats.start_ns) / 1e9);
+
+  for (i = 0; i < STATS_COUNTER_MAX; ++i)
+    log_info("stats: %-24s total=%lu rate=%.2f/s", g_counter_names[i],
+             g_stats.counters[i].total, g_stats.counters[i].per_second);
+
+  for (i = 0; i < STATS_TIMER_MAX; ++i)
+    log_histogram(g_timer_names[i], &g_stats.timers[i]);
+
+  if (!list_is_initialized(&g_modules))
+    return;
+
+  list_for_each(module, &g_modules, link) {
+    snprintf(name, sizeof(name), "%s.update", module->name);
+    log_histogram(name, &module->stats.update);
+    snprintf(name, sizeof(name), "%s.render", module->name);
+    log_histogram(name, &module->stats.render);
+  }
+}
+
+void stats_wakeup(void) {
+  size_t i;
+  u64 now, elapsed;
+  struct stats_rate* rate;
+
+  stats_count(STATS_COUNTER_WAKEUPS);
+
+  now = stats_now();
+  elapsed = now - g_stats.window_start_ns;
+  if (elapsed >= RATE_WINDOW_NS) {
+    for (i = 0; i < STATS_COUNTER_MAX; ++i) {
+      rate = &g_stats.counters[i];
+      rate->per_second = (f64)(rate->total - rate->window_total) * 1e9
+                         / elapsed;
+      rate->window_total = rate->total;
+    }
+    g_stats.window_start_ns = now;
+  }
+
+  if (g_dump_requested) {
+    g_dump_requested = false;
+    dump_to_log();
+  }
+}
+
+static cJSON* histogram_to_json(struct stats_histogram* histogram) {
+  size_t i;
+  cJSON *json, *buckets;
+
+  json = cJSON_CreateObject();
+  cJSON_AddNumberToObject(json, "count", histogram->count);
+  cJSON_AddNumberToObject(json, "total_ns", histogram->total_ns);
+  cJSON_AddNumberToObject(json, "avg_ns", histogram_average(histogram));
+  cJSON_AddNumberToObject(json, "p50_ns", histogram_percentile(histogram, 50));
+  cJSON_AddNumberToObject(json, "p99_ns", histogram_percentile(histogram, 99));
+  cJSON_AddNumberToObject(json, "max_ns", histogram->max_ns);
+
+  buckets = cJSON_AddArrayToObject(json, "buckets");
+  for (i = 0; i < STATS_HISTOGRAM_BUCKETS; ++i)
+    cJSON_AddItemToArray(buckets, cJSON_CreateNumber(histogram->buckets[i]));
+
+  return json;
+}
+
+char* stats_to_json(void) {
+  size_t i;
+  char* string;
+  cJSON *root, *counters, *counter, *timers, *modules, *module_json;
+  struct module* module;
+
+  root = cJSON_CreateObject();
+  if (root == NULL)
+    return NULL;
+
+  cJSON_AddNumberToObject(root, "uptime_ns", stats_now() - g_stats.start_ns);
+
+  counters = cJSON_AddObjectToObject(root, "counters");
+  for (i = 0; i < STATS_COUNTER_MAX; ++i) {
+    counter = cJSON_AddObjectToObject(counters, g_counter_names[i]);
+    cJSON_AddNumberToObject(counter, "total", g_stats.counters[i].total);
+    cJSON_AddNumberToObject(counter, "per_second",
+                            g_stats.counters[i].per_second);
+  }
+
+  timers = cJSON_AddObjectToObject(root, "timers");
+  for (i = 0; i < STATS_TIMER_MAX; ++i)
+    cJSON_AddItemToObject(timers, g_timer_names[i],
+                          histogram_to_json(&g_stats.timers[i]));
+
+  modules = cJSON_AddObjectToObject(root, "modules");
+  if (list_is_initialized(&g_modules)) {
+    list_for_each(module, &g_modules, link) {
+      module_json = cJSON_AddObjectToObject(modules, module->name);
+      cJSON_AddItemToObject(module_json, "update",
+                            histogram_to_json(&module->stats.update));
+      cJSON_AddItemToObject(module_json, "render",
+                            histogram_to_json(&module->stats.render));
+    }
+  }
+
+  string = cJSON_PrintUnformatted(root);
+  cJSON_Delete(root);
+  return string;
+}
+
+void stats_init(void) {
+  g_stats.start_ns = g_stats.window_start_ns = stats_now();
+  set_usr1_handler();
+}
+
+void stats_cleanup(void) {
+  restore_usr1_handler();
+}
@@ -0,0 +1,221 @@
+#include <gaybar/trace.h>
+#include <gaybar/params.h>
+#include <gaybar/log.h>
+#include <gaybar/util.h>
+#include <gaybar/assert.h>
+#include <gaybar/compiler.h>
+#include <gaybar/thread.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TRACE_RING_SIZE         16384 /* Must be a power of two */
+#define TRACE_FLUSH_INTERVAL_MS 50
+
+STATIC_ASSERT((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0);
+
+enum trace_event_type {
+  TRACE_EVENT_SPAN,
+  TRACE_EVENT_INSTANT
+};
+
+struct trace_event {
+  enum trace_event_type type;
+  const char* category;
+  const char* name;
+  u64 id;
+  u64 start_ns;
+  u64 end_ns;
+};
+
+/* Single producer (the main thread), single consumer (the writer thread) */
+struct trace_ring {
+  struct trace_event events[TRACE_RING_SIZE];
+  u64 head;
+  u64 tail;
+  u64 dropped;
+};
+
+struct trace {
+  FILE* file;
+  struct trace_ring* ring;
+  pthread_t writer;
+  b8 stop;
+  int pid;
+};
+
+b8 g_trace_enabled = false;
+static struct trace g_trace;
+
+static struct trace_event* ring_reserve(void) {
+  u64 head, tail;
+  struct trace_ring* ring = g_trace.ring;
+
+  head = ring->head;
+  tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+  if (head - tail >= TRACE_RING_SIZE) {
+    /* Never wait for the writer, drop the event instead */
+    __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+
+  return &ring->events[head & (TRACE_RING_SIZE - 1)];
+}
+
+static void ring_commit(void) {
+  struct trace_ring* ring = g_trace.ring;
+  __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+void _trace_span(const char* category, const char* name, u64 id,
+                 u64 start_ns, u64 end_ns) {
+  struct trace_event* event = ring_reserve();
+  if (event == NULL)
+    return;
+
+  event->type = TRACE_EVENT_SPAN;
+  event->category = category;
+  event->name = name;
+  event->id = id;
+  event->start_ns = start_ns;
+  event->end_ns = end_ns;
+
+  ring_commit();
+}
+
+void _trace_instant(const char* category, const char* name, u64 id) {
+  struct trace_event* event = ring_reserve();
+  if (event == NULL)
+    return;
+
+  event->type = TRACE_EVENT_INSTANT;
+  event->category = category;
+  event->name = name;
+  event->id = id;
+  event->start_ns = event->end_ns = stats_now();
+
+  ring_commit();
+}
+
+/* Chrome trace timestamps are in microseconds */
+#define US_FMT "%lu.%03lu"
+#define US(ns) (ns) / 1000, (ns) % 1000
+
+static void write_event(struct trace_event* event) {
+  FILE* file = g_trace.file;
+
+  fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"pid\":%d,\"tid\":%d,"
+                "\"ts\":" US_FMT,
+          event->name, event->category, g_trace.pid, g_trace.pid,
+          US(event->start_ns));
+
+  if (event->type == TRACE_EVENT_SPAN)
+    fprintf(file, ",\"ph\":\"X\",\"dur\":" US_FMT,
+            US(event->end_ns - event->start_ns));
+  else
+    fputs(",\"ph\":\"i\",\"s\":\"t\"", file);
+
+  if (event->id != TRACE_NO_ID)
+    fprintf(file, ",\"args\":{\"id\":%lu}", event->id);
+
+  fputc('}', file);
+}
+
+static void drain_ring(void) {
+  u64 head, tail;
+  struct trace_ring* ring = g_trace.ring;
+
+  head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  for (tail = ring->tail; tail != head; ++tail)
+    write_event(&ring->events[tail & (TRACE_RING_SIZE - 1)]);
+  __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+
+  fflush(g_trace.file);
+}
+
+static void* writer_main(void* arg) {
+  const struct timespec interval = {
+    .tv_sec = 0,
+    .tv_nsec = TRACE_FLUSH_INTERVAL_MS * 1000000L
+  };
+
+  UNUSED(arg);
+
+  while (!__atomic_load_n(&g_trace.stop, __ATOMIC_ACQUIRE)) {
+    drain_ring();
+    nanosleep(&interval, NULL);
+  }
+  drain_ring();
+
+  return NULL;
+}
+
+static b8 start_writer(void) {
+  int rc = thread_spawn(&g_trace.writer, writer_main, NULL);
+  if (rc != 0) {
+    log_error("could not start trace writer: %s", strerror(rc));
+    return false;
+  }
+
+  return true;
+}
+
+void trace_init(void) {
+  const char* path;
+
+  path = g_params.trace_file != NULL ? g_params.trace_file
+                                     : param_env("TRACE");
+  if (path == NULL || *path == '\0')
+    return;
+
+  g_trace.file = fopen(path, "w");
+  if (g_trace.file == NULL) {
+    log_error("could not open trace file '%s': %m", path);
+    return;
+  }
+
+  g_trace.ring = zalloc(sizeof(*g_trace.ring));
+  ASSERT(g_trace.ring != NULL);
+
+  g_trace.pid = getpid();
+  g_trace.stop = false;
+
+  /* Every other event is written with a leading comma, so that the file is
+   * a valid JSON array once closed. Perfetto loads unterminated arrays too.
+   */
+  fprintf(g_trace.file,
+          "[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+          "\"args\":{\"name\":\"gaybar\"}}",
+          g_trace.pid);
+
+  if (!start_writer()) {
+    fclose(g_trace.file);
+    free(g_trace.ring);
+    return;
+  }
+
+  g_trace_enabled = true;
+  log_info("writing trace to '%s'", path);
+}
+
+void trace_cleanup(void) {
+  u64 dropped;
+
+  if (!g_trace_enabled)
+    return;
+
+  g_trace_enabled = false;
+  __atomic_store_n(&g_trace.stop, true, __ATOMIC_RELEASE);
+  pthread_join(g_trace.writer, NULL);
+
+  fputs("\n]\n", g_trace.file);
+  fclose(g_trace.file);
+
+  dropped = __atomic_load_n(&g_trace.ring->dropped, __ATOMIC_RELAXED);
+  if (dropped > 0)
+    log_warn("%lu trace events were dropped", dropped);
+
+  free(g_trace.ring);
+}
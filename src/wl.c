@@ -5,6 +5,10 @@
 #include <gaybar/list.h>
 #include <gaybar/assert.h>
 #include <gaybar/compiler.h>
+#include <gaybar/draw.h>
+#include <gaybar/sched.h>
+#include <gaybar/stats.h>
+#include <gaybar/trace.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -54,6 +58,8 @@ struct wl {
   struct list outputs;
   u32 output_format;
   b8 init_done, can_draw;
+  /* Zones are laid out along the y axis */
+  b8 vertical;
 };
 
 struct wl g_wl = {0};
@@ -282,6 +288,7 @@ static void wl_callback_frame_handle_done(void* data,
   struct output* output = data;
   ASSERT(wl_callback == output->wl_callback);
   UNUSED(timestamp);
+  trace_instant("wayland", "frame_done", output->id);
   /* Clear the callback */
   wl_callback_destroy(wl_callback);
   output->wl_callback = NULL;
@@ -300,6 +307,8 @@ static void request_frame(struct output* output) {
   wl_callback_add_listener(output->wl_callback, &g_wl_callback_frame_listener,
                            output);
   wl_surface_commit(output->wl_surface);
+  stats_count(STATS_COUNTER_COMMITS);
+  trace_instant("wayland", "wl_surface_commit", output->id);
   /* When a frame has been requested, we can't draw */
   output->frame_done = false;
 }
@@ -322,15 +331,12 @@ static void init_output(struct output* output) {
     return;
   }
 
-  /* Compute bar size
-   *
-   * NOTE: Here we are assuming the bar is in an horizontal position
-   *       (i.e. anchored to the top or bottom of the screen). If we ever want
-   *       to support vertical bars (anchored to the left or right of the
-   *       screen), we will need to check whether the bar is vertical or
-   *       horizonal and compute the surface width and height accordingly.
-   */
-  {
+  /* Compute bar size */
+  if (g_wl.vertical) {
+    ASSERT(bar_thickness < output->width);
+    initial_width = bar_thickness;
+    initial_height = output->height;
+  } else {
     ASSERT(bar_thickness < output->height);
     initial_width = output->width;
     initial_height = bar_thickness;
@@ -464,6 +470,8 @@ position_to_anchor(enum bar_position position) {
   switch (position) {
     CASE(BOTTOM);
     CASE(TOP);
+    CASE(LEFT);
+    CASE(RIGHT);
     default:
       log_fatal("invalid bar position #%d", position);
   }
@@ -498,6 +506,7 @@ int wl_init(void) {
   set_int_handler();
 
   g_wl.anchor = position_to_anchor(bar_get_position());
+  g_wl.vertical = bar_is_vertical();
 
   /* Set invalid output format */
   g_wl.output_format = -1;
@@ -577,9 +586,12 @@ int wl_init(void) {
 
 int wl_should_close(void) {
   int rc;
-  struct pollfd pfd = {
-    .fd = wl_display_get_fd(g_wl.wl_display),
-    .events = POLLIN
+  size_t n_watches;
+  struct pollfd pfds[1 + SCHED_MAX_WATCHES] = {
+    {
+      .fd = wl_display_get_fd(g_wl.wl_display),
+      .events = POLLIN
+    }
   };
 
   /* NOTE: This is a very complicated loop to achieve what
@@ -591,15 +603,16 @@ int wl_should_close(void) {
   /* Send all buffered requests to the compositor */
   wl_display_flush(g_wl.wl_display);
 
-  /* Poll for events from the compositor */
-  rc = poll(&pfd, 1, -1);
+  /* Poll for events from the compositor and the watched file descriptors */
+  n_watches = sched_watch_pollfds(&pfds[1], ARRAY_LENGTH(pfds) - 1);
+  rc = poll(pfds, 1 + n_watches, -1);
   /* Check for errors */
   g_should_close |= rc < 0 && errno != EINTR;
-  g_should_close |= (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) != 0;
+  g_should_close |= (pfds[0].revents & (POLLERR | POLLHUP | POLLNVAL)) != 0;
   if (g_should_close)
     goto out;
   /* Check for events */
-  else if (pfd.revents & POLLIN) {
+  else if (pfds[0].revents & POLLIN) {
     ASSERT(wl_display_prepare_read(g_wl.wl_display) == 0);
     wl_display_read_events(g_wl.wl_display);
 
@@ -612,16 +625,25 @@ int wl_should_close(void) {
     }
   }
 
+  sched_watch_dispatch(&pfds[1], n_watches);
+
 out:
   return g_should_close;
 }
 
-b8 wl_draw_begin(void) {
+b8 wl_frame_ready(void) {
   struct output* output;
   list_for_each(output, &g_wl.outputs, link) {
     if (!output->frame_done)
       return false;
   }
+  return true;
+}
+
+b8 wl_draw_begin(void) {
+  struct output* output;
+  if (!wl_frame_ready())
+    return false;
   list_for_each(output, &g_wl.outputs, link) {
     if (output->wl_surface == NULL || output->wl_buffer == NULL) {
       log_warn("output %s (id: %u) has not been initialized",
@@ -669,81 +691,78 @@ void wl_cleanup(void) {
   restore_int_handler();
 }
 
-static void fill_buffer_region(u32 src_x, u32 src_y,
-                               u32 dst_x, u32 dst_y,
-                               u32 width, u32 height,
-                               u32* src, u32 src_stride,
-                               u32* dst, u32 dst_stride) {
-  size_t i_src, i_dst;
-  size_t w, h;
-
-  i_src = src_y * src_stride + src_x;
-  i_dst = dst_y * dst_stride + dst_x;
-
-  /* NOTE: Drawing is done on the CPU, and is very slow.
-   *       Call this function sparingly.
-   */
-  for (h = 0; h < height; ++h) {
-    for (w = 0; w < width; ++w)
-      dst[i_dst + w] = src[i_src + w];
-    i_src += src_stride;
-    i_dst += dst_stride;
-  }
+/* The length of the bar on the output, along which zones are laid out */
+static inline u32 get_length(struct output* output) {
+  return g_wl.vertical ? output->surface_height : output->surface_width;
 }
 
-static inline i32 get_offset(struct output* output, struct zone* zone,
+static inline i32 get_offset(struct output* output,
+                             enum zone_position position, u32 width,
                              u32 offset, u32 position_width) {
-  switch (zone->position) {
+  switch (position) {
     case ZONE_POSITION_LEFT:
       return offset;
     case ZONE_POSITION_CENTER:
-      return ((output->surface_width - position_width) >> 1) + offset;
+      return ((get_length(output) - position_width) >> 1) + offset;
     case ZONE_POSITION_RIGHT:
-      return output->surface_width - offset - zone->width;
+      return get_length(output) - offset - width;
     default:
-      log_fatal("invalid zone position %d", zone->position);
+      log_fatal("invalid zone position %d", position);
   }
 }
 
+struct area {
+  u32 x, y;
+  u32 width, height;
+};
+
+/* The area that goes from start for length pixels along the bar, and for
+ * thickness pixels across it.
+ */
+static inline struct area get_area(u32 start, u32 length, u32 thickness) {
+  if (g_wl.vertical)
+    return (struct area) {
+      .x = 0, .y = start, .width = thickness, .height = length
+    };
+  else
+    return (struct area) {
+      .x = start, .y = 0, .width = length, .height = thickness
+    };
+}
+
 void wl_draw_zone(struct zone* zone, u32 offset, u32 position_width) {
+  i32 start;
+  struct area area;
   struct output* output;
-  i32 start_x, end_x;
-  const i32 start_y = 0, end_y = zone->height;
 
   list_for_each(output, &g_wl.outputs, link) {
     if (output->buffer == NULL) {
-      log_warn("output %s (id: %u) has buffer == NULL",
-               output_name(output), output->id);
+      log_warn_ratelimited("output %s (id: %u) has buffer == NULL",
+                           output_name(output), output->id);
       continue;
     }
 
-    /* NOTE: The following code only works for horizontal bars.
-     *       If we want to support vertical bars, we're going to have to
-     *       adapt this.
-     */
-
-    start_x = get_offset(output, zone, offset, position_width);
-    ASSERT(start_x >= 0);
-    ASSERT(start_x <= (i32)(output->surface_width - zone->width));
-
-    end_x = start_x + zone->width;
-    ASSERT(end_x >= (i32)zone->width);
-    ASSERT(end_x <= (i32)output->surface_width);
-
-    ASSERT(end_x > start_x);
-    ASSERT(end_y > start_y);
+    start = get_offset(output, zone->position, zone->width,
+                       offset, position_width);
+    ASSERT(start >= 0);
+    ASSERT(start + zone->width <= get_length(output));
 
-    ASSERT((u32)(end_x - start_x) == zone->width);
-    ASSERT((u32)(end_y - start_y) == zone->height);
+    /* The zone is stored the way it appears on screen, see struct zone. On
+     * vertical bars its rows span the whole surface, and it is copied in
+     * one go.
+     */
+    area = get_area(start, zone->width, zone->height);
+    ASSERT(area.x + area.width <= output->surface_width);
+    ASSERT(area.y + area.height <= output->surface_height);
 
-    fill_buffer_region(0, 0, start_x, start_y,
-                       zone->width, zone->height,
-                       zone->image_buffer, zone->width,
+    fill_buffer_region(0, 0, area.x, area.y,
+                       area.width, area.height,
+                       zone->image_buffer, area.width,
                        output->buffer, output->surface_width);
 
     wl_surface_damage_buffer(output->wl_surface,
-                             start_x, start_y,
-                             zone->width, zone->height);
+                             area.x, area.y,
+                             area.width, area.height);
 
     /* Mark the buffer as dirty */
     output->buffer_dirty = true;
@@ -754,8 +773,8 @@ void wl_clear(u32 color) {
   struct output* output;
   list_for_each(output, &g_wl.outputs, link) {
     if (output->buffer == NULL) {
-      log_warn("output %s (id: %u) has buffer == NULL",
-               output_name(output), output->id);
+      log_warn_ratelimited("output %s (id: %u) has buffer == NULL",
+                           output_name(output), output->id);
       continue;
     }
     /* Use wmemset(..) for semplicity */
@@ -766,3 +785,45 @@ void wl_clear(u32 color) {
     output->buffer_dirty = true;
   }
 }
+
+void wl_clear_area(enum zone_position position, u32 offset, u32 width,
+                   u32 position_width, u32 color) {
+  u32 y;
+  i32 start;
+  struct area area;
+  struct output* output;
+
+  list_for_each(output, &g_wl.outputs, link) {
+    if (output->buffer == NULL)
+      continue;
+
+    start = get_offset(output, position, width, offset, position_width);
+    if (start < 0 || start + width > get_length(output))
+      continue;
+
+    area = get_area(start, width, g_wl.vertical ? output->surface_width
+                                                : output->surface_height);
+    for (y = area.y; y < area.y + area.height; ++y)
+      wmemset((int*)&output->buffer[area.x + y * output->surface_width],
+              color, area.width);
+    wl_surface_damage_buffer(output->wl_surface,
+                             area.x, area.y, area.width, area.height);
+    /* Mark the buffer as dirty */
+    output->buffer_dirty = true;
+  }
+}
+
+u32 wl_get_length(void) {
+  u32 length;
+  struct output* output;
+
+  length = 0;
+  list_for_each(output, &g_wl.outputs, link) {
+    if (output->buffer == NULL)
+      continue;
+    if (length == 0 || get_length(output) < length)
+      length = get_length(output);
+  }
+
+  return length;
+}